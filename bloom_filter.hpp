@@ -23,11 +23,29 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <iterator>
 #include <limits>
 #include <string>
 #include <vector>
 
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+#include <immintrin.h>
+#endif
+
+#if defined(BLOOM_FILTER_THREADS)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(BLOOM_FILTER_PERF_EVENTS)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 
 static const std::size_t bits_per_char = 0x08;    // 8 bits in 1 char(unsigned)
 static const unsigned char bit_mask[bits_per_char] = {
@@ -156,297 +174,206 @@ public:
 
 };
 
-class bloom_filter
+struct bloom_key_view
 {
-protected:
-
-   typedef unsigned int bloom_type;
-   typedef unsigned char cell_type;
-
-public:
-
-   bloom_filter()
-   : bit_table_(0),
-     salt_count_(0),
-     table_size_(0),
-     raw_table_size_(0),
-     projected_element_count_(0),
-     inserted_element_count_(0),
-     random_seed_(0),
-     desired_false_positive_probability_(0.0)
+   /*
+     Note:
+     A non-owning (pointer,length) reference to a key, used to feed
+     keys into a filter without materialising std::string instances.
+   */
+   bloom_key_view()
+   : data(0),
+     length(0)
    {}
 
-   bloom_filter(const bloom_parameters& p)
-   : bit_table_(0),
-     projected_element_count_(p.projected_element_count),
-     inserted_element_count_(0),
-     random_seed_((p.random_seed * 0xA5A5A5A5) + 1),
-     desired_false_positive_probability_(p.false_positive_probability)
-   {
-      salt_count_ = p.optimal_parameters.number_of_hashes;
-      table_size_ = p.optimal_parameters.table_size;
-      generate_unique_salt();
-      raw_table_size_ = table_size_ / bits_per_char;
-      bit_table_ = new cell_type[static_cast<std::size_t>(raw_table_size_)];
-      std::fill_n(bit_table_,raw_table_size_,0x00);
-   }
-
-   bloom_filter(const bloom_filter& filter)
-   {
-      this->operator=(filter);
-   }
-
-   inline bool operator == (const bloom_filter& f) const
-   {
-      if (this != &f)
-      {
-         return
-            (salt_count_                         == f.salt_count_)                         &&
-            (table_size_                         == f.table_size_)                         &&
-            (raw_table_size_                     == f.raw_table_size_)                     &&
-            (projected_element_count_            == f.projected_element_count_)            &&
-            (inserted_element_count_             == f.inserted_element_count_)             &&
-            (random_seed_                        == f.random_seed_)                        &&
-            (desired_false_positive_probability_ == f.desired_false_positive_probability_) &&
-            (salt_                               == f.salt_)                               &&
-            std::equal(f.bit_table_,f.bit_table_ + raw_table_size_,bit_table_);
-      }
-      else
-         return true;
-   }
-
-   inline bool operator != (const bloom_filter& f) const
-   {
-      return !operator==(f);
-   }
-
-   inline bloom_filter& operator = (const bloom_filter& f)
-   {
-      if (this != &f)
-      {
-         salt_count_ = f.salt_count_;
-         table_size_ = f.table_size_;
-         raw_table_size_ = f.raw_table_size_;
-         projected_element_count_ = f.projected_element_count_;
-         inserted_element_count_ = f.inserted_element_count_;
-         random_seed_ = f.random_seed_;
-         desired_false_positive_probability_ = f.desired_false_positive_probability_;
-         delete[] bit_table_;
-         bit_table_ = new cell_type[static_cast<std::size_t>(raw_table_size_)];
-         std::copy(f.bit_table_,f.bit_table_ + raw_table_size_,bit_table_);
-         salt_ = f.salt_;
-      }
-      return *this;
-   }
+   bloom_key_view(const char* d, const std::size_t l)
+   : data(d),
+     length(l)
+   {}
 
-   virtual ~bloom_filter()
-   {
-      delete[] bit_table_;
-   }
+   const char* data;
+   std::size_t length;
+};
 
-   inline bool operator!() const
-   {
-      return (0 == table_size_);
-   }
+struct bloom_uint64
+{
+   /*
+     Note:
+     A 64-bit integer key hashed by the integer key path of
+     bloom_filter: mixed once and probed with h1 + i * h2 rather than
+     k passes of hash_ap. The path is opt in. A plain integer passed to
+     insert/contains is still hashed as its bytes, so it matches what
+     existing code, persisted tables and bloom_filter_client insert;
+     a key inserted as a bloom_uint64 must be queried as one.
+   */
+   bloom_uint64()
+   : value(0)
+   {}
 
-   inline void clear()
-   {
-      std::fill_n(bit_table_,raw_table_size_,0x00);
-      inserted_element_count_ = 0;
-   }
+   explicit bloom_uint64(const unsigned long long int v)
+   : value(v)
+   {}
 
-   inline void insert(const unsigned char* key_begin, const std::size_t& length)
-   {
-      std::size_t bit_index = 0;
-      std::size_t bit = 0;
-      for (std::size_t i = 0; i < salt_.size(); ++i)
-      {
-         compute_indices(hash_ap(key_begin,length,salt_[i]),bit_index,bit);
-         bit_table_[bit_index / bits_per_char] |= bit_mask[bit];
-      }
-      ++inserted_element_count_;
-   }
+   unsigned long long int value;
+};
 
-   template<typename T>
-   inline void insert(const T& t)
-   {
-      // Note: T must be a C++ POD type.
-      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
-   }
+struct bloom_uint128
+{
+   /*
+     Note:
+     A 128-bit integer key, e.g. a UUID, hashed by the integer key
+     path of bloom_filter rather than as 16 bytes (see bloom_uint64).
+   */
+   bloom_uint128()
+   : low(0),
+     high(0)
+   {}
 
-   inline void insert(const std::string& key)
-   {
-      insert(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
-   }
+   bloom_uint128(const unsigned long long int l, const unsigned long long int h)
+   : low(l),
+     high(h)
+   {}
 
-   inline void insert(const char* data, const std::size_t& length)
-   {
-      insert(reinterpret_cast<const unsigned char*>(data),length);
-   }
+   unsigned long long int low;
+   unsigned long long int high;
+};
 
-   template<typename InputIterator>
-   inline void insert(const InputIterator begin, const InputIterator end)
+namespace details
+{
+   inline unsigned int hash_ap(const unsigned char* begin, std::size_t remaining_length, unsigned int hash)
    {
-      InputIterator itr = begin;
-      while (end != itr)
+      const unsigned char* itr = begin;
+      unsigned int loop = 0;
+      while (remaining_length >= 8)
       {
-         insert(*(itr++));
+         const unsigned int& i1 = *(reinterpret_cast<const unsigned int*>(itr)); itr += sizeof(unsigned int);
+         const unsigned int& i2 = *(reinterpret_cast<const unsigned int*>(itr)); itr += sizeof(unsigned int);
+         hash ^= (hash <<  7) ^  i1 * (hash >> 3) ^
+              (~((hash << 11) + (i2 ^ (hash >> 5))));
+         remaining_length -= 8;
       }
-   }
-
-   inline virtual bool contains(const unsigned char* key_begin, const std::size_t length) const
-   {
-      std::size_t bit_index = 0;
-      std::size_t bit = 0;
-      for (std::size_t i = 0; i < salt_.size(); ++i)
+      if (remaining_length)
       {
-         compute_indices(hash_ap(key_begin,length,salt_[i]),bit_index,bit);
-         if ((bit_table_[bit_index / bits_per_char] & bit_mask[bit]) != bit_mask[bit])
+         if (remaining_length >= 4)
          {
-            return false;
+            const unsigned int& i = *(reinterpret_cast<const unsigned int*>(itr));
+            if (loop & 0x01)
+               hash ^=    (hash <<  7) ^  i * (hash >> 3);
+            else
+               hash ^= (~((hash << 11) + (i ^ (hash >> 5))));
+            ++loop;
+            remaining_length -= 4;
+            itr += sizeof(unsigned int);
          }
-      }
-      return true;
-   }
-
-   template<typename T>
-   inline bool contains(const T& t) const
-   {
-      return contains(reinterpret_cast<const unsigned char*>(&t),static_cast<std::size_t>(sizeof(T)));
-   }
-
-   inline bool contains(const std::string& key) const
-   {
-      return contains(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
-   }
-
-   inline bool contains(const char* data, const std::size_t& length) const
-   {
-      return contains(reinterpret_cast<const unsigned char*>(data),length);
-   }
-
-   template<typename InputIterator>
-   inline InputIterator contains_all(const InputIterator begin, const InputIterator end) const
-   {
-      InputIterator itr = begin;
-      while (end != itr)
-      {
-         if (!contains(*itr))
+         if (remaining_length >= 2)
          {
-            return itr;
+            const unsigned short& i = *(reinterpret_cast<const unsigned short*>(itr));
+            if (loop & 0x01)
+               hash ^=    (hash <<  7) ^  i * (hash >> 3);
+            else
+               hash ^= (~((hash << 11) + (i ^ (hash >> 5))));
+            ++loop;
+            remaining_length -= 2;
+            itr += sizeof(unsigned short);
          }
-         ++itr;
-      }
-      return end;
-   }
-
-   template<typename InputIterator>
-   inline InputIterator contains_none(const InputIterator begin, const InputIterator end) const
-   {
-      InputIterator itr = begin;
-      while (end != itr)
-      {
-         if (contains(*itr))
+         if (remaining_length)
          {
-            return itr;
+            hash += ((*itr) ^ (hash * 0xA5A5A5A5)) + loop;
          }
-         ++itr;
       }
-      return end;
+      return hash;
    }
 
-   inline virtual unsigned long long int size() const
+   inline unsigned long long int mix64(unsigned long long int h)
    {
-      return table_size_;
+      // MurmurHash3 64-bit finalizer.
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDULL;
+      h ^= h >> 33;
+      h *= 0xC4CEB9FE1A85EC53ULL;
+      h ^= h >> 33;
+      return h;
    }
 
-   inline std::size_t element_count() const
+   inline unsigned long long int hash64(const unsigned char* begin, const std::size_t length, const unsigned long long int seed)
    {
-      return inserted_element_count_;
+      /*
+        Note:
+        64-bit hash built from two differently salted hash_ap values,
+        finalised so that every output bit depends on both halves.
+      */
+      const unsigned long long int h0 = hash_ap(begin,length,static_cast<unsigned int>(seed)         ^ 0xAAAAAAAA);
+      const unsigned long long int h1 = hash_ap(begin,length,static_cast<unsigned int>(seed >> 32) ^ 0x55555555);
+      return mix64((h0 << 32) ^ h1 ^ seed);
    }
 
-   inline double effective_fpp() const
+   inline void integer_hash(const unsigned long long int low,
+                            const unsigned long long int high,
+                            const unsigned long long int seed,
+                            unsigned int& h1,
+                            unsigned int& h2)
    {
       /*
         Note:
-        The effective false positive probability is calculated using the
-        designated table size and hash function count in conjunction with
-        the current number of inserted elements - not the user defined
-        predicated/expected number of inserted elements.
+        Integer keys are mixed once with the Murmur3 finalizer and the
+        k probe hashes are derived as h1 + i * h2 (Kirsch and
+        Mitzenmacher), replacing k passes of hash_ap over the key bytes.
+        h2 is odd so that successive probe hashes never repeat.
       */
-      return std::pow(1.0 - std::exp(-1.0 * salt_.size() * inserted_element_count_ / size()), 1.0 * salt_.size());
-   }
+      unsigned long long int h = mix64(low ^ seed);
 
-   inline bloom_filter& operator &= (const bloom_filter& f)
-   {
-      /* intersection */
-      if (
-          (salt_count_  == f.salt_count_) &&
-          (table_size_  == f.table_size_) &&
-          (random_seed_ == f.random_seed_)
-         )
-      {
-         for (std::size_t i = 0; i < raw_table_size_; ++i)
-         {
-            bit_table_[i] &= f.bit_table_[i];
-         }
-      }
-      return *this;
+      if (high)
+         h = mix64(h ^ high);
+
+      h1 = static_cast<unsigned int>(h);
+      h2 = static_cast<unsigned int>(h >> 32) | 1;
    }
 
-   inline bloom_filter& operator |= (const bloom_filter& f)
+   inline unsigned int word_bit(const unsigned long long int bit_index)
    {
-      /* union */
-      if (
-          (salt_count_  == f.salt_count_) &&
-          (table_size_  == f.table_size_) &&
-          (random_seed_ == f.random_seed_)
-         )
-      {
-         for (std::size_t i = 0; i < raw_table_size_; ++i)
-         {
-            bit_table_[i] |= f.bit_table_[i];
-         }
-      }
-      return *this;
+      /*
+        Note:
+        Position of table bit bit_index within its 64-bit word. On big
+        endian hosts the byte order is reversed, so that on any host
+        bit i of a word table is in byte i / 8 of its memory, i.e. the
+        byte view of the table is the same.
+      */
+      #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+      return static_cast<unsigned int>(bit_index & 0x3F) ^ 0x38;
+      #else
+      return static_cast<unsigned int>(bit_index & 0x3F);
+      #endif
    }
 
-   inline bloom_filter& operator ^= (const bloom_filter& f)
+   inline void prefetch(const void* address)
    {
-      /* difference */
-      if (
-          (salt_count_  == f.salt_count_) &&
-          (table_size_  == f.table_size_) &&
-          (random_seed_ == f.random_seed_)
-         )
-      {
-         for (std::size_t i = 0; i < raw_table_size_; ++i)
-         {
-            bit_table_[i] ^= f.bit_table_[i];
-         }
-      }
-      return *this;
+      #if defined(__GNUC__)
+      __builtin_prefetch(address);
+      #else
+      static_cast<void>(address);
+      #endif
    }
 
-   inline const cell_type* table() const
+   inline bloom_key_view make_key_view(const std::string& key)
    {
-      return bit_table_;
+      return bloom_key_view(key.data(),key.size());
    }
 
-   inline std::size_t hash_count()
+   inline bloom_key_view make_key_view(const bloom_key_view& key)
    {
-      return salt_.size();
+      return key;
    }
 
-protected:
-
-   inline virtual void compute_indices(const bloom_type& hash, std::size_t& bit_index, std::size_t& bit) const
+   template<typename T>
+   inline bloom_key_view make_key_view(const T& t)
    {
-      bit_index = hash % table_size_;
-      bit = bit_index % bits_per_char;
+      // Note: T must be a C++ POD type.
+      return bloom_key_view(reinterpret_cast<const char*>(&t),sizeof(T));
    }
 
-   void generate_unique_salt()
+   inline void generate_salt(const unsigned int salt_count,
+                             const unsigned long long int random_seed,
+                             std::vector<unsigned int>& salt)
    {
       /*
         Note:
@@ -455,7 +382,7 @@ protected:
         hash function with different values seems to be adequate.
       */
       const unsigned int predef_salt_count = 128;
-      static const bloom_type predef_salt[predef_salt_count] =
+      static const unsigned int predef_salt[predef_salt_count] =
                                  {
                                     0xAAAAAAAA, 0x55555555, 0x33333333, 0xCCCCCCCC,
                                     0x66666666, 0x99999999, 0xB5B5B5B5, 0x4B4B4B4B,
@@ -491,12 +418,12 @@ protected:
                                     0xC569F575, 0xCDB2A091, 0x2CC016B4, 0x5C5F4421
                                  };
 
-      if (salt_count_ <= predef_salt_count)
+      if (salt_count <= predef_salt_count)
       {
          std::copy(predef_salt,
-                   predef_salt + salt_count_,
-                   std::back_inserter(salt_));
-          for (unsigned int i = 0; i < salt_.size(); ++i)
+                   predef_salt + salt_count,
+                   std::back_inserter(salt));
+          for (unsigned int i = 0; i < salt.size(); ++i)
           {
             /*
               Note:
@@ -504,175 +431,6274 @@ protected:
               so as to allow for the generation of unique bloom filter
               instances.
             */
-            salt_[i] = salt_[i] * salt_[(i + 3) % salt_.size()] + static_cast<bloom_type>(random_seed_);
+            salt[i] = salt[i] * salt[(i + 3) % salt.size()] + static_cast<unsigned int>(random_seed);
           }
       }
       else
       {
-         std::copy(predef_salt,predef_salt + predef_salt_count,std::back_inserter(salt_));
-         srand(static_cast<unsigned int>(random_seed_));
-         while (salt_.size() < salt_count_)
+         std::copy(predef_salt,predef_salt + predef_salt_count,std::back_inserter(salt));
+         // A splitmix64 sequence: deterministic and free of the global rand() state.
+         unsigned long long int state = random_seed;
+         while (salt.size() < salt_count)
          {
-            bloom_type current_salt = static_cast<bloom_type>(rand()) * static_cast<bloom_type>(rand());
+            state += 0x9E3779B97F4A7C15ULL;
+            const unsigned int current_salt = static_cast<unsigned int>(mix64(state));
             if (0 == current_salt) continue;
-            if (salt_.end() == std::find(salt_.begin(), salt_.end(), current_salt))
+            if (salt.end() == std::find(salt.begin(), salt.end(), current_salt))
             {
-               salt_.push_back(current_salt);
+               salt.push_back(current_salt);
             }
          }
       }
    }
+}
 
-   inline bloom_type hash_ap(const unsigned char* begin, std::size_t remaining_length, bloom_type hash) const
+class filter_schema_ptr;
+
+class filter_schema
+{
+   /*
+     Note:
+     The immutable shape of a bloom_filter: table size, hash count,
+     random seed and the salts derived from them, together with the
+     parameters the table was sized for. A filter is a schema and a
+     table; filters built from one schema, and copies of a filter,
+     share the schema rather than each generating and storing salts,
+     and set operations between them check compatibility with a
+     pointer compare. Schemas are reference counted through
+     filter_schema_ptr, atomically where GCC builtins are available.
+   */
+
+public:
+
+   static inline filter_schema_ptr create(const bloom_parameters& p);
+
+   static inline filter_schema_ptr create(const unsigned long long int table_size,
+                                          const unsigned int           salt_count,
+                                          const unsigned long long int random_seed,
+                                          const unsigned long long int projected_element_count,
+                                          const double                 false_positive_probability);
+
+   static inline const filter_schema* empty()
    {
-      const unsigned char* itr = begin;
-      unsigned int loop = 0;
-      while (remaining_length >= 8)
-      {
-         const unsigned int& i1 = *(reinterpret_cast<const unsigned int*>(itr)); itr += sizeof(unsigned int);
-         const unsigned int& i2 = *(reinterpret_cast<const unsigned int*>(itr)); itr += sizeof(unsigned int);
-         hash ^= (hash <<  7) ^  i1 * (hash >> 3) ^
-              (~((hash << 11) + (i2 ^ (hash >> 5))));
-         remaining_length -= 8;
+      // Shape of a default constructed filter, pinned by its initial reference.
+      static const filter_schema* schema = new filter_schema(0,0,0,0,0.0);
+      return schema;
+   }
+
+   inline bool compatible(const filter_schema& s) const
+   {
+      // Same bits for the same keys: the condition for set operations.
+      return (this == &s) ||
+             ((salt_count  == s.salt_count ) &&
+              (table_size  == s.table_size ) &&
+              (random_seed == s.random_seed));
+   }
+
+   inline bool operator == (const filter_schema& s) const
+   {
+      return (this == &s) ||
+             (compatible(s) &&
+              (projected_element_count    == s.projected_element_count   ) &&
+              (false_positive_probability == s.false_positive_probability));
+   }
+
+   const unsigned long long int    table_size;
+   const unsigned long long int    raw_table_size;
+   const unsigned int              salt_count;
+   const unsigned long long int    random_seed;  // internal form, (seed * 0xA5A5A5A5) + 1
+   const unsigned long long int    projected_element_count;
+   const double                    false_positive_probability;
+   const std::vector<unsigned int> salt;
+
+private:
+
+   friend class filter_schema_ptr;
+
+   filter_schema(const unsigned long long int ts,
+                 const unsigned int           sc,
+                 const unsigned long long int rs,
+                 const unsigned long long int pec,
+                 const double                 fpp)
+   : table_size(ts),
+     raw_table_size(ts / bits_per_char),
+     salt_count(sc),
+     random_seed(rs),
+     projected_element_count(pec),
+     false_positive_probability(fpp),
+     salt(generate(sc,rs)),
+     references_(1)
+   {}
+
+   filter_schema(const filter_schema&);
+   filter_schema& operator=(const filter_schema&);
+
+   static inline std::vector<unsigned int> generate(const unsigned int salt_count, const unsigned long long int random_seed)
+   {
+      std::vector<unsigned int> result;
+      details::generate_salt(salt_count,random_seed,result);
+      return result;
+   }
+
+   inline void acquire() const
+   {
+      #if defined(__GNUC__)
+      __atomic_add_fetch(&references_,1U,__ATOMIC_RELAXED);
+      #else
+      ++references_;
+      #endif
+   }
+
+   inline void release() const
+   {
+      #if defined(__GNUC__)
+      if (0 == __atomic_sub_fetch(&references_,1U,__ATOMIC_ACQ_REL))
+      #else
+      if (0 == --references_)
+      #endif
+      {
+         delete this;
+      }
+   }
+
+   mutable unsigned int references_;
+};
+
+class filter_schema_ptr
+{
+public:
+
+   filter_schema_ptr()
+   : schema_(filter_schema::empty())
+   {
+      schema_->acquire();
+   }
+
+   filter_schema_ptr(const filter_schema_ptr& p)
+   : schema_(p.schema_)
+   {
+      schema_->acquire();
+   }
+
+  ~filter_schema_ptr()
+   {
+      schema_->release();
+   }
+
+   inline filter_schema_ptr& operator=(const filter_schema_ptr& p)
+   {
+      p.schema_->acquire();
+      schema_->release();
+      schema_ = p.schema_;
+      return *this;
+   }
+
+   inline const filter_schema* get() const
+   {
+      return schema_;
+   }
+
+   inline const filter_schema* operator->() const
+   {
+      return schema_;
+   }
+
+   inline const filter_schema& operator*() const
+   {
+      return *schema_;
+   }
+
+   inline bool operator == (const filter_schema_ptr& p) const
+   {
+      return (schema_ == p.schema_);
+   }
+
+   inline bool operator != (const filter_schema_ptr& p) const
+   {
+      return (schema_ != p.schema_);
+   }
+
+private:
+
+   friend class filter_schema;
+
+   explicit filter_schema_ptr(const filter_schema* schema)
+   : schema_(schema)
+   {}
+
+   const filter_schema* schema_;
+};
+
+inline filter_schema_ptr filter_schema::create(const bloom_parameters& p)
+{
+   return create(p.optimal_parameters.table_size,
+                 p.optimal_parameters.number_of_hashes,
+                 (p.random_seed * 0xA5A5A5A5) + 1,
+                 p.projected_element_count,
+                 p.false_positive_probability);
+}
+
+inline filter_schema_ptr filter_schema::create(const unsigned long long int table_size,
+                                               const unsigned int           salt_count,
+                                               const unsigned long long int random_seed,
+                                               const unsigned long long int projected_element_count,
+                                               const double                 false_positive_probability)
+{
+   return filter_schema_ptr(new filter_schema(table_size,salt_count,random_seed,projected_element_count,false_positive_probability));
+}
+
+class bloom_filter
+{
+   friend class filter_collection;
+
+protected:
+
+   typedef unsigned int bloom_type;
+   typedef unsigned char cell_type;
+   typedef unsigned long long int word_type;
+
+   enum { bits_per_word = 64 };
+
+public:
+
+   enum query_strategy_t
+   {
+      e_early_exit = 0, // test each bit as soon as it is hashed
+      e_branchless = 1, // test all k bits, combine without branching
+      e_adaptive   = 2  // pick one of the above from the observed negative rate
+   };
+
+   bloom_filter()
+   : bit_table_(0),
+     inserted_element_count_(0),
+     generation_(0),
+     removal_generation_(0),
+     query_strategy_(e_early_exit),
+     adaptive_queries_(0),
+     adaptive_negatives_(0),
+     adaptive_branchless_(false)
+   {}
+
+   bloom_filter(const bloom_parameters& p)
+   : schema_(filter_schema::create(p)),
+     bit_table_(0),
+     inserted_element_count_(0),
+     generation_(0),
+     removal_generation_(0),
+     query_strategy_(e_early_exit),
+     adaptive_queries_(0),
+     adaptive_negatives_(0),
+     adaptive_branchless_(false)
+   {
+      allocate_table();
+   }
+
+   explicit bloom_filter(const filter_schema_ptr& schema)
+   : schema_(schema),
+     bit_table_(0),
+     inserted_element_count_(0),
+     generation_(0),
+     removal_generation_(0),
+     query_strategy_(e_early_exit),
+     adaptive_queries_(0),
+     adaptive_negatives_(0),
+     adaptive_branchless_(false)
+   {
+      // An empty filter of the given shape, sharing its salts.
+      allocate_table();
+   }
+
+   bloom_filter(const bloom_filter& filter)
+   : bit_table_(0),
+     generation_(0),
+     removal_generation_(0)
+   {
+      this->operator=(filter);
+   }
+
+   inline bool operator == (const bloom_filter& f) const
+   {
+      if (this != &f)
+      {
+         return
+            (inserted_element_count_ == f.inserted_element_count_) &&
+            ((schema_ == f.schema_) || (*schema_ == *f.schema_))   &&
+            std::equal(f.bit_table_,f.bit_table_ + word_count(),bit_table_);
+      }
+      else
+         return true;
+   }
+
+   inline bool operator != (const bloom_filter& f) const
+   {
+      return !operator==(f);
+   }
+
+   inline bloom_filter& operator = (const bloom_filter& f)
+   {
+      if (this != &f)
+      {
+         schema_ = f.schema_;
+         inserted_element_count_ = f.inserted_element_count_;
+         delete[] bit_table_;
+         bit_table_ = new word_type[f.word_count()];
+         std::copy(f.bit_table_,f.bit_table_ + f.word_count(),bit_table_);
+         query_strategy_ = f.query_strategy_;
+         adaptive_queries_ = 0;
+         adaptive_negatives_ = 0;
+         adaptive_branchless_ = false;
+         removed_bits();
+      }
+      return *this;
+   }
+
+   virtual ~bloom_filter()
+   {
+      delete[] bit_table_;
+   }
+
+   inline bool operator!() const
+   {
+      return (0 == schema_->table_size);
+   }
+
+   inline void clear()
+   {
+      std::fill_n(bit_table_,word_count(),0ULL);
+      inserted_element_count_ = 0;
+      removed_bits();
+   }
+
+   inline void insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         set_bit(bit_index);
+      }
+      ++inserted_element_count_;
+      ++generation_;
+   }
+
+   template<typename T>
+   inline void insert(const T& t)
+   {
+      // Note: T must be a C++ POD type.
+      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline void insert(const std::string& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline void insert(const char* data, const std::size_t& length)
+   {
+      insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline void insert(const bloom_key_view& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const bloom_uint64& key)
+   {
+      insert_integer(key.value,0);
+   }
+
+   inline void insert(const bloom_uint128& key)
+   {
+      insert_integer(key.low,key.high);
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   inline void insert_batch(const bloom_uint64* keys, const std::size_t count)
+   {
+      /*
+        Note:
+        Inserts count 64-bit integer keys by the integer key path, see
+        bloom_uint64. Keys are mixed a block at a
+        time, a loop the compiler can vectorise, and the first probe of
+        every key in the block is prefetched before any bit is set.
+      */
+      bloom_type h1[integer_block_size];
+      bloom_type h2[integer_block_size];
+
+      for (std::size_t base = 0; base < count; base += integer_block_size)
+      {
+         const std::size_t n = std::min<std::size_t>(integer_block_size,count - base);
+
+         hash_integer_block(keys + base,n,h1,h2);
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            std::size_t bit_index = 0;
+            for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1[j] += h2[j])
+            {
+               compute_index(h1[j],bit_index);
+               set_bit(bit_index);
+            }
+         }
+
+         inserted_element_count_ += static_cast<unsigned int>(n);
+      }
+
+      ++generation_;
+   }
+
+   inline virtual bool contains(const unsigned char* key_begin, const std::size_t length) const
+   {
+      switch (query_strategy_)
+      {
+         case e_branchless : return contains_branchless(key_begin,length);
+         case e_adaptive   : return contains_adaptive  (key_begin,length);
+         default           : return contains_early_exit(key_begin,length);
+      }
+   }
+
+   template<typename T>
+   inline bool contains(const T& t) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(&t),static_cast<std::size_t>(sizeof(T)));
+   }
+
+   inline bool contains(const std::string& key) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline bool contains(const char* data, const std::size_t& length) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline bool contains(const bloom_key_view& key) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline bool contains(const bloom_uint64& key) const
+   {
+      return contains_integer(key.value,0);
+   }
+
+   inline bool contains(const bloom_uint128& key) const
+   {
+      return contains_integer(key.low,key.high);
+   }
+
+   inline void contains_batch(const bloom_uint64* keys, const std::size_t count, bool* results) const
+   {
+      /*
+        Note:
+        Writes contains(keys[i]) to results[i]. As with insert_batch the
+        keys are mixed a block at a time and the first probe of every
+        key in the block is prefetched before any of them is tested.
+      */
+      bloom_type h1[integer_block_size];
+      bloom_type h2[integer_block_size];
+
+      for (std::size_t base = 0; base < count; base += integer_block_size)
+      {
+         const std::size_t n = std::min<std::size_t>(integer_block_size,count - base);
+
+         hash_integer_block(keys + base,n,h1,h2);
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            results[base + j] = contains_hashed(h1[j],h2[j]);
+         }
+      }
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_all(const InputIterator begin, const InputIterator end) const
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         if (!contains(*itr))
+         {
+            return itr;
+         }
+         ++itr;
+      }
+      return end;
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_none(const InputIterator begin, const InputIterator end) const
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         if (contains(*itr))
+         {
+            return itr;
+         }
+         ++itr;
+      }
+      return end;
+   }
+
+   template<typename InputIterator>
+   inline void contains_interleaved(const InputIterator begin,
+                                    const InputIterator end,
+                                    bool* results,
+                                    const std::size_t group_size = 16) const
+   {
+      /*
+        Note:
+        Answers contains() for every key in [begin,end), writing the
+        i-th answer to results[i]. Up to group_size lookups are in
+        flight at once: each lookup computes its next probe, prefetches
+        the cache line holding it and yields to the next lookup in the
+        group, so the memory latency of one lookup is overlapped with
+        the hashing of the others. Worthwhile when the table is much
+        larger than the last level cache.
+      */
+      std::vector<lookup_state> group(std::max<std::size_t>(1,std::min<std::size_t>(group_size,64)));
+
+      InputIterator itr = begin;
+      std::size_t next_result = 0;
+      std::size_t in_flight   = 0;
+
+      for (std::size_t i = 0; (i < group.size()) && (end != itr); ++i, ++itr)
+      {
+         start_lookup(group[i],*itr,next_result++);
+         ++in_flight;
+      }
+
+      while (in_flight)
+      {
+         for (std::size_t i = 0; i < group.size(); ++i)
+         {
+            lookup_state& state = group[i];
+
+            if (!state.active)
+               continue;
+
+            if (!step_lookup(state))
+               continue;
+
+            results[state.result_index] = state.result;
+            state.active = false;
+            --in_flight;
+
+            if (end != itr)
+            {
+               start_lookup(state,*itr,next_result++);
+               ++itr;
+               ++in_flight;
+            }
+         }
+      }
+   }
+
+   enum { max_mask_keys = 32, mask_group_size = 8 };
+
+   inline unsigned int contains_mask(const bloom_key_view* keys, const std::size_t count) const
+   {
+      /*
+        Note:
+        Answers contains() for up to max_mask_keys keys, e.g. the
+        variants of one key, setting bit i of the result when keys[i]
+        is possibly in the set. The keys are looked up in groups of up
+        to mask_group_size, all lookups of a group in flight at once as
+        in contains_interleaved, but without any allocation.
+      */
+      lookup_state group[mask_group_size];
+
+      const std::size_t n = std::min<std::size_t>(count,max_mask_keys);
+
+      unsigned int result = 0;
+
+      for (std::size_t first = 0; first < n; first += mask_group_size)
+      {
+         const std::size_t group_size = std::min<std::size_t>(n - first,mask_group_size);
+
+         for (std::size_t i = 0; i < group_size; ++i)
+         {
+            start_lookup(group[i],keys[first + i],first + i);
+         }
+
+         std::size_t in_flight = group_size;
+
+         while (in_flight)
+         {
+            for (std::size_t i = 0; i < group_size; ++i)
+            {
+               lookup_state& state = group[i];
+
+               if (!state.active || !step_lookup(state))
+                  continue;
+
+               if (state.result)
+                  result |= (1U << state.result_index);
+
+               state.active = false;
+               --in_flight;
+            }
+         }
+      }
+
+      return result;
+   }
+
+   inline virtual unsigned long long int size() const
+   {
+      return schema_->table_size;
+   }
+
+   inline std::size_t element_count() const
+   {
+      return inserted_element_count_;
+   }
+
+   inline double effective_fpp() const
+   {
+      /*
+        Note:
+        The effective false positive probability is calculated using the
+        designated table size and hash function count in conjunction with
+        the current number of inserted elements - not the user defined
+        predicated/expected number of inserted elements.
+      */
+      return std::pow(1.0 - std::exp(-1.0 * schema_->salt.size() * inserted_element_count_ / size()), 1.0 * schema_->salt.size());
+   }
+
+   inline double effective_fpp(const bool use_fill_ratio) const
+   {
+      /*
+        Note:
+        When use_fill_ratio is set the false positive probability is
+        derived from the observed proportion of set bits in the table,
+        which remains valid after set operations or after loading a
+        table that was populated elsewhere.
+      */
+      if (!use_fill_ratio)
+         return effective_fpp();
+      else
+         return std::pow(fill_ratio(), 1.0 * schema_->salt.size());
+   }
+
+   inline unsigned long long int bit_count() const
+   {
+      return popcount(bit_table_,word_count());
+   }
+
+   inline double fill_ratio() const
+   {
+      return (1.0 * bit_count()) / size();
+   }
+
+   inline double estimated_element_count() const
+   {
+      /*
+        Note:
+        Swamidass-Baldi estimate of the number of distinct elements
+        inserted, based solely on the number of set bits X:
+        n* = -(m / k) * ln(1 - X / m)
+      */
+      return estimate_cardinality(bit_count());
+   }
+
+   inline double estimated_union_count(const bloom_filter& f) const
+   {
+      /*
+        Note:
+        Estimated cardinality of the union of the two filters' sets.
+        Returns a negative value if the filters are not compatible.
+      */
+      if (!compatible(f))
+         return -1.0;
+
+      const std::size_t words = word_count();
+      unsigned long long int union_bits = 0;
+
+      for (std::size_t i = 0; i < words; ++i)
+      {
+         union_bits += popcount64(bit_table_[i] | f.bit_table_[i]);
+      }
+
+      return estimate_cardinality(union_bits);
+   }
+
+   inline double estimated_intersection_count(const bloom_filter& f) const
+   {
+      /*
+        Note:
+        Estimated cardinality of the intersection of the two filters'
+        sets: n(A) + n(B) - n(A u B). Returns a negative value if the
+        filters are not compatible.
+      */
+      if (!compatible(f))
+         return -1.0;
+
+      const double intersection = estimated_element_count() + f.estimated_element_count() - estimated_union_count(f);
+
+      return (intersection > 0.0) ? intersection : 0.0;
+   }
+
+   inline bloom_filter& operator &= (const bloom_filter& f)
+   {
+      /* intersection */
+      if ((schema_ == f.schema_) || schema_->compatible(*f.schema_))
+      {
+         const std::size_t words = word_count();
+
+         for (std::size_t i = 0; i < words; ++i)
+         {
+            bit_table_[i] &= f.bit_table_[i];
+         }
+
+         removed_bits();
+      }
+      return *this;
+   }
+
+   inline bloom_filter& operator |= (const bloom_filter& f)
+   {
+      /* union */
+      if ((schema_ == f.schema_) || schema_->compatible(*f.schema_))
+      {
+         const std::size_t words = word_count();
+
+         for (std::size_t i = 0; i < words; ++i)
+         {
+            bit_table_[i] |= f.bit_table_[i];
+         }
+
+         ++generation_;
+      }
+      return *this;
+   }
+
+   inline bloom_filter& operator ^= (const bloom_filter& f)
+   {
+      /* difference */
+      if ((schema_ == f.schema_) || schema_->compatible(*f.schema_))
+      {
+         const std::size_t words = word_count();
+
+         for (std::size_t i = 0; i < words; ++i)
+         {
+            bit_table_[i] ^= f.bit_table_[i];
+         }
+
+         removed_bits();
+      }
+      return *this;
+   }
+
+   inline const cell_type* table() const
+   {
+      // Byte view: bit i is in byte i / 8, as bit i % 8.
+      return reinterpret_cast<const cell_type*>(bit_table_);
+   }
+
+   inline void set_query_strategy(const query_strategy_t strategy)
+   {
+      query_strategy_ = strategy;
+   }
+
+   inline query_strategy_t query_strategy() const
+   {
+      return query_strategy_;
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return schema_->salt.size();
+   }
+
+   inline const filter_schema_ptr& schema() const
+   {
+      return schema_;
+   }
+
+protected:
+
+   enum { integer_block_size = 8 };
+
+   struct lookup_state
+   {
+      lookup_state()
+      : probe(0),
+        bit_index(0),
+        result_index(0),
+        hash(0),
+        step(0),
+        integer(false),
+        result(false),
+        active(false)
+      {}
+
+      bloom_key_view key;
+      std::size_t    probe;
+      std::size_t    bit_index;
+      std::size_t    result_index;
+      bloom_type     hash;
+      bloom_type     step;
+      bool           integer;
+      bool           result;
+      bool           active;
+   };
+
+   inline void start_lookup(lookup_state& state, const bloom_key_view& key, const std::size_t result_index) const
+   {
+      state.key          = key;
+      state.probe        = 0;
+      state.result_index = result_index;
+      state.integer      = false;
+      state.result       = true;
+      state.active       = true;
+
+      if (!schema_->salt.empty())
+      {
+         compute_index(hash_ap(reinterpret_cast<const unsigned char*>(key.data),key.length,schema_->salt[0]),state.bit_index);
+         details::prefetch(bit_table_ + (state.bit_index / bits_per_word));
+      }
+   }
+
+   template<typename T>
+   inline void start_lookup(lookup_state& state, const T& t, const std::size_t result_index) const
+   {
+      start_lookup(state,details::make_key_view(t),result_index);
+   }
+
+   inline void start_lookup(lookup_state& state, const bloom_uint64& key, const std::size_t result_index) const
+   {
+      start_integer_lookup(state,key.value,0,result_index);
+   }
+
+   inline void start_lookup(lookup_state& state, const bloom_uint128& key, const std::size_t result_index) const
+   {
+      start_integer_lookup(state,key.low,key.high,result_index);
+   }
+
+   inline void start_integer_lookup(lookup_state& state,
+                                    const unsigned long long int low,
+                                    const unsigned long long int high,
+                                    const std::size_t result_index) const
+   {
+      state.probe        = 0;
+      state.result_index = result_index;
+      state.integer      = true;
+      state.result       = true;
+      state.active       = true;
+
+      integer_hash(low,high,state.hash,state.step);
+
+      if (!schema_->salt.empty())
+      {
+         compute_index(state.hash,state.bit_index);
+         details::prefetch(bit_table_ + (state.bit_index / bits_per_word));
+      }
+   }
+
+   inline bool step_lookup(lookup_state& state) const
+   {
+      // Tests the previously prefetched probe and, unless the lookup is
+      // complete, prefetches the next one. Returns true when complete.
+      if (state.probe >= schema_->salt.size())
+         return true;
+
+      if (!test_bit(state.bit_index))
+      {
+         state.result = false;
+         return true;
+      }
+
+      if (++state.probe >= schema_->salt.size())
+         return true;
+
+      if (state.integer)
+         compute_index(state.hash += state.step,state.bit_index);
+      else
+         compute_index(hash_ap(reinterpret_cast<const unsigned char*>(state.key.data),state.key.length,schema_->salt[state.probe]),state.bit_index);
+      details::prefetch(bit_table_ + (state.bit_index / bits_per_word));
+
+      return false;
+   }
+
+   inline bool contains_early_exit(const unsigned char* key_begin, const std::size_t length) const
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         if (!test_bit(bit_index))
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   inline bool contains_branchless(const unsigned char* key_begin, const std::size_t length) const
+   {
+      /*
+        Note:
+        Every probe is computed and its bit folded into the result, so
+        the cost is k probes regardless of the outcome and there is no
+        data dependent branch to mispredict. The loads are independent
+        and can be overlapped by the processor.
+      */
+      std::size_t bit_index = 0;
+      word_type result = 0x01;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         result &= bit_table_[bit_index / bits_per_word] >> details::word_bit(bit_index);
+      }
+      return (0x01 == (result & 0x01));
+   }
+
+   inline bool contains_adaptive(const unsigned char* key_begin, const std::size_t length) const
+   {
+      /*
+        Note:
+        The negative rate is measured over windows of queries. Early
+        exit is used when nearly all queries agree (branches predict
+        well and negatives exit after a probe or two), branchless when
+        the outcome is mixed. The window counters are updated with
+        relaxed accesses; under concurrent use they are approximate,
+        which only affects the choice of strategy, never the result.
+      */
+      static const unsigned int window = 1024;
+      static const unsigned int low_negative_count  = window / 10;
+      static const unsigned int high_negative_count = window - (window / 10);
+
+      const bool result = relaxed_load(adaptive_branchless_) ?
+                          contains_branchless(key_begin,length) :
+                          contains_early_exit(key_begin,length);
+
+      const unsigned int queries   = relaxed_load(adaptive_queries_) + 1;
+      const unsigned int negatives = relaxed_load(adaptive_negatives_) + (result ? 0 : 1);
+
+      if (queries < window)
+      {
+         relaxed_store(adaptive_queries_,queries);
+         relaxed_store(adaptive_negatives_,negatives);
+      }
+      else
+      {
+         relaxed_store(adaptive_branchless_,(negatives > low_negative_count) && (negatives < high_negative_count));
+         relaxed_store(adaptive_queries_,0U);
+         relaxed_store(adaptive_negatives_,0U);
+      }
+
+      return result;
+   }
+
+   inline void integer_hash(const unsigned long long int low, const unsigned long long int high, bloom_type& h1, bloom_type& h2) const
+   {
+      details::integer_hash(low,high,schema_->random_seed,h1,h2);
+   }
+
+   inline void insert_integer(const unsigned long long int low, const unsigned long long int high)
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1 += h2)
+      {
+         compute_index(h1,bit_index);
+         set_bit(bit_index);
+      }
+      ++inserted_element_count_;
+      ++generation_;
+   }
+
+   inline bool contains_integer(const unsigned long long int low, const unsigned long long int high) const
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+      return contains_hashed(h1,h2);
+   }
+
+   inline bool contains_hashed(bloom_type h1, const bloom_type h2) const
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1 += h2)
+      {
+         compute_index(h1,bit_index);
+         if (!test_bit(bit_index))
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   inline void hash_integer_block(const bloom_uint64* keys, const std::size_t n, bloom_type* h1, bloom_type* h2) const
+   {
+      for (std::size_t j = 0; j < n; ++j)
+      {
+         integer_hash(keys[j].value,0,h1[j],h2[j]);
+      }
+
+      if (schema_->salt.empty())
+         return;
+
+      std::size_t bit_index = 0;
+      for (std::size_t j = 0; j < n; ++j)
+      {
+         compute_index(h1[j],bit_index);
+         details::prefetch(bit_table_ + (bit_index / bits_per_word));
+      }
+   }
+
+   template<typename T>
+   static inline T relaxed_load(const T& value)
+   {
+      #if defined(__GNUC__)
+      return __atomic_load_n(&value,__ATOMIC_RELAXED);
+      #else
+      return value;
+      #endif
+   }
+
+   template<typename T>
+   static inline void relaxed_store(T& value, const T new_value)
+   {
+      #if defined(__GNUC__)
+      __atomic_store_n(&value,new_value,__ATOMIC_RELAXED);
+      #else
+      value = new_value;
+      #endif
+   }
+
+   inline bool compatible(const bloom_filter& f) const
+   {
+      return ((schema_ == f.schema_) || schema_->compatible(*f.schema_)) &&
+             (size() == f.size());
+   }
+
+   inline double estimate_cardinality(const unsigned long long int set_bits) const
+   {
+      const double m = static_cast<double>(size());
+
+      if (set_bits >= size())
+         return std::numeric_limits<double>::infinity();
+      else if (schema_->salt.empty())
+         return 0.0;
+
+      return -(m / schema_->salt.size()) * std::log(1.0 - (set_bits / m));
+   }
+
+   static inline unsigned long long int popcount64(unsigned long long int v)
+   {
+      #if defined(__GNUC__)
+      return static_cast<unsigned long long int>(__builtin_popcountll(v));
+      #else
+      v = v - ((v >> 1) & 0x5555555555555555ULL);
+      v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+      v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+      return (v * 0x0101010101010101ULL) >> 56;
+      #endif
+   }
+
+   static inline unsigned long long int popcount(const word_type* table, const std::size_t length)
+   {
+      /*
+        Note:
+        Compile with -mpopcnt (or -march=native) so that popcount64 is
+        lowered to the POPCNT instruction. When AVX-512 VPOPCNTDQ is
+        available the bulk of the table is counted 512 bits at a time.
+      */
+      unsigned long long int count = 0;
+      std::size_t i = 0;
+
+      #if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+      __m512i accumulator = _mm512_setzero_si512();
+      for (; (i + 8) <= length; i += 8)
+      {
+         accumulator = _mm512_add_epi64(accumulator,_mm512_popcnt_epi64(_mm512_loadu_si512(table + i)));
+      }
+      unsigned long long int lanes[8];
+      _mm512_storeu_si512(lanes,accumulator);
+      for (std::size_t j = 0; j < 8; ++j)
+      {
+         count += lanes[j];
+      }
+      #endif
+
+      for (; i < length; ++i)
+      {
+         count += popcount64(table[i]);
+      }
+
+      return count;
+   }
+
+   inline void compute_index(const bloom_type& hash, std::size_t& bit_index) const
+   {
+      std::size_t bit = 0;
+      compute_indices(hash,bit_index,bit);
+   }
+
+   inline virtual void compute_indices(const bloom_type& hash, std::size_t& bit_index, std::size_t& bit) const
+   {
+      /*
+        Note:
+        The override point for the probe position. bit, the position
+        within the byte of the original byte table, is no longer read:
+        the table is held as 64-bit words and addressed by bit_index
+        alone.
+      */
+      bit_index = hash % schema_->table_size;
+      bit = bit_index % bits_per_char;
+   }
+
+   inline void set_bit(const std::size_t bit_index)
+   {
+      bit_table_[bit_index / bits_per_word] |= (1ULL << details::word_bit(bit_index));
+   }
+
+   inline void removed_bits()
+   {
+      // The table may have lost bits: results from before now are stale.
+      removal_generation_ = ++generation_;
+   }
+
+   inline bool test_bit(const std::size_t bit_index) const
+   {
+      return 0 != (bit_table_[bit_index / bits_per_word] & (1ULL << details::word_bit(bit_index)));
+   }
+
+   inline std::size_t word_count() const
+   {
+      // Bits past size() in the last word are always zero.
+      return static_cast<std::size_t>((size() + bits_per_word - 1) / bits_per_word);
+   }
+
+   inline void allocate_table()
+   {
+      bit_table_ = new word_type[word_count()];
+      std::fill_n(bit_table_,word_count(),0ULL);
+   }
+
+   inline bloom_type hash_ap(const unsigned char* begin, std::size_t remaining_length, bloom_type hash) const
+   {
+      return details::hash_ap(begin,remaining_length,hash);
+   }
+
+   filter_schema_ptr       schema_;
+   word_type*              bit_table_;
+   unsigned int            inserted_element_count_;
+   unsigned int            generation_;          // bumped by every change to the table
+   unsigned int            removal_generation_;  // generation_ of the last change that may clear bits
+   query_strategy_t        query_strategy_;
+   mutable unsigned int    adaptive_queries_;
+   mutable unsigned int    adaptive_negatives_;
+   mutable bool            adaptive_branchless_;
+};
+
+inline bloom_filter operator & (const bloom_filter& a, const bloom_filter& b)
+{
+   bloom_filter result = a;
+   result &= b;
+   return result;
+}
+
+inline bloom_filter operator | (const bloom_filter& a, const bloom_filter& b)
+{
+   bloom_filter result = a;
+   result |= b;
+   return result;
+}
+
+inline bloom_filter operator ^ (const bloom_filter& a, const bloom_filter& b)
+{
+   bloom_filter result = a;
+   result ^= b;
+   return result;
+}
+
+class compressible_bloom_filter : public bloom_filter
+{
+public:
+
+   compressible_bloom_filter(const bloom_parameters& p)
+   : bloom_filter(p)
+   {
+      size_list.push_back(schema_->table_size);
+   }
+
+   inline unsigned long long int size() const
+   {
+      return size_list.back();
+   }
+
+   inline bool compress(const double& percentage)
+   {
+      if ((0.0 >= percentage) || (percentage >= 100.0))
+      {
+         return false;
+      }
+
+      unsigned long long int original_table_size = size_list.back();
+      unsigned long long int new_table_size = static_cast<unsigned long long int>((size_list.back() * (1.0 - (percentage / 100.0))));
+      new_table_size -= (((new_table_size % bits_per_char) != 0) ? (new_table_size % bits_per_char) : 0);
+
+      if ((bits_per_char > new_table_size) || (new_table_size >= original_table_size))
+      {
+         return false;
+      }
+
+      schema_ = filter_schema::create(schema_->table_size,
+                                      schema_->salt_count,
+                                      schema_->random_seed,
+                                      schema_->projected_element_count,
+                                      effective_fpp());
+      const std::size_t new_bytes = static_cast<std::size_t>(new_table_size      / bits_per_char);
+      const std::size_t old_bytes = static_cast<std::size_t>(original_table_size / bits_per_char);
+      const std::size_t new_words = (new_bytes + sizeof(word_type) - 1) / sizeof(word_type);
+
+      word_type* tmp = new word_type[new_words];
+      std::fill_n(tmp,new_words,0ULL);
+
+      // Fold the byte view: bit b moves to b % new_table_size.
+      const cell_type* itr = table();
+      cell_type* itr_tmp = reinterpret_cast<cell_type*>(tmp);
+
+      for (std::size_t i = 0; i < old_bytes; ++i)
+      {
+         itr_tmp[i % new_bytes] |= itr[i];
+      }
+
+      delete[] bit_table_;
+      bit_table_ = tmp;
+      size_list.push_back(new_table_size);
+      removed_bits();
+
+      return true;
+   }
+
+private:
+
+   inline void compute_indices(const bloom_type& hash, std::size_t& bit_index, std::size_t& bit) const
+   {
+      bit_index = hash;
+      for (std::size_t i = 0; i < size_list.size(); ++i)
+      {
+         bit_index %= size_list[i];
+      }
+      bit = bit_index % bits_per_char;
+   }
+
+   std::vector<unsigned long long int> size_list;
+};
+
+template<typename FingerprintType>
+class xor_filter
+{
+   /*
+     Note:
+     Static XOR filter (Graf and Lemire) for an immutable key set. Each
+     key maps to one slot in each of three blocks, and the fingerprints
+     are assigned such that the XOR of a key's three slots equals the
+     key's fingerprint. A query therefore costs three memory accesses,
+     the table occupies about 1.23 fingerprints per key, and the false
+     positive probability is 2^-(bits in FingerprintType). Keys cannot
+     be added once the filter is built.
+   */
+
+public:
+
+   typedef FingerprintType fingerprint_type;
+
+   xor_filter()
+   : seed_(0),
+     block_length_(0),
+     element_count_(0)
+   {}
+
+   template<typename InputIterator>
+   inline bool build(const InputIterator begin, const InputIterator end, const unsigned int thread_count = 1)
+   {
+      /*
+        Note:
+        Accepts the same key types as bloom_filter::insert(begin,end).
+        Duplicate keys are permitted. With BLOOM_FILTER_THREADS defined
+        the keys are hashed by thread_count workers (0 selects the
+        number of online processors); the peeling phase is sequential.
+        Returns false if no peelable hypergraph was found.
+      */
+      const std::size_t count = static_cast<std::size_t>(std::distance(begin,end));
+
+      std::vector<bloom_key_view> keys;
+      keys.reserve(count);
+
+      for (InputIterator itr = begin; itr != end; ++itr)
+      {
+         keys.push_back(details::make_key_view(*itr));
+      }
+
+      static const unsigned int max_attempts = 100;
+
+      unsigned long long int seed = 0x726B2B9D438B9D4DULL;
+
+      for (unsigned int attempt = 0; attempt < max_attempts; ++attempt)
+      {
+         seed = details::mix64(seed + attempt);
+
+         std::vector<unsigned long long int> hashes(keys.size());
+
+         hash_keys(keys,hashes,seed,thread_count);
+
+         std::sort(hashes.begin(),hashes.end());
+         hashes.erase(std::unique(hashes.begin(),hashes.end()),hashes.end());
+
+         if (construct(hashes,seed))
+            return true;
+      }
+
+      return false;
+   }
+
+   template<typename T>
+   inline bool contains(const T& t) const
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return contains(key.data,key.length);
+   }
+
+   inline bool contains(const char* data, const std::size_t& length) const
+   {
+      if (fingerprints_.empty())
+         return false;
+
+      const unsigned long long int hash = details::hash64(reinterpret_cast<const unsigned char*>(data),length,seed_);
+
+      return fingerprint(hash) == static_cast<fingerprint_type>(fingerprints_[index(hash,0)] ^
+                                                                fingerprints_[index(hash,1)] ^
+                                                                fingerprints_[index(hash,2)]);
+   }
+
+   inline bool contains(const std::string& key) const
+   {
+      return contains(key.data(),key.size());
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_all(const InputIterator begin, const InputIterator end) const
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         if (!contains(*itr))
+         {
+            return itr;
+         }
+         ++itr;
+      }
+      return end;
+   }
+
+   inline unsigned long long int size() const
+   {
+      // Table size in bits.
+      return static_cast<unsigned long long int>(fingerprints_.size()) * sizeof(fingerprint_type) * bits_per_char;
+   }
+
+   inline std::size_t element_count() const
+   {
+      return element_count_;
+   }
+
+   inline double effective_fpp() const
+   {
+      return 1.0 / std::pow(2.0,static_cast<double>(sizeof(fingerprint_type) * bits_per_char));
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return 3;
+   }
+
+   inline const fingerprint_type* table() const
+   {
+      return fingerprints_.empty() ? 0 : &fingerprints_[0];
+   }
+
+private:
+
+   inline std::size_t index(const unsigned long long int hash, const unsigned int block) const
+   {
+      return index(hash,block,block_length_);
+   }
+
+   static inline std::size_t index(const unsigned long long int hash, const unsigned int block, const std::size_t block_length)
+   {
+      const unsigned long long int r = (hash << (21 * block)) | (hash >> ((64 - (21 * block)) & 63));
+      return static_cast<std::size_t>(((r & 0xFFFFFFFFULL) * block_length) >> 32) + (block * block_length);
+   }
+
+   static inline fingerprint_type fingerprint(const unsigned long long int hash)
+   {
+      return static_cast<fingerprint_type>(hash ^ (hash >> 32));
+   }
+
+   struct hash_task
+   {
+      const std::vector<bloom_key_view>*  keys;
+      std::vector<unsigned long long int>* hashes;
+      unsigned long long int              seed;
+      std::size_t                         begin;
+      std::size_t                         end;
+
+      static void* run(void* arg)
+      {
+         hash_task& t = *static_cast<hash_task*>(arg);
+
+         for (std::size_t i = t.begin; i < t.end; ++i)
+         {
+            const bloom_key_view& key = (*t.keys)[i];
+            (*t.hashes)[i] = details::hash64(reinterpret_cast<const unsigned char*>(key.data),key.length,t.seed);
+         }
+
+         return 0;
+      }
+   };
+
+   static inline void hash_keys(const std::vector<bloom_key_view>& keys,
+                                std::vector<unsigned long long int>& hashes,
+                                const unsigned long long int seed,
+                                unsigned int thread_count)
+   {
+      #if defined(BLOOM_FILTER_THREADS)
+      if (0 == thread_count)
+      {
+         const long online = ::sysconf(_SC_NPROCESSORS_ONLN);
+         thread_count = (online > 0) ? static_cast<unsigned int>(online) : 1;
+      }
+      #else
+      thread_count = 1;
+      #endif
+
+      std::vector<hash_task> tasks(std::max(1U,thread_count));
+
+      for (std::size_t i = 0; i < tasks.size(); ++i)
+      {
+         tasks[i].keys   = &keys;
+         tasks[i].hashes = &hashes;
+         tasks[i].seed   = seed;
+         tasks[i].begin  = (keys.size() * i) / tasks.size();
+         tasks[i].end    = (keys.size() * (i + 1)) / tasks.size();
+      }
+
+      #if defined(BLOOM_FILTER_THREADS)
+      std::vector<pthread_t> threads(tasks.size());
+      std::vector<char>      started(tasks.size(),0);
+
+      for (std::size_t i = 1; i < tasks.size(); ++i)
+      {
+         started[i] = (0 == pthread_create(&threads[i],0,&hash_task::run,&tasks[i]));
+
+         // A task whose thread could not be started runs here instead.
+         if (!started[i])
+            hash_task::run(&tasks[i]);
+      }
+
+      hash_task::run(&tasks[0]);
+
+      for (std::size_t i = 1; i < tasks.size(); ++i)
+      {
+         if (started[i])
+            pthread_join(threads[i],0);
+      }
+      #else
+      hash_task::run(&tasks[0]);
+      #endif
+   }
+
+   inline bool construct(const std::vector<unsigned long long int>& hashes, const unsigned long long int seed)
+   {
+      // Built into locals and only committed on success, so a failed
+      // rebuild leaves the previously built filter intact.
+      const std::size_t capacity     = 32 + static_cast<std::size_t>(std::ceil(1.23 * hashes.size()));
+      const std::size_t block_length = capacity / 3;
+      const std::size_t table_length = 3 * block_length;
+
+      std::vector<unsigned long long int> xor_mask(table_length,0);
+      std::vector<unsigned int>           count   (table_length,0);
+
+      for (std::size_t i = 0; i < hashes.size(); ++i)
+      {
+         for (unsigned int b = 0; b < 3; ++b)
+         {
+            const std::size_t slot = index(hashes[i],b,block_length);
+            xor_mask[slot] ^= hashes[i];
+            ++count[slot];
+         }
+      }
+
+      std::vector<std::size_t> queue;
+
+      for (std::size_t i = 0; i < table_length; ++i)
+      {
+         if (1 == count[i])
+            queue.push_back(i);
+      }
+
+      // Peel singleton slots, recording the order for assignment.
+      std::vector<std::pair<unsigned long long int,std::size_t> > stack;
+      stack.reserve(hashes.size());
+
+      while (!queue.empty())
+      {
+         const std::size_t slot = queue.back();
+         queue.pop_back();
+
+         if (1 != count[slot])
+            continue;
+
+         const unsigned long long int hash = xor_mask[slot];
+         stack.push_back(std::make_pair(hash,slot));
+
+         for (unsigned int b = 0; b < 3; ++b)
+         {
+            const std::size_t other = index(hash,b,block_length);
+            xor_mask[other] ^= hash;
+
+            if (1 == --count[other])
+               queue.push_back(other);
+         }
+      }
+
+      if (stack.size() != hashes.size())
+         return false;
+
+      std::vector<fingerprint_type> fingerprints(table_length,0);
+
+      for (std::size_t i = stack.size(); i-- > 0; )
+      {
+         const unsigned long long int hash = stack[i].first;
+         const std::size_t slot = stack[i].second;
+
+         fingerprints[slot] = static_cast<fingerprint_type>(fingerprint(hash)                         ^
+                                                            fingerprints[index(hash,0,block_length)] ^
+                                                            fingerprints[index(hash,1,block_length)] ^
+                                                            fingerprints[index(hash,2,block_length)]);
+      }
+
+      fingerprints_.swap(fingerprints);
+      block_length_  = block_length;
+      seed_          = seed;
+      element_count_ = hashes.size();
+
+      return true;
+   }
+
+   std::vector<fingerprint_type> fingerprints_;
+   unsigned long long int        seed_;
+   std::size_t                   block_length_;
+   std::size_t                   element_count_;
+};
+
+typedef xor_filter<unsigned char>  xor8_filter;
+typedef xor_filter<unsigned short> xor16_filter;
+
+class quotient_filter
+{
+   /*
+     Note:
+     Quotient filter (Bender et al.). A key's 64-bit hash is truncated
+     to a (q + r) bit fingerprint, whose top q bits select a home slot
+     and whose low r bits are stored, together with three metadata
+     bits, in a table of 2^q packed slots. Fingerprints sharing a home
+     slot form a sorted run and runs are kept in home slot order, so a
+     lookup scans a short contiguous cluster, normally within one or
+     two cache lines.
+
+     The fingerprints can be enumerated in sorted order, so the table
+     can be doubled (one remainder bit moves into the quotient, at the
+     cost of doubling the false positive probability) and two filters
+     can be merged in linear time, both without access to the original
+     keys.
+
+     Every insertion stores a fingerprint, including one already in
+     the table, and erase removes exactly one copy. Keys sharing a
+     fingerprint therefore survive the erasure of each other, provided
+     only keys known to have been inserted are erased.
+   */
+
+public:
+
+   quotient_filter()
+   : qbits_(0),
+     rbits_(0),
+     elem_bits_(0),
+     index_mask_(0),
+     rmask_(0),
+     elem_mask_(0),
+     element_count_(0),
+     seed_(0)
+   {}
+
+   quotient_filter(const bloom_parameters& p)
+   : qbits_(0),
+     rbits_(0),
+     elem_bits_(0),
+     index_mask_(0),
+     rmask_(0),
+     elem_mask_(0),
+     element_count_(0),
+     seed_(details::mix64(p.random_seed))
+   {
+      /*
+        Note:
+        With a load factor a the false positive probability is about
+        a * 2^-r, so r is taken from the desired probability and q is
+        chosen such that projected_element_count stays below the
+        maximum load factor.
+      */
+      const double slots = std::max(2.0,p.projected_element_count / max_load_factor());
+
+      unsigned int q = 1;
+      while ((q < 48) && (std::pow(2.0,1.0 * q) < slots)) ++q;
+
+      unsigned int r = static_cast<unsigned int>(std::ceil(-std::log(std::max(p.false_positive_probability,1.0e-18)) / std::log(2.0)));
+      r = std::max(2U,std::min(r,64U - q));
+      r = std::min(r,61U);
+
+      initialise(q,r);
+   }
+
+   inline bool operator!() const
+   {
+      return (0 == qbits_);
+   }
+
+   inline void clear()
+   {
+      std::fill(table_.begin(),table_.end(),0ULL);
+      element_count_ = 0;
+   }
+
+   inline bool insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      /*
+        Note:
+        Returns false when the table is full; call double_size first.
+      */
+      return insert_fingerprint(fingerprint(key_begin,length));
+   }
+
+   template<typename T>
+   inline bool insert(const T& t)
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline bool insert(const char* data, const std::size_t& length)
+   {
+      return insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   template<typename InputIterator>
+   inline bool insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         if (!insert(*(itr++)))
+            return false;
+      }
+      return true;
+   }
+
+   inline bool contains(const unsigned char* key_begin, const std::size_t length) const
+   {
+      return contains_fingerprint(fingerprint(key_begin,length));
+   }
+
+   template<typename T>
+   inline bool contains(const T& t) const
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return contains(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline bool contains(const char* data, const std::size_t& length) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_all(const InputIterator begin, const InputIterator end) const
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         if (!contains(*itr))
+         {
+            return itr;
+         }
+         ++itr;
+      }
+      return end;
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_none(const InputIterator begin, const InputIterator end) const
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         if (contains(*itr))
+         {
+            return itr;
+         }
+         ++itr;
+      }
+      return end;
+   }
+
+   inline bool erase(const unsigned char* key_begin, const std::size_t length)
+   {
+      return erase_fingerprint(fingerprint(key_begin,length));
+   }
+
+   template<typename T>
+   inline bool erase(const T& t)
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return erase(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline bool erase(const char* data, const std::size_t& length)
+   {
+      return erase(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline bool double_size()
+   {
+      /*
+        Note:
+        Doubles the number of slots by moving the top remainder bit of
+        every fingerprint into its quotient. Fails once the remainder
+        would drop below one bit.
+      */
+      if ((rbits_ <= 1) || !(*this))
+         return false;
+
+      std::vector<unsigned long long int> fingerprints;
+      enumerate(fingerprints);
+
+      return rebuild(fingerprints,qbits_ + 1);
+   }
+
+   inline bool merge(const quotient_filter& f)
+   {
+      /*
+        Note:
+        Merges the fingerprints of f into this filter in time linear in
+        the size of both tables, doubling the table as required to stay
+        under the maximum load factor. Both filters must have been
+        built with the same seed and fingerprint width. Returns false,
+        leaving this filter unchanged, if the union does not fit even
+        at the smallest remainder width.
+      */
+      if ((seed_ != f.seed_) || ((qbits_ + rbits_) != (f.qbits_ + f.rbits_)) || !(*this))
+         return false;
+
+      std::vector<unsigned long long int> a;
+      std::vector<unsigned long long int> b;
+      enumerate(a);
+      f.enumerate(b);
+
+      std::vector<unsigned long long int> merged;
+      merged.reserve(a.size() + b.size());
+      std::merge(a.begin(),a.end(),b.begin(),b.end(),std::back_inserter(merged));
+
+      unsigned int q = std::max(qbits_,f.qbits_);
+      while ((merged.size() > max_load_factor() * std::pow(2.0,1.0 * q)) && ((qbits_ + rbits_ - q) > 1)) ++q;
+
+      return rebuild(merged,q);
+   }
+
+   inline unsigned long long int size() const
+   {
+      // Table size in bits.
+      return static_cast<unsigned long long int>(table_.size()) * 64;
+   }
+
+   inline unsigned long long int capacity() const
+   {
+      return slot_count();
+   }
+
+   inline std::size_t element_count() const
+   {
+      return element_count_;
+   }
+
+   inline double load_factor() const
+   {
+      return slot_count() ? (1.0 * element_count_) / slot_count() : 0.0;
+   }
+
+   inline double effective_fpp() const
+   {
+      return 1.0 - std::exp(-load_factor() / std::pow(2.0,1.0 * rbits_));
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return 1;
+   }
+
+   inline unsigned int quotient_bits() const
+   {
+      return qbits_;
+   }
+
+   inline unsigned int remainder_bits() const
+   {
+      return rbits_;
+   }
+
+   static inline double max_load_factor()
+   {
+      return 0.75;
+   }
+
+private:
+
+   inline void initialise(const unsigned int q, const unsigned int r)
+   {
+      qbits_     = q;
+      rbits_     = r;
+      elem_bits_ = r + 3;
+      index_mask_ = (1ULL << q) - 1;
+      rmask_      = (r < 64) ? ((1ULL << r) - 1) : ~0ULL;
+      elem_mask_  = (elem_bits_ < 64) ? ((1ULL << elem_bits_) - 1) : ~0ULL;
+      element_count_ = 0;
+      table_.assign(static_cast<std::size_t>(((slot_count() * elem_bits_) + 63) / 64),0ULL);
+   }
+
+   inline unsigned long long int slot_count() const
+   {
+      return qbits_ ? (index_mask_ + 1) : 0;
+   }
+
+   inline unsigned long long int fingerprint(const unsigned char* key_begin, const std::size_t length) const
+   {
+      const unsigned long long int hash = details::hash64(key_begin,length,seed_);
+      return ((qbits_ + rbits_) < 64) ? (hash & ((1ULL << (qbits_ + rbits_)) - 1)) : hash;
+   }
+
+   // Slot layout: bit 0 occupied, bit 1 continuation, bit 2 shifted,
+   // remaining bits hold the remainder.
+   static inline bool is_occupied    (const unsigned long long int e) { return (e & 1) != 0; }
+   static inline bool is_continuation(const unsigned long long int e) { return (e & 2) != 0; }
+   static inline bool is_shifted     (const unsigned long long int e) { return (e & 4) != 0; }
+   static inline bool is_empty       (const unsigned long long int e) { return (e & 7) == 0; }
+
+   static inline bool is_cluster_start(const unsigned long long int e)
+   {
+      return is_occupied(e) && !is_continuation(e) && !is_shifted(e);
+   }
+
+   static inline bool is_run_start(const unsigned long long int e)
+   {
+      return !is_continuation(e) && (is_occupied(e) || is_shifted(e));
+   }
+
+   static inline unsigned long long int remainder(const unsigned long long int e)
+   {
+      return e >> 3;
+   }
+
+   inline unsigned long long int incr(const unsigned long long int i) const
+   {
+      return (i + 1) & index_mask_;
+   }
+
+   inline unsigned long long int decr(const unsigned long long int i) const
+   {
+      return (i - 1) & index_mask_;
+   }
+
+   inline unsigned long long int get(const unsigned long long int index) const
+   {
+      const unsigned long long int bit_position = index * elem_bits_;
+      std::size_t  word   = static_cast<std::size_t>(bit_position / 64);
+      const unsigned int offset = static_cast<unsigned int>(bit_position % 64);
+      const int    spill  = static_cast<int>(offset + elem_bits_) - 64;
+
+      unsigned long long int e = (table_[word] >> offset) & elem_mask_;
+
+      if (spill > 0)
+      {
+         ++word;
+         const unsigned long long int x = table_[word] & (~0ULL >> (64 - spill));
+         e |= x << (elem_bits_ - spill);
+      }
+
+      return e;
+   }
+
+   inline void set(const unsigned long long int index, unsigned long long int e)
+   {
+      const unsigned long long int bit_position = index * elem_bits_;
+      std::size_t  word   = static_cast<std::size_t>(bit_position / 64);
+      const unsigned int offset = static_cast<unsigned int>(bit_position % 64);
+      const int    spill  = static_cast<int>(offset + elem_bits_) - 64;
+
+      e &= elem_mask_;
+      table_[word] &= ~(elem_mask_ << offset);
+      table_[word] |= e << offset;
+
+      if (spill > 0)
+      {
+         ++word;
+         table_[word] &= ~(~0ULL >> (64 - spill));
+         table_[word] |= e >> (elem_bits_ - spill);
+      }
+   }
+
+   inline unsigned long long int find_run_index(const unsigned long long int fq) const
+   {
+      // Walk back to the start of the cluster, then forward run by run.
+      unsigned long long int b = fq;
+
+      while (is_shifted(get(b)))
+         b = decr(b);
+
+      unsigned long long int s = b;
+
+      while (b != fq)
+      {
+         do { s = incr(s); } while (is_continuation(get(s)));
+         do { b = incr(b); } while (!is_occupied(get(b)));
+      }
+
+      return s;
+   }
+
+   inline void insert_into(unsigned long long int s, unsigned long long int e)
+   {
+      // Shift the remainder of the cluster right by one slot.
+      unsigned long long int previous = 0;
+      bool empty = false;
+
+      do
+      {
+         previous = get(s);
+         empty = is_empty(previous);
+
+         if (!empty)
+         {
+            previous |= 4;
+
+            if (is_occupied(previous))
+            {
+               e |= 1;
+               previous &= ~1ULL;
+            }
+         }
+
+         set(s,e);
+         e = previous;
+         s = incr(s);
+      }
+      while (!empty);
+   }
+
+   inline bool insert_fingerprint(const unsigned long long int hash)
+   {
+      // One slot is always left empty so that shifting terminates.
+      if ((element_count_ + 1) >= slot_count())
+         return false;
+
+      const unsigned long long int fq = (hash >> rbits_) & index_mask_;
+      const unsigned long long int fr = hash & rmask_;
+      const unsigned long long int t_fq = get(fq);
+
+      unsigned long long int entry = fr << 3;
+
+      if (is_empty(t_fq))
+      {
+         set(fq,entry | 1);
+         ++element_count_;
+         return true;
+      }
+
+      if (!is_occupied(t_fq))
+         set(fq,t_fq | 1);
+
+      const unsigned long long int start = find_run_index(fq);
+      unsigned long long int s = start;
+
+      if (is_occupied(t_fq))
+      {
+         // Duplicates are stored too, after the equal remainders.
+         do
+         {
+            if (remainder(get(s)) > fr)
+               break;
+
+            s = incr(s);
+         }
+         while (is_continuation(get(s)));
+
+         if (s == start)
+            set(start,get(start) | 2);
+         else
+            entry |= 2;
+      }
+
+      if (s != fq)
+         entry |= 4;
+
+      insert_into(s,entry);
+      ++element_count_;
+
+      return true;
+   }
+
+   inline bool contains_fingerprint(const unsigned long long int hash) const
+   {
+      if (!(*this))
+         return false;
+
+      const unsigned long long int fq = (hash >> rbits_) & index_mask_;
+      const unsigned long long int fr = hash & rmask_;
+
+      if (!is_occupied(get(fq)))
+         return false;
+
+      unsigned long long int s = find_run_index(fq);
+
+      do
+      {
+         const unsigned long long int rem = remainder(get(s));
+
+         if (rem == fr)
+            return true;
+         else if (rem > fr)
+            return false;
+
+         s = incr(s);
+      }
+      while (is_continuation(get(s)));
+
+      return false;
+   }
+
+   inline void delete_entry(unsigned long long int s, unsigned long long int quot)
+   {
+      // Shift the remainder of the cluster left by one slot.
+      unsigned long long int current = get(s);
+      unsigned long long int sp = incr(s);
+      const unsigned long long int original = s;
+
+      for ( ; ; )
+      {
+         const unsigned long long int next = get(sp);
+         const bool current_occupied = is_occupied(current);
+
+         if (is_empty(next) || is_cluster_start(next) || (sp == original))
+         {
+            set(s,0);
+            return;
+         }
+
+         unsigned long long int updated_next = next;
+
+         if (is_run_start(next))
+         {
+            do { quot = incr(quot); } while (!is_occupied(get(quot)));
+
+            if (current_occupied && (quot == s))
+               updated_next &= ~4ULL;
+         }
+
+         set(s,current_occupied ? (updated_next | 1) : (updated_next & ~1ULL));
+
+         s = sp;
+         sp = incr(sp);
+         current = next;
+      }
+   }
+
+   inline bool erase_fingerprint(const unsigned long long int hash)
+   {
+      if (!(*this))
+         return false;
+
+      const unsigned long long int fq = (hash >> rbits_) & index_mask_;
+      const unsigned long long int fr = hash & rmask_;
+      unsigned long long int t_fq = get(fq);
+
+      if (!is_occupied(t_fq) || (0 == element_count_))
+         return false;
+
+      unsigned long long int s = find_run_index(fq);
+      unsigned long long int rem = 0;
+
+      do
+      {
+         rem = remainder(get(s));
+
+         if (rem >= fr)
+            break;
+
+         s = incr(s);
+      }
+      while (is_continuation(get(s)));
+
+      if (rem != fr)
+         return false;
+
+      const unsigned long long int kill = (s == fq) ? t_fq : get(s);
+      const bool replace_run_start = is_run_start(kill);
+
+      // Deleting the last entry of a run clears its occupied bit.
+      if (replace_run_start)
+      {
+         if (!is_continuation(get(incr(s))))
+         {
+            t_fq &= ~1ULL;
+            set(fq,t_fq);
+         }
+      }
+
+      delete_entry(s,fq);
+
+      if (replace_run_start)
+      {
+         const unsigned long long int next = get(s);
+         unsigned long long int updated_next = next;
+
+         if (is_continuation(next))
+            updated_next &= ~2ULL;
+
+         if ((s == fq) && is_run_start(updated_next))
+            updated_next &= ~4ULL;
+
+         if (updated_next != next)
+            set(s,updated_next);
+      }
+
+      --element_count_;
+
+      return true;
+   }
+
+   inline void enumerate(std::vector<unsigned long long int>& fingerprints) const
+   {
+      /*
+        Note:
+        Appends every stored fingerprint in ascending order. Iteration
+        starts at the first cluster start and walks the table once, so
+        runs whose quotients wrapped around the end of the table come
+        out last; rotating them to the front restores the order.
+      */
+      fingerprints.reserve(fingerprints.size() + element_count_);
+
+      if (0 == element_count_)
+         return;
+
+      const std::size_t first = fingerprints.size();
+
+      unsigned long long int index = 0;
+
+      while (!is_cluster_start(get(index)))
+         ++index;
+
+      unsigned long long int quotient = index;
+      std::size_t visited = 0;
+
+      while (visited < element_count_)
+      {
+         const unsigned long long int e = get(index);
+
+         if (is_cluster_start(e))
+            quotient = index;
+         else if (is_run_start(e))
+         {
+            do { quotient = incr(quotient); } while (!is_occupied(get(quotient)));
+         }
+
+         index = incr(index);
+
+         if (!is_empty(e))
+         {
+            fingerprints.push_back((quotient << rbits_) | remainder(e));
+            ++visited;
+         }
+      }
+
+      for (std::size_t i = first + 1; i < fingerprints.size(); ++i)
+      {
+         if (fingerprints[i] < fingerprints[i - 1])
+         {
+            std::rotate(fingerprints.begin() + first,fingerprints.begin() + i,fingerprints.end());
+            break;
+         }
+      }
+   }
+
+   inline bool rebuild(const std::vector<unsigned long long int>& fingerprints, const unsigned int q)
+   {
+      // Fingerprints are in ascending order, so each insert appends to
+      // the end of its cluster. An insert can only fail on a full
+      // table, which is ruled out before anything is changed.
+      if ((q >= 64) || ((fingerprints.size() + 1) >= (1ULL << q)))
+         return false;
+
+      const unsigned int fingerprint_bits = qbits_ + rbits_;
+
+      initialise(q,fingerprint_bits - q);
+
+      for (std::size_t i = 0; i < fingerprints.size(); ++i)
+      {
+         if (!insert_fingerprint(fingerprints[i]))
+            return false;
+      }
+
+      return true;
+   }
+
+   unsigned int                        qbits_;
+   unsigned int                        rbits_;
+   unsigned int                        elem_bits_;
+   unsigned long long int              index_mask_;
+   unsigned long long int              rmask_;
+   unsigned long long int              elem_mask_;
+   std::size_t                         element_count_;
+   unsigned long long int              seed_;
+   std::vector<unsigned long long int> table_;
+};
+
+class multiset_bloom_filter
+{
+   /*
+     Note:
+     Bit-sliced Bloom filter over a number of sets. Row i of the table
+     holds bit i of every set's filter, one bit per set, so a query
+     hashes the key once, derives the k row indices by double hashing
+     and ANDs k rows together. The resulting bitmap has bit s set when
+     the key is possibly a member of set s. Against one bloom_filter
+     per set this replaces sets * k probes and hashes by k probes (each
+     a contiguous row) and a single hash.
+
+     Each set is sized by the bloom_parameters given at construction,
+     i.e. projected_element_count and false_positive_probability apply
+     per set.
+   */
+
+public:
+
+   typedef unsigned long long int word_type;
+
+   static const std::size_t bits_per_word = sizeof(word_type) * bits_per_char;
+
+   multiset_bloom_filter()
+   : set_count_(0),
+     words_per_row_(0),
+     row_count_(0),
+     hash_count_(0),
+     seed_(0)
+   {}
+
+   multiset_bloom_filter(const bloom_parameters& p, const std::size_t set_count)
+   : set_count_(set_count),
+     words_per_row_((set_count + bits_per_word - 1) / bits_per_word),
+     row_count_(p.optimal_parameters.table_size),
+     hash_count_(p.optimal_parameters.number_of_hashes),
+     seed_(details::mix64(p.random_seed)),
+     element_count_(set_count,0)
+   {
+      table_.assign(static_cast<std::size_t>(row_count_ * words_per_row_),0ULL);
+   }
+
+   inline bool operator!() const
+   {
+      return (0 == set_count_) || (0 == row_count_) || (0 == hash_count_);
+   }
+
+   inline void clear()
+   {
+      std::fill(table_.begin(),table_.end(),0ULL);
+      std::fill(element_count_.begin(),element_count_.end(),0);
+   }
+
+   inline void insert(const std::size_t set, const unsigned char* key_begin, const std::size_t& length)
+   {
+      probe_sequence probe(*this,key_begin,length);
+
+      const std::size_t word = set / bits_per_word;
+      const word_type   mask = 1ULL << (set % bits_per_word);
+
+      for (std::size_t i = 0; i < hash_count_; ++i, probe.next())
+      {
+         table_[static_cast<std::size_t>(probe.row * words_per_row_) + word] |= mask;
+      }
+
+      ++element_count_[set];
+   }
+
+   template<typename T>
+   inline void insert(const std::size_t set, const T& t)
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      insert(set,reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const std::size_t set, const char* data, const std::size_t& length)
+   {
+      insert(set,reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   template<typename InputIterator>
+   inline void insert(const std::size_t set, const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(set,*(itr++));
+      }
+   }
+
+   inline bool contains(const std::size_t set, const unsigned char* key_begin, const std::size_t length) const
+   {
+      probe_sequence probe(*this,key_begin,length);
+
+      const std::size_t word = set / bits_per_word;
+      const word_type   mask = 1ULL << (set % bits_per_word);
+
+      for (std::size_t i = 0; i < hash_count_; ++i, probe.next())
+      {
+         if (0 == (table_[static_cast<std::size_t>(probe.row * words_per_row_) + word] & mask))
+         {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
+   template<typename T>
+   inline bool contains(const std::size_t set, const T& t) const
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return contains(set,reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline bool contains(const std::size_t set, const char* data, const std::size_t& length) const
+   {
+      return contains(set,reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline bool membership(const unsigned char* key_begin, const std::size_t length, word_type* bitmap) const
+   {
+      /*
+        Note:
+        Writes words_per_row() words to bitmap, bit s of the bitmap
+        being set when the key is possibly in set s. Returns true if
+        any bit is set. Stops early once the bitmap becomes empty.
+      */
+      initialise_bitmap(bitmap);
+
+      probe_sequence probe(*this,key_begin,length);
+
+      for (std::size_t i = 0; i < hash_count_; ++i, probe.next())
+      {
+         if (!and_row(bitmap,row(probe.row)))
+            return false;
+      }
+
+      return (0 != hash_count_);
+   }
+
+   template<typename T>
+   inline bool membership(const T& t, word_type* bitmap) const
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return membership(reinterpret_cast<const unsigned char*>(key.data),key.length,bitmap);
+   }
+
+   inline bool membership(const char* data, const std::size_t& length, word_type* bitmap) const
+   {
+      return membership(reinterpret_cast<const unsigned char*>(data),length,bitmap);
+   }
+
+   template<typename T>
+   inline word_type membership(const T& t) const
+   {
+      // Note: Bitmap of the first 64 sets, for filters of up to 64 sets.
+      std::vector<word_type> bitmap(std::max<std::size_t>(1,words_per_row_));
+      membership(t,&bitmap[0]);
+      return bitmap[0];
+   }
+
+   template<typename InputIterator>
+   inline void membership(const InputIterator begin, const InputIterator end, word_type* bitmaps, const std::size_t group_size = 16) const
+   {
+      /*
+        Note:
+        Batched membership: the bitmap of the i-th key is written to
+        bitmaps[i * words_per_row()]. The rows of up to group_size keys
+        are located and prefetched before any of them is read, so the
+        cache misses of the group overlap. The row AND is branch free
+        over the batch.
+      */
+      const std::size_t group = std::max<std::size_t>(1,std::min<std::size_t>(group_size,64));
+
+      std::vector<unsigned long long int> rows(group * hash_count_);
+
+      InputIterator itr = begin;
+      std::size_t key_index = 0;
+
+      while (end != itr)
+      {
+         std::size_t n = 0;
+
+         for (; (n < group) && (end != itr); ++n, ++itr)
+         {
+            const bloom_key_view key = details::make_key_view(*itr);
+
+            probe_sequence probe(*this,reinterpret_cast<const unsigned char*>(key.data),key.length);
+
+            for (std::size_t i = 0; i < hash_count_; ++i, probe.next())
+            {
+               rows[(n * hash_count_) + i] = probe.row;
+               details::prefetch(row(probe.row));
+            }
+         }
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            word_type* bitmap = bitmaps + ((key_index + j) * words_per_row_);
+
+            initialise_bitmap(bitmap);
+
+            for (std::size_t i = 0; i < hash_count_; ++i)
+            {
+               and_row(bitmap,row(rows[(j * hash_count_) + i]));
+            }
+         }
+
+         key_index += n;
+      }
+   }
+
+   inline unsigned long long int size() const
+   {
+      // Table size in bits, over all sets.
+      return static_cast<unsigned long long int>(table_.size()) * bits_per_word;
+   }
+
+   inline std::size_t set_count() const
+   {
+      return set_count_;
+   }
+
+   inline std::size_t words_per_row() const
+   {
+      return words_per_row_;
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return hash_count_;
+   }
+
+   inline std::size_t element_count(const std::size_t set) const
+   {
+      return element_count_[set];
+   }
+
+   inline double effective_fpp(const std::size_t set) const
+   {
+      if (0 == row_count_)
+         return 1.0;
+
+      return std::pow(1.0 - std::exp(-1.0 * hash_count_ * element_count_[set] / row_count_),1.0 * hash_count_);
+   }
+
+   inline const word_type* table() const
+   {
+      return table_.empty() ? 0 : &table_[0];
+   }
+
+private:
+
+   struct probe_sequence
+   {
+      /*
+        Note:
+        Row indices h1 + i * h2 (mod rows) derived from one 64-bit
+        hash (Kirsch and Mitzenmacher). The step is never zero, so
+        consecutive probes never land on the same row.
+      */
+      probe_sequence(const multiset_bloom_filter& f, const unsigned char* key_begin, const std::size_t length)
+      : row_count(f.row_count_)
+      {
+         const unsigned long long int hash = details::hash64(key_begin,length,f.seed_);
+         row  = hash % row_count;
+         step = (row_count > 1) ? (1 + (details::mix64(hash) % (row_count - 1))) : 0;
+      }
+
+      inline void next()
+      {
+         row += step;
+         if (row >= row_count)
+            row -= row_count;
+      }
+
+      unsigned long long int row_count;
+      unsigned long long int row;
+      unsigned long long int step;
+   };
+
+   inline const word_type* row(const unsigned long long int index) const
+   {
+      return &table_[static_cast<std::size_t>(index * words_per_row_)];
+   }
+
+   inline void initialise_bitmap(word_type* bitmap) const
+   {
+      std::fill_n(bitmap,words_per_row_,~0ULL);
+
+      if (set_count_ % bits_per_word)
+      {
+         bitmap[words_per_row_ - 1] = (1ULL << (set_count_ % bits_per_word)) - 1;
+      }
+   }
+
+   inline bool and_row(word_type* bitmap, const word_type* row) const
+   {
+      /*
+        Note:
+        Written as a plain word loop with an OR reduction so that the
+        compiler vectorises it (SSE2/AVX2/AVX-512 depending on -march)
+        when rows span several words.
+      */
+      word_type any = 0;
+      for (std::size_t i = 0; i < words_per_row_; ++i)
+      {
+         bitmap[i] &= row[i];
+         any |= bitmap[i];
+      }
+      return (0 != any);
+   }
+
+   std::size_t              set_count_;
+   std::size_t              words_per_row_;
+   unsigned long long int   row_count_;
+   std::size_t              hash_count_;
+   unsigned long long int   seed_;
+   std::vector<std::size_t> element_count_;
+   std::vector<word_type>   table_;
+};
+
+class filter_collection
+{
+   /*
+     Note:
+     Bit-sliced (transposed) view of a sequence of bloom_filters that
+     share salts and table size, e.g. one filter per time partition.
+     Row i holds bit i of every filter, so the k probes of a key are k
+     row ANDs and yield the set of filters that may contain the key,
+     instead of k probes into each filter.
+
+     Filters are kept in a ring of columns: append() transposes a new
+     filter into the next free column (growing the ring when full) and
+     drop_oldest() releases the oldest column in constant time. Filters
+     are identified by their position, 0 being the oldest.
+   */
+
+public:
+
+   typedef unsigned long long int word_type;
+
+   static const std::size_t bits_per_word = sizeof(word_type) * bits_per_char;
+
+   filter_collection()
+   : table_size_(0),
+     random_seed_(0),
+     words_per_row_(0),
+     head_(0),
+     count_(0)
+   {}
+
+   inline bool operator!() const
+   {
+      return (0 == table_size_);
+   }
+
+   inline void clear()
+   {
+      table_.clear();
+      active_.clear();
+      salt_.clear();
+      table_size_    = 0;
+      random_seed_   = 0;
+      words_per_row_ = 0;
+      head_          = 0;
+      count_         = 0;
+   }
+
+   inline bool append(const bloom_filter& filter)
+   {
+      /*
+        Note:
+        Returns false if the filter's salts or table size differ from
+        those of the filters already in the collection, or if it is a
+        compressed filter.
+      */
+      if ((filter.size() != filter.schema_->table_size) || (0 == filter.schema_->table_size))
+         return false;
+
+      if (0 == count_)
+      {
+         salt_        = filter.schema_->salt;
+         table_size_  = filter.schema_->table_size;
+         random_seed_ = filter.schema_->random_seed;
+
+         reallocate(std::max<std::size_t>(1,words_per_row_));
+      }
+      else if ((salt_ != filter.schema_->salt) || (table_size_ != filter.schema_->table_size) || (random_seed_ != filter.schema_->random_seed))
+         return false;
+
+      if (count_ == capacity())
+         reallocate(2 * words_per_row_);
+
+      const std::size_t column = (head_ + count_) % capacity();
+      const std::size_t word   = column / bits_per_word;
+      const word_type   mask   = 1ULL << (column % bits_per_word);
+
+      for (unsigned long long int r = 0; r < table_size_; ++r)
+      {
+         word_type& w = table_[static_cast<std::size_t>(r * words_per_row_) + word];
+
+         if (filter.test_bit(static_cast<std::size_t>(r)))
+            w |= mask;
+         else
+            w &= ~mask;
+      }
+
+      active_[word] |= mask;
+      ++count_;
+
+      return true;
+   }
+
+   inline bool drop_oldest()
+   {
+      if (0 == count_)
+         return false;
+
+      active_[head_ / bits_per_word] &= ~(1ULL << (head_ % bits_per_word));
+
+      head_ = (head_ + 1) % capacity();
+      --count_;
+
+      return true;
+   }
+
+   template<typename T>
+   inline bool contains(const T& t, std::vector<std::size_t>& filters) const
+   {
+      const bloom_key_view key = details::make_key_view(t);
+      return contains(reinterpret_cast<const unsigned char*>(key.data),key.length,filters);
+   }
+
+   inline bool contains(const char* data, const std::size_t& length, std::vector<std::size_t>& filters) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(data),length,filters);
+   }
+
+   inline bool contains(const bloom_uint64& key, std::vector<std::size_t>& filters) const
+   {
+      return contains_integer(key.value,0,filters);
+   }
+
+   inline bool contains(const bloom_uint128& key, std::vector<std::size_t>& filters) const
+   {
+      return contains_integer(key.low,key.high,filters);
+   }
+
+   inline bool contains(const unsigned char* key_begin, const std::size_t length, std::vector<std::size_t>& filters) const
+   {
+      /*
+        Note:
+        Replaces the contents of filters with the positions (oldest
+        first) of the filters that may contain the key. Returns false
+        if there are none.
+      */
+      filters.clear();
+
+      if (0 == count_)
+         return false;
+
+      std::vector<word_type> bitmap(active_);
+
+      for (std::size_t i = 0; i < salt_.size(); ++i)
+      {
+         if (!and_row(bitmap,details::hash_ap(key_begin,length,salt_[i]) % table_size_))
+            return false;
+      }
+
+      collect(bitmap,filters);
+
+      return true;
+   }
+
+   inline std::size_t filter_count() const
+   {
+      return count_;
+   }
+
+   inline std::size_t capacity() const
+   {
+      return words_per_row_ * bits_per_word;
+   }
+
+   inline unsigned long long int size() const
+   {
+      // Table size in bits of each filter in the collection.
+      return table_size_;
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return salt_.size();
+   }
+
+private:
+
+   inline bool contains_integer(const unsigned long long int low, const unsigned long long int high, std::vector<std::size_t>& filters) const
+   {
+      // Note: Mirrors the integer key path of bloom_filter.
+      filters.clear();
+
+      if (0 == count_)
+         return false;
+
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      details::integer_hash(low,high,random_seed_,h1,h2);
+
+      std::vector<word_type> bitmap(active_);
+
+      for (std::size_t i = 0; i < salt_.size(); ++i, h1 += h2)
+      {
+         if (!and_row(bitmap,h1 % table_size_))
+            return false;
+      }
+
+      collect(bitmap,filters);
+
+      return true;
+   }
+
+   inline bool and_row(std::vector<word_type>& bitmap, const unsigned long long int r) const
+   {
+      const word_type* row = &table_[static_cast<std::size_t>(r * words_per_row_)];
+
+      word_type any = 0;
+      for (std::size_t w = 0; w < words_per_row_; ++w)
+      {
+         bitmap[w] &= row[w];
+         any |= bitmap[w];
+      }
+
+      return (0 != any);
+   }
+
+   inline void collect(const std::vector<word_type>& bitmap, std::vector<std::size_t>& filters) const
+   {
+      for (std::size_t w = 0; w < words_per_row_; ++w)
+      {
+         for (word_type bits = bitmap[w]; bits; bits &= bits - 1)
+         {
+            const std::size_t column = (w * bits_per_word) + lowest_bit(bits);
+            filters.push_back((column + capacity() - head_) % capacity());
+         }
+      }
+
+      std::sort(filters.begin(),filters.end());
+   }
+
+   static inline std::size_t lowest_bit(const word_type bits)
+   {
+      #if defined(__GNUC__)
+      return static_cast<std::size_t>(__builtin_ctzll(bits));
+      #else
+      std::size_t i = 0;
+      while (0 == (bits & (1ULL << i))) ++i;
+      return i;
+      #endif
+   }
+
+   inline void reallocate(const std::size_t words_per_row)
+   {
+      /*
+        Note:
+        Resizes rows to words_per_row words, moving the live columns
+        to positions 0..count-1 so that the ring starts at column 0.
+      */
+      const std::size_t old_capacity = capacity();
+
+      std::vector<word_type> table(static_cast<std::size_t>(table_size_ * words_per_row),0ULL);
+
+      for (unsigned long long int r = 0; (r < table_size_) && count_; ++r)
+      {
+         const word_type* old_row = &table_[static_cast<std::size_t>(r * words_per_row_)];
+         word_type*       new_row = &table [static_cast<std::size_t>(r * words_per_row )];
+
+         for (std::size_t j = 0; j < count_; ++j)
+         {
+            const std::size_t column = (head_ + j) % old_capacity;
+
+            if (old_row[column / bits_per_word] & (1ULL << (column % bits_per_word)))
+               new_row[j / bits_per_word] |= 1ULL << (j % bits_per_word);
+         }
+      }
+
+      table_.swap(table);
+
+      active_.assign(words_per_row,0ULL);
+
+      for (std::size_t j = 0; j < count_; ++j)
+      {
+         active_[j / bits_per_word] |= 1ULL << (j % bits_per_word);
+      }
+
+      words_per_row_ = words_per_row;
+      head_          = 0;
+   }
+
+   std::vector<unsigned int> salt_;
+   unsigned long long int    table_size_;
+   unsigned long long int    random_seed_;
+   std::size_t               words_per_row_;
+   std::size_t               head_;
+   std::size_t               count_;
+   std::vector<word_type>    active_;
+   std::vector<word_type>    table_;
+};
+
+class range_bloom_filter
+{
+   /*
+     Note:
+     Prefix Bloom filter for 64-bit integer keys, answering "might any
+     key in [a,b] exist?". A key x is inserted as the dyadic prefixes
+     (l, x >> l) for every level l in [0,levels), all tagged with their
+     level and held in a single bloom_filter. A range query decomposes
+     [a,b] into maximal aligned dyadic intervals, each of which is one
+     prefix probe, so a range of width w costs at most about 2 log2(w)
+     probes while w < 2^levels.
+
+     FPP bound: an empty range is reported as non-empty only if one of
+     its P probes is a false positive, so the range false positive
+     probability is at most 1 - (1 - p)^P <= P * p, where p is the
+     point probability of the underlying filter and P <= 2 * levels
+     for ranges narrower than 2^levels. Wider ranges are covered by
+     several top level prefixes; when more than max_probes() probes
+     would be needed the range is conservatively reported as possibly
+     non-empty.
+   */
+
+public:
+
+   range_bloom_filter()
+   : levels_(0),
+     element_count_(0)
+   {}
+
+   range_bloom_filter(const bloom_parameters& p, const unsigned int levels = 20)
+   : levels_(std::max(1U,std::min(levels,64U))),
+     element_count_(0)
+   {
+      /*
+        Note:
+        p describes the keys. Every key inserts levels prefixes (fewer
+        distinct ones, as neighbouring keys share upper prefixes), so
+        the underlying filter is sized for levels times as many
+        elements at the same point false positive probability.
+      */
+      bloom_parameters parameters(p);
+      parameters.projected_element_count *= levels_;
+      parameters.compute_optimal_parameters();
+
+      filter_ = bloom_filter(parameters);
+   }
+
+   inline bool operator!() const
+   {
+      return (0 == levels_) || !filter_;
+   }
+
+   inline void clear()
+   {
+      filter_.clear();
+      element_count_ = 0;
+   }
+
+   inline void insert(const unsigned long long int key)
+   {
+      for (unsigned int level = 0; level < levels_; ++level)
+      {
+         insert_prefix(level,key >> level);
+      }
+
+      ++element_count_;
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(static_cast<unsigned long long int>(*(itr++)));
+      }
+   }
+
+   inline bool contains(const unsigned long long int key) const
+   {
+      return contains_prefix(0,key);
+   }
+
+   inline bool contains_range(const unsigned long long int lower, const unsigned long long int upper) const
+   {
+      // Note: Both bounds are inclusive.
+      if (lower > upper)
+         return false;
+
+      unsigned long long int begin = lower;
+      std::size_t probes = 0;
+
+      for ( ; ; )
+      {
+         const unsigned int level = dyadic_level(begin,upper);
+
+         if (++probes > max_probes())
+            return true;
+
+         if (contains_prefix(level,begin >> level))
+            return true;
+
+         const unsigned long long int next = begin + (1ULL << level);
+
+         if ((next - 1) >= upper)
+            return false;
+
+         begin = next;
+      }
+   }
+
+   inline double range_fpp(const unsigned long long int lower, const unsigned long long int upper) const
+   {
+      // Estimated false positive probability of an empty [lower,upper], from its probe count.
+      if (lower > upper)
+         return 0.0;
+
+      unsigned long long int begin = lower;
+      std::size_t probes = 0;
+
+      for ( ; ; )
+      {
+         const unsigned int level = dyadic_level(begin,upper);
+
+         if (++probes > max_probes())
+            return 1.0;
+
+         const unsigned long long int next = begin + (1ULL << level);
+
+         if ((next - 1) >= upper)
+            break;
+
+         begin = next;
+      }
+
+      return 1.0 - std::pow(1.0 - filter_.effective_fpp(),1.0 * probes);
+   }
+
+   inline unsigned int levels() const
+   {
+      return levels_;
+   }
+
+   inline std::size_t max_probes() const
+   {
+      return 4 * static_cast<std::size_t>(levels_);
+   }
+
+   inline unsigned long long int size() const
+   {
+      return filter_.size();
+   }
+
+   inline std::size_t element_count() const
+   {
+      return element_count_;
+   }
+
+   inline double effective_fpp() const
+   {
+      // Point query false positive probability.
+      return filter_.effective_fpp();
+   }
+
+   inline const bloom_filter& filter() const
+   {
+      return filter_;
+   }
+
+private:
+
+   inline unsigned int dyadic_level(const unsigned long long int begin, const unsigned long long int upper) const
+   {
+      // Largest level such that [begin,begin + 2^level) is aligned and within [begin,upper].
+      unsigned int level = 0;
+
+      while ((level + 1) < levels_)
+      {
+         const unsigned long long int width = 1ULL << (level + 1);
+
+         if ((begin & (width - 1)) || ((upper - begin) < (width - 1)))
+            break;
+
+         ++level;
+      }
+
+      return level;
+   }
+
+   static inline void encode(const unsigned int level, const unsigned long long int prefix, unsigned char* buffer)
+   {
+      for (std::size_t i = 0; i < sizeof(prefix); ++i)
+      {
+         buffer[i] = static_cast<unsigned char>(prefix >> (i * bits_per_char));
+      }
+
+      buffer[sizeof(prefix)] = static_cast<unsigned char>(level);
+   }
+
+   inline void insert_prefix(const unsigned int level, const unsigned long long int prefix)
+   {
+      unsigned char buffer[sizeof(unsigned long long int) + 1];
+      encode(level,prefix,buffer);
+      filter_.insert(buffer,sizeof(buffer));
+   }
+
+   inline bool contains_prefix(const unsigned int level, const unsigned long long int prefix) const
+   {
+      unsigned char buffer[sizeof(unsigned long long int) + 1];
+      encode(level,prefix,buffer);
+      return filter_.contains(buffer,sizeof(buffer));
+   }
+
+   unsigned int levels_;
+   std::size_t  element_count_;
+   bloom_filter filter_;
+};
+
+struct bloom_partition
+{
+   /*
+     Note:
+     One class of keys for a partitioned_bloom_filter. The inputs are
+     the number of keys in the class, the relative frequency with which
+     queries fall into the class and the cost of a false positive for
+     such a query. false_positive_probability and table_size are the
+     outputs of optimise_partitions.
+   */
+   bloom_partition()
+   : projected_element_count(0),
+     query_frequency(1.0),
+     cost_weight(1.0),
+     false_positive_probability(1.0),
+     table_size(0)
+   {}
+
+   bloom_partition(const unsigned long long int element_count, const double frequency, const double weight)
+   : projected_element_count(element_count),
+     query_frequency(frequency),
+     cost_weight(weight),
+     false_positive_probability(1.0),
+     table_size(0)
+   {}
+
+   unsigned long long int projected_element_count;
+   double                 query_frequency;
+   double                 cost_weight;
+   double                 false_positive_probability;
+   unsigned long long int table_size;
+};
+
+namespace details
+{
+   inline double partition_bits(const bloom_partition& partition, const double false_positive_probability)
+   {
+      // Bits needed at the optimal number of hashes: n ln(1/p) / ln(2)^2.
+      const double ln2 = std::log(2.0);
+      return (partition.projected_element_count * -std::log(false_positive_probability)) / (ln2 * ln2);
+   }
+
+   inline double partition_cost(const std::vector<bloom_partition>& partitions)
+   {
+      double cost  = 0.0;
+      double total = 0.0;
+
+      for (std::size_t i = 0; i < partitions.size(); ++i)
+      {
+         cost  += partitions[i].query_frequency * partitions[i].cost_weight * partitions[i].false_positive_probability;
+         total += partitions[i].query_frequency;
+      }
+
+      return (total > 0.0) ? (cost / total) : 0.0;
+   }
+}
+
+inline double optimise_partitions(std::vector<bloom_partition>& partitions, const unsigned long long int memory_budget)
+{
+   /*
+     Note:
+     Chooses the false positive probability p(i) of every partition so
+     as to minimise the expected false positive cost per query,
+
+        sum q(i) w(i) p(i) / sum q(i)
+
+     subject to sum m(i) <= memory_budget bits, where a partition of
+     n(i) keys needs m(i) = n(i) ln(1/p(i)) / ln(2)^2 bits. Setting the
+     derivatives of the Lagrangian to zero gives
+
+        p(i) = min(1, lambda n(i) / (q(i) w(i)))
+
+     i.e. each partition's probability is proportional to its key
+     count and inversely proportional to its query weight, so hot or
+     expensive classes get the lowest probabilities. lambda is found
+     by bisection such that the budget is used up; filters built from
+     the result differ from it only by the rounding of table sizes and
+     hash counts. A partition with p(i) = 1 receives no bits at all.
+     Neither does an empty partition (n(i) = 0), which needs no bits
+     to answer every query with "not present", so its p(i) is 0.
+
+     Fills in false_positive_probability and returns the expected cost.
+   */
+   static const double min_probability = 1.0e-18;
+
+   std::vector<double> weight(partitions.size(),0.0);
+
+   for (std::size_t i = 0; i < partitions.size(); ++i)
+   {
+      const double c = partitions[i].query_frequency * partitions[i].cost_weight;
+
+      if ((c > 0.0) && (partitions[i].projected_element_count > 0))
+         weight[i] = partitions[i].projected_element_count / c;
+   }
+
+   double lower = -700.0;  // ln(lambda) bounds
+   double upper =  700.0;
+
+   for (std::size_t iteration = 0; iteration < 200; ++iteration)
+   {
+      const double middle = 0.5 * (lower + upper);
+      const double lambda = std::exp(middle);
+
+      double bits = 0.0;
+
+      for (std::size_t i = 0; i < partitions.size(); ++i)
+      {
+         if (weight[i] > 0.0)
+         {
+            const double p = std::max(min_probability,std::min(1.0,lambda * weight[i]));
+            bits += details::partition_bits(partitions[i],p);
+         }
+      }
+
+      if (bits > memory_budget)
+         lower = middle;
+      else
+         upper = middle;
+   }
+
+   const double lambda = std::exp(upper);
+
+   for (std::size_t i = 0; i < partitions.size(); ++i)
+   {
+      if (0 == partitions[i].projected_element_count)
+         partitions[i].false_positive_probability = 0.0;
+      else
+         partitions[i].false_positive_probability = (weight[i] > 0.0) ?
+                                                    std::max(min_probability,std::min(1.0,lambda * weight[i])) : 1.0;
+   }
+
+   return details::partition_cost(partitions);
+}
+
+inline double uniform_partition_cost(const std::vector<bloom_partition>& partitions, const unsigned long long int memory_budget)
+{
+   /*
+     Note:
+     Expected cost per query when memory_budget is spent as a single
+     false positive probability shared by every partition, i.e. what
+     one bloom_filter over all keys would give. For comparison with
+     optimise_partitions.
+   */
+   std::vector<bloom_partition> uniform(partitions);
+
+   unsigned long long int total_elements = 0;
+
+   for (std::size_t i = 0; i < uniform.size(); ++i)
+   {
+      total_elements += uniform[i].projected_element_count;
+   }
+
+   const double ln2 = std::log(2.0);
+   const double p = (total_elements > 0) ? std::min(1.0,std::exp(-(memory_budget * ln2 * ln2) / total_elements)) : 1.0;
+
+   for (std::size_t i = 0; i < uniform.size(); ++i)
+   {
+      uniform[i].false_positive_probability = p;
+   }
+
+   return details::partition_cost(uniform);
+}
+
+template<typename Classifier>
+class partitioned_bloom_filter
+{
+   /*
+     Note:
+     One bloom_filter per key class, each sized by optimise_partitions
+     from the class's key count, query frequency and false positive
+     cost under a shared memory budget. Keys are routed to their
+     partition by the caller supplied Classifier, a functor returning
+     the partition index of a key; it must accept every key type
+     passed to insert and contains. A partition that was given no
+     bits reports every key as present, except an empty one (projected
+     with no keys), which reports every key as absent until a key is
+     inserted into it anyway.
+   */
+
+public:
+
+   partitioned_bloom_filter(const std::vector<bloom_partition>& partitions,
+                            const unsigned long long int memory_budget,
+                            const Classifier& classifier = Classifier(),
+                            const unsigned long long int random_seed = 0xA5A5A5A55A5A5A5AULL)
+   : partitions_(partitions),
+     classifier_(classifier),
+     filters_(partitions.size()),
+     empty_(partitions.size(),0),
+     expected_cost_(0.0)
+   {
+      expected_cost_ = optimise_partitions(partitions_,memory_budget);
+
+      for (std::size_t i = 0; i < partitions_.size(); ++i)
+      {
+         empty_[i] = (0 == partitions_[i].projected_element_count);
+
+         if (empty_[i] || (partitions_[i].false_positive_probability >= 1.0))
+            continue;
+
+         bloom_parameters parameters;
+         parameters.projected_element_count    = partitions_[i].projected_element_count;
+         parameters.false_positive_probability = partitions_[i].false_positive_probability;
+         parameters.random_seed                = random_seed + i;
+         parameters.compute_optimal_parameters();
+
+         filters_[i] = bloom_filter(parameters);
+         partitions_[i].table_size = parameters.optimal_parameters.table_size;
+      }
+   }
+
+   inline bool operator!() const
+   {
+      return partitions_.empty();
+   }
+
+   inline void clear()
+   {
+      for (std::size_t i = 0; i < filters_.size(); ++i)
+      {
+         if (!(!filters_[i]))
+            filters_[i].clear();
+
+         empty_[i] = (0 == partitions_[i].projected_element_count);
+      }
+   }
+
+   template<typename T>
+   inline bool insert(const T& key)
+   {
+      // Note: Returns false if the classifier's index is out of range.
+      const std::size_t i = classifier_(key);
+
+      if (i >= filters_.size())
+         return false;
+
+      if (!(!filters_[i]))
+         filters_[i].insert(key);
+      else
+         empty_[i] = 0;
+
+      return true;
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   template<typename T>
+   inline bool contains(const T& key) const
+   {
+      const std::size_t i = classifier_(key);
+
+      if (i >= filters_.size())
+         return true;
+      else if (!filters_[i])
+         return !empty_[i];
+
+      return filters_[i].contains(key);
+   }
+
+   inline std::size_t partition_count() const
+   {
+      return partitions_.size();
+   }
+
+   inline const bloom_partition& partition(const std::size_t i) const
+   {
+      return partitions_[i];
+   }
+
+   inline const bloom_filter& filter(const std::size_t i) const
+   {
+      return filters_[i];
+   }
+
+   inline unsigned long long int size() const
+   {
+      unsigned long long int result = 0;
+
+      for (std::size_t i = 0; i < filters_.size(); ++i)
+      {
+         result += (!filters_[i]) ? 0 : filters_[i].size();
+      }
+
+      return result;
+   }
+
+   inline double expected_cost() const
+   {
+      // Expected false positive cost per query, as solved for.
+      return expected_cost_;
+   }
+
+   inline double effective_cost() const
+   {
+      // Expected cost per query from the keys actually inserted.
+      std::vector<bloom_partition> current(partitions_);
+
+      for (std::size_t i = 0; i < current.size(); ++i)
+      {
+         if (!filters_[i])
+            current[i].false_positive_probability = empty_[i] ? 0.0 : 1.0;
+         else
+            current[i].false_positive_probability = filters_[i].effective_fpp();
+      }
+
+      return details::partition_cost(current);
+   }
+
+private:
+
+   std::vector<bloom_partition> partitions_;
+   Classifier                   classifier_;
+   std::vector<bloom_filter>    filters_;
+   std::vector<char>            empty_;
+   double                       expected_cost_;
+};
+
+class buffered_bloom_filter : public bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter for bulk loads into tables much larger than the
+     cache. Rather than setting each probe bit as it is computed, which
+     dirties k random cache lines per key, inserts append the bit index
+     to the buffer of the table region (region_bytes, an L2 sized slice
+     of the table) it falls in. A buffer is applied when it fills, so
+     its writes all land in one cache resident region.
+
+     Lookups made through this class apply the pending buffers first,
+     as do byte key lookups through a bloom_filter reference (the
+     virtual contains). Any other use of the table through the base
+     class, e.g. the set operators, table() or fill ratio estimates,
+     must be preceded by flush(). Tables of a single region are
+     updated directly.
+
+     Not thread safe, including contains: a lookup with bits pending
+     applies them to the table. Once flush() has been called, lookups
+     only read until the next insert, so concurrent readers are safe
+     there.
+   */
+
+public:
+
+   enum
+   {
+      default_region_bytes = 256 * 1024,
+      buffer_entries       = 512,
+      max_partitions       = 4096
+   };
+
+   buffered_bloom_filter(const bloom_parameters& p, const std::size_t region_bytes = default_region_bytes)
+   : bloom_filter(p),
+     region_shift_(0),
+     pending_(0)
+   {
+      while ((1ULL << region_shift_) < (region_bytes * bits_per_char))
+      {
+         ++region_shift_;
+      }
+
+      while (((schema_->table_size - 1) >> region_shift_) >= max_partitions)
+      {
+         ++region_shift_;
+      }
+
+      const std::size_t partitions = static_cast<std::size_t>((schema_->table_size - 1) >> region_shift_) + 1;
+
+      if (partitions > 1)
+      {
+         buffer_.resize(partitions * buffer_entries);
+         fill_.assign(partitions,0);
+      }
+   }
+
+   inline void insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         buffer_bit(bit_index);
+      }
+      ++inserted_element_count_;
+   }
+
+   template<typename T>
+   inline void insert(const T& t)
+   {
+      // Note: T must be a C++ POD type.
+      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline void insert(const std::string& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline void insert(const char* data, const std::size_t& length)
+   {
+      insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline void insert(const bloom_key_view& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const bloom_uint64& key)
+   {
+      insert_hashed_integer(key.value,0);
+   }
+
+   inline void insert(const bloom_uint128& key)
+   {
+      insert_hashed_integer(key.low,key.high);
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   inline void insert_batch(const bloom_uint64* keys, const std::size_t count)
+   {
+      bloom_type h1[integer_block_size];
+      bloom_type h2[integer_block_size];
+
+      for (std::size_t base = 0; base < count; base += integer_block_size)
+      {
+         const std::size_t n = std::min<std::size_t>(integer_block_size,count - base);
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            integer_hash(keys[base + j].value,0,h1[j],h2[j]);
+         }
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            insert_hashed(h1[j],h2[j]);
+         }
+      }
+   }
+
+   inline void flush() const
+   {
+      // Applies every pending bit to the table.
+      if (0 == pending_)
+         return;
+
+      for (std::size_t p = 0; p < fill_.size(); ++p)
+      {
+         if (fill_[p])
+            flush_partition(p);
+      }
+   }
+
+   inline std::size_t pending() const
+   {
+      // Number of buffered bit positions not yet applied to the table.
+      return pending_;
+   }
+
+   using bloom_filter::contains;
+
+   inline virtual bool contains(const unsigned char* key_begin, const std::size_t length) const
+   {
+      flush();
+      return bloom_filter::contains(key_begin,length);
+   }
+
+   inline bool contains(const bloom_uint64& key) const
+   {
+      flush();
+      return bloom_filter::contains(key);
+   }
+
+   inline bool contains(const bloom_uint128& key) const
+   {
+      flush();
+      return bloom_filter::contains(key);
+   }
+
+   inline void contains_batch(const bloom_uint64* keys, const std::size_t count, bool* results) const
+   {
+      flush();
+      bloom_filter::contains_batch(keys,count,results);
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_all(const InputIterator begin, const InputIterator end) const
+   {
+      flush();
+      return bloom_filter::contains_all(begin,end);
+   }
+
+   template<typename InputIterator>
+   inline InputIterator contains_none(const InputIterator begin, const InputIterator end) const
+   {
+      flush();
+      return bloom_filter::contains_none(begin,end);
+   }
+
+   template<typename InputIterator>
+   inline void contains_interleaved(const InputIterator begin,
+                                    const InputIterator end,
+                                    bool* results,
+                                    const std::size_t group_size = 16) const
+   {
+      flush();
+      bloom_filter::contains_interleaved(begin,end,results,group_size);
+   }
+
+   inline unsigned int contains_mask(const bloom_key_view* keys, const std::size_t count) const
+   {
+      flush();
+      return bloom_filter::contains_mask(keys,count);
+   }
+
+private:
+
+   inline void buffer_bit(const std::size_t bit_index)
+   {
+      if (fill_.empty())
+      {
+         set_bit(bit_index);
+         return;
+      }
+
+      const std::size_t p = bit_index >> region_shift_;
+      unsigned int& n = fill_[p];
+
+      buffer_[(p * buffer_entries) + n] = static_cast<unsigned int>(bit_index);
+      ++pending_;
+
+      if (buffer_entries == ++n)
+         flush_partition(p);
+   }
+
+   inline void insert_hashed(bloom_type h1, const bloom_type h2)
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1 += h2)
+      {
+         compute_index(h1,bit_index);
+         buffer_bit(bit_index);
+      }
+      ++inserted_element_count_;
+   }
+
+   inline void insert_hashed_integer(const unsigned long long int low, const unsigned long long int high)
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+      insert_hashed(h1,h2);
+   }
+
+   inline void flush_partition(const std::size_t p) const
+   {
+      const unsigned int* itr = &buffer_[p * buffer_entries];
+      const unsigned int* end = itr + fill_[p];
+
+      while (end != itr)
+      {
+         const unsigned int bit_index = *(itr++);
+         bit_table_[bit_index / bits_per_word] |= (1ULL << details::word_bit(bit_index));
+      }
+
+      pending_ -= fill_[p];
+      fill_[p]  = 0;
+   }
+
+   unsigned int                      region_shift_;
+   std::vector<unsigned int>         buffer_;
+   mutable std::vector<unsigned int> fill_;
+   mutable std::size_t               pending_;
+};
+
+class bloom_arena
+{
+   /*
+     Note:
+     Monotonic allocator for short-lived filters: allocations are
+     carved sequentially out of a caller supplied buffer and then out
+     of blocks the arena allocates, and are only reclaimed together by
+     release(). Blocks are kept for reuse, so an arena released after
+     every request stops allocating once it has seen the largest one.
+     Not thread safe.
+   */
+
+public:
+
+   enum { default_block_size = 64 * 1024 };
+
+   explicit bloom_arena(const std::size_t block_size = default_block_size)
+   : buffer_(0),
+     buffer_size_(0),
+     block_size_(block_size),
+     current_(0),
+     remaining_(0),
+     next_block_(0)
+   {}
+
+   bloom_arena(void* buffer, const std::size_t buffer_size, const std::size_t block_size = default_block_size)
+   : buffer_(static_cast<unsigned char*>(buffer)),
+     buffer_size_(buffer_size),
+     block_size_(block_size),
+     current_(static_cast<unsigned char*>(buffer)),
+     remaining_(buffer_size),
+     next_block_(0)
+   {}
+
+  ~bloom_arena()
+   {
+      for (std::size_t i = 0; i < blocks_.size(); ++i)
+      {
+         delete[] blocks_[i].first;
+      }
+   }
+
+   inline void* allocate(const std::size_t size, const std::size_t alignment = sizeof(unsigned long long int))
+   {
+      std::size_t padding = (alignment - (reinterpret_cast<std::size_t>(current_) % alignment)) % alignment;
+
+      if ((0 == current_) || ((size + padding) > remaining_))
+      {
+         next_region(size + alignment);
+         padding = (alignment - (reinterpret_cast<std::size_t>(current_) % alignment)) % alignment;
+      }
+
+      unsigned char* result = current_ + padding;
+      current_   += padding + size;
+      remaining_ -= padding + size;
+
+      return result;
+   }
+
+   inline void release()
+   {
+      // Invalidates every allocation made since the last release.
+      current_    = buffer_;
+      remaining_  = buffer_size_;
+      next_block_ = 0;
+   }
+
+   inline std::size_t block_count() const
+   {
+      return blocks_.size();
+   }
+
+private:
+
+   bloom_arena(const bloom_arena&);
+   bloom_arena& operator=(const bloom_arena&);
+
+   inline void next_region(const std::size_t size)
+   {
+      // Reuse the next kept block that is large enough, else add one.
+      while (next_block_ < blocks_.size())
+      {
+         const std::pair<unsigned char*,std::size_t>& block = blocks_[next_block_++];
+
+         if (block.second >= size)
+         {
+            current_   = block.first;
+            remaining_ = block.second;
+            return;
+         }
+      }
+
+      const std::size_t block_size = std::max(block_size_,size);
+
+      blocks_.push_back(std::make_pair(new unsigned char[block_size],block_size));
+      next_block_ = blocks_.size();
+      current_    = blocks_.back().first;
+      remaining_  = block_size;
+   }
+
+   unsigned char* buffer_;
+   std::size_t    buffer_size_;
+   std::size_t    block_size_;
+   unsigned char* current_;
+   std::size_t    remaining_;
+   std::size_t    next_block_;
+   std::vector<std::pair<unsigned char*,std::size_t> > blocks_;
+};
+
+class arena_bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter whose table is allocated from a bloom_arena and
+     whose salts come from a shared filter_schema, so that constructing
+     one from a schema costs a reference count increment, an arena
+     allocation and zeroing the table, and destroying one costs the
+     decrement. The table lives until the arena is released, which
+     must not happen while the filter is in use. Constructing from
+     parameters creates a schema, salts included, for this filter
+     alone.
+
+     Keys set the same bits as in a bloom_filter built from the same
+     parameters. Not copyable.
+   */
+
+public:
+
+   arena_bloom_filter(const filter_schema_ptr& schema, bloom_arena& arena)
+   : schema_(schema),
+     bit_table_(0),
+     inserted_element_count_(0)
+   {
+      allocate_table(arena);
+   }
+
+   arena_bloom_filter(const bloom_parameters& p, bloom_arena& arena)
+   : schema_(filter_schema::create(p)),
+     bit_table_(0),
+     inserted_element_count_(0)
+   {
+      allocate_table(arena);
+   }
+
+   inline void clear()
+   {
+      std::memset(bit_table_,0x00,table_bytes());
+      inserted_element_count_ = 0;
+   }
+
+   inline void insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      for (unsigned int i = 0; i < schema_->salt_count; ++i)
+      {
+         set_bit(details::hash_ap(key_begin,length,schema_->salt[i]));
+      }
+      ++inserted_element_count_;
+   }
+
+   template<typename T>
+   inline void insert(const T& t)
+   {
+      // Note: T must be a C++ POD type.
+      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline void insert(const std::string& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline void insert(const char* data, const std::size_t& length)
+   {
+      insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline void insert(const bloom_key_view& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const bloom_uint64& key)
+   {
+      insert_integer(key.value,0);
+   }
+
+   inline void insert(const bloom_uint128& key)
+   {
+      insert_integer(key.low,key.high);
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   inline bool contains(const unsigned char* key_begin, const std::size_t length) const
+   {
+      for (unsigned int i = 0; i < schema_->salt_count; ++i)
+      {
+         if (!test_bit(details::hash_ap(key_begin,length,schema_->salt[i])))
+            return false;
+      }
+      return true;
+   }
+
+   template<typename T>
+   inline bool contains(const T& t) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(&t),static_cast<std::size_t>(sizeof(T)));
+   }
+
+   inline bool contains(const std::string& key) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline bool contains(const char* data, const std::size_t& length) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline bool contains(const bloom_key_view& key) const
+   {
+      return contains(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline bool contains(const bloom_uint64& key) const
+   {
+      return contains_integer(key.value,0);
+   }
+
+   inline bool contains(const bloom_uint128& key) const
+   {
+      return contains_integer(key.low,key.high);
+   }
+
+   inline unsigned long long int size() const
+   {
+      return schema_->table_size;
+   }
+
+   inline std::size_t element_count() const
+   {
+      return inserted_element_count_;
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return schema_->salt_count;
+   }
+
+   inline double effective_fpp() const
+   {
+      return std::pow(1.0 - std::exp(-1.0 * schema_->salt_count * inserted_element_count_ / size()), 1.0 * schema_->salt_count);
+   }
+
+   inline const unsigned char* table() const
+   {
+      return reinterpret_cast<const unsigned char*>(bit_table_);
+   }
+
+   inline const filter_schema_ptr& schema() const
+   {
+      return schema_;
+   }
+
+private:
+
+   arena_bloom_filter(const arena_bloom_filter&);
+   arena_bloom_filter& operator=(const arena_bloom_filter&);
+
+   inline void allocate_table(bloom_arena& arena)
+   {
+      bit_table_ = static_cast<unsigned long long int*>(arena.allocate(table_bytes(),sizeof(unsigned long long int)));
+      std::memset(bit_table_,0x00,table_bytes());
+   }
+
+   inline std::size_t bit_index(const unsigned int hash) const
+   {
+      // hash % table_size with a 32-bit division: the hash is 32 bits wide.
+      return (schema_->table_size > 0xFFFFFFFFULL) ? hash : (hash % static_cast<unsigned int>(schema_->table_size));
+   }
+
+   inline std::size_t table_bytes() const
+   {
+      // ceil(table_size / 64) whole 64-bit words, as in bloom_filter.
+      return static_cast<std::size_t>(((schema_->table_size + 63) / 64) * 8);
+   }
+
+   inline void set_bit(const unsigned int hash)
+   {
+      const std::size_t bit_index = this->bit_index(hash);
+      bit_table_[bit_index / 64] |= (1ULL << details::word_bit(bit_index));
+   }
+
+   inline bool test_bit(const unsigned int hash) const
+   {
+      const std::size_t bit_index = this->bit_index(hash);
+      return 0 != (bit_table_[bit_index / 64] & (1ULL << details::word_bit(bit_index)));
+   }
+
+   inline void insert_integer(const unsigned long long int low, const unsigned long long int high)
+   {
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      details::integer_hash(low,high,schema_->random_seed,h1,h2);
+
+      for (unsigned int i = 0; i < schema_->salt_count; ++i, h1 += h2)
+      {
+         set_bit(h1);
+      }
+      ++inserted_element_count_;
+   }
+
+   inline bool contains_integer(const unsigned long long int low, const unsigned long long int high) const
+   {
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      details::integer_hash(low,high,schema_->random_seed,h1,h2);
+
+      for (unsigned int i = 0; i < schema_->salt_count; ++i, h1 += h2)
+      {
+         if (!test_bit(h1))
+            return false;
+      }
+      return true;
+   }
+
+   filter_schema_ptr       schema_;
+   unsigned long long int* bit_table_;
+   unsigned int            inserted_element_count_;
+};
+
+class count_min_parameters
+{
+public:
+
+   count_min_parameters()
+   : epsilon(0.001),
+     delta(0.01),
+     conservative_update(false),
+     random_seed(0xA5A5A5A55A5A5A5AULL)
+   {}
+
+   virtual ~count_min_parameters()
+   {}
+
+   inline bool operator!()
+   {
+      return (epsilon <= 0.0) || (epsilon >= 1.0) ||
+             (delta   <= 0.0) || (delta   >= 1.0) ||
+             (0 == random_seed)                   ||
+             (0xFFFFFFFFFFFFFFFFULL == random_seed);
+   }
+
+   //Estimates exceed the true count by at most epsilon times
+   //the total of all updates, with probability 1 - delta.
+   double epsilon;
+   double delta;
+
+   //Raise only the counters below the new estimate on update.
+   bool conservative_update;
+
+   unsigned long long int random_seed;
+
+   struct optimal_parameters_t
+   {
+      optimal_parameters_t()
+      : width(0),
+        depth(0)
+      {}
+
+      unsigned long long int width;
+      unsigned int depth;
+   };
+
+   optimal_parameters_t optimal_parameters;
+
+   virtual bool compute_optimal_parameters()
+   {
+      /*
+        Note:
+        width = e / epsilon and depth = ln(1 / delta) (Cormode and
+        Muthukrishnan). The width is rounded up to a power of two of
+        at least 16 counters, so that a row index is a mask and every
+        row is a whole number of 64 byte cache lines.
+      */
+
+      if (!(*this))
+         return false;
+
+      const double min_width = std::ceil(std::exp(1.0) / epsilon);
+
+      optimal_parameters.width = 16;
+
+      while (optimal_parameters.width < min_width)
+      {
+         optimal_parameters.width <<= 1;
+      }
+
+      optimal_parameters.depth = std::max(1U,static_cast<unsigned int>(std::ceil(std::log(1.0 / delta))));
+
+      return true;
+   }
+};
+
+class count_min_sketch
+{
+   /*
+     Note:
+     depth rows of width counters. A key maps to one counter per row;
+     an update adds to each and an estimate is their minimum, which
+     never undercounts. With conservative update only the counters
+     below the new estimate are raised, which tightens estimates of
+     infrequent keys.
+
+     Keys are hashed as in bloom_filter: byte keys with the first two
+     salts of a filter_schema, bloom_uint64 keys with its seed through
+     details::integer_hash, and row i uses h1 + i * h2. A sketch built
+     on a filter's schema thus shares the filter's hashes for a key,
+     see counted_bloom_filter.
+   */
+
+public:
+
+   typedef unsigned int counter_type;
+
+   enum { batch_block_size = 8 };
+
+   count_min_sketch()
+   : width_(0),
+     mask_(0),
+     depth_(0),
+     conservative_(false),
+     total_count_(0)
+   {}
+
+   explicit count_min_sketch(const count_min_parameters& p)
+   : schema_(filter_schema::create(p.optimal_parameters.width * p.optimal_parameters.depth * sizeof(counter_type) * bits_per_char,
+                                   2,
+                                   (p.random_seed * 0xA5A5A5A5) + 1,
+                                   0,
+                                   p.delta)),
+     width_(static_cast<std::size_t>(p.optimal_parameters.width)),
+     mask_(width_ - 1),
+     depth_(p.optimal_parameters.depth),
+     conservative_(p.conservative_update),
+     total_count_(0),
+     table_(width_ * depth_,0)
+   {}
+
+   count_min_sketch(const count_min_parameters& p, const filter_schema_ptr& schema)
+   : schema_(schema),
+     width_(static_cast<std::size_t>(p.optimal_parameters.width)),
+     mask_(width_ - 1),
+     depth_(p.optimal_parameters.depth),
+     conservative_(p.conservative_update),
+     total_count_(0),
+     table_(width_ * depth_,0)
+   {}
+
+   inline bool operator!() const
+   {
+      return (0 == depth_);
+   }
+
+   inline void clear()
+   {
+      std::fill(table_.begin(),table_.end(),0);
+      total_count_ = 0;
+   }
+
+   inline void update(const unsigned char* key_begin, const std::size_t& length, const counter_type count = 1)
+   {
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      hash(key_begin,length,h1,h2);
+      update_hashed(h1,h2,count);
+   }
+
+   inline void update(const std::string& key, const counter_type count = 1)
+   {
+      update(reinterpret_cast<const unsigned char*>(key.data()),key.size(),count);
+   }
+
+   inline void update(const char* data, const std::size_t& length, const counter_type count = 1)
+   {
+      update(reinterpret_cast<const unsigned char*>(data),length,count);
+   }
+
+   inline void update(const bloom_key_view& key, const counter_type count = 1)
+   {
+      update(reinterpret_cast<const unsigned char*>(key.data),key.length,count);
+   }
+
+   inline void update(const bloom_uint64& key, const counter_type count = 1)
+   {
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      details::integer_hash(key.value,0,schema_->random_seed,h1,h2);
+      update_hashed(h1,h2,count);
+   }
+
+   inline void update_batch(const bloom_uint64* keys, const std::size_t count, const counter_type increment = 1)
+   {
+      unsigned int h1[batch_block_size];
+      unsigned int h2[batch_block_size];
+
+      for (std::size_t i = 0; i < count; i += batch_block_size)
+      {
+         const std::size_t n = std::min<std::size_t>(batch_block_size,count - i);
+
+         hash_block(keys + i,n,h1,h2);
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            update_hashed(h1[j],h2[j],increment);
+         }
+      }
+   }
+
+   inline counter_type estimate(const unsigned char* key_begin, const std::size_t length) const
+   {
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      hash(key_begin,length,h1,h2);
+      return estimate_hashed(h1,h2);
+   }
+
+   inline counter_type estimate(const std::string& key) const
+   {
+      return estimate(reinterpret_cast<const unsigned char*>(key.data()),key.size());
+   }
+
+   inline counter_type estimate(const char* data, const std::size_t& length) const
+   {
+      return estimate(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline counter_type estimate(const bloom_key_view& key) const
+   {
+      return estimate(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline counter_type estimate(const bloom_uint64& key) const
+   {
+      unsigned int h1 = 0;
+      unsigned int h2 = 0;
+      details::integer_hash(key.value,0,schema_->random_seed,h1,h2);
+      return estimate_hashed(h1,h2);
+   }
+
+   inline void estimate_batch(const bloom_uint64* keys, const std::size_t count, counter_type* results) const
+   {
+      unsigned int h1[batch_block_size];
+      unsigned int h2[batch_block_size];
+
+      for (std::size_t i = 0; i < count; i += batch_block_size)
+      {
+         const std::size_t n = std::min<std::size_t>(batch_block_size,count - i);
+
+         hash_block(keys + i,n,h1,h2);
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            results[i + j] = estimate_hashed(h1[j],h2[j]);
+         }
+      }
+   }
+
+   inline bool merge(const count_min_sketch& s)
+   {
+      /*
+        Note:
+        Adds the counters of a sketch of the same shape and hashing,
+        giving the sketch of the combined streams. Returns false if
+        the sketches differ in either.
+      */
+      if (
+          (width_ != s.width_) ||
+          (depth_ != s.depth_) ||
+          !((schema_ == s.schema_) || schema_->compatible(*s.schema_))
+         )
+         return false;
+
+      for (std::size_t i = 0; i < table_.size(); ++i)
+      {
+         table_[i] = saturating_add(table_[i],s.table_[i]);
+      }
+
+      total_count_ += s.total_count_;
+
+      return true;
+   }
+
+   inline std::size_t width() const
+   {
+      return width_;
+   }
+
+   inline std::size_t depth() const
+   {
+      return depth_;
+   }
+
+   inline bool conservative_update() const
+   {
+      return conservative_;
+   }
+
+   inline unsigned long long int total_count() const
+   {
+      return total_count_;
+   }
+
+   inline const counter_type* table() const
+   {
+      // depth rows of width counters, row major.
+      return table_.empty() ? 0 : &table_[0];
+   }
+
+   inline const filter_schema_ptr& schema() const
+   {
+      return schema_;
+   }
+
+private:
+
+   friend class counted_bloom_filter;
+
+   static inline counter_type saturating_add(const counter_type a, const counter_type b)
+   {
+      const counter_type sum = a + b;
+      return (sum < a) ? std::numeric_limits<counter_type>::max() : sum;
+   }
+
+   static inline unsigned int derived_hash(const unsigned int h1)
+   {
+      // Second hash for schemas with a single salt.
+      return static_cast<unsigned int>(details::mix64(h1));
+   }
+
+   inline void hash(const unsigned char* key_begin, const std::size_t length, unsigned int& h1, unsigned int& h2) const
+   {
+      const std::vector<unsigned int>& salt = schema_->salt;
+
+      h1 = salt.empty()     ? 0 : details::hash_ap(key_begin,length,salt[0]);
+      h2 = (salt.size() > 1) ? details::hash_ap(key_begin,length,salt[1]) : derived_hash(h1);
+   }
+
+   inline void hash_block(const bloom_uint64* keys, const std::size_t n, unsigned int* h1, unsigned int* h2) const
+   {
+      for (std::size_t j = 0; j < n; ++j)
+      {
+         details::integer_hash(keys[j].value,0,schema_->random_seed,h1[j],h2[j]);
+      }
+
+      for (std::size_t j = 0; j < n; ++j)
+      {
+         unsigned int h = h1[j];
+
+         for (std::size_t i = 0; i < depth_; ++i, h += h2[j])
+         {
+            details::prefetch(&table_[(i * width_) + (h & mask_)]);
+         }
+      }
+   }
+
+   inline void update_hashed(unsigned int h1, unsigned int h2, const counter_type count)
+   {
+      h2 |= 1;
+      total_count_ += count;
+
+      if (conservative_)
+      {
+         const counter_type target = saturating_add(estimate_hashed(h1,h2),count);
+
+         for (std::size_t i = 0; i < depth_; ++i, h1 += h2)
+         {
+            counter_type& counter = table_[(i * width_) + (h1 & mask_)];
+
+            if (counter < target)
+               counter = target;
+         }
+      }
+      else
+      {
+         for (std::size_t i = 0; i < depth_; ++i, h1 += h2)
+         {
+            counter_type& counter = table_[(i * width_) + (h1 & mask_)];
+            counter = saturating_add(counter,count);
+         }
+      }
+   }
+
+   inline counter_type estimate_hashed(unsigned int h1, unsigned int h2) const
+   {
+      h2 |= 1;
+
+      counter_type result = std::numeric_limits<counter_type>::max();
+
+      for (std::size_t i = 0; i < depth_; ++i, h1 += h2)
+      {
+         result = std::min(result,table_[(i * width_) + (h1 & mask_)]);
+      }
+
+      return depth_ ? result : 0;
+   }
+
+   filter_schema_ptr         schema_;
+   std::size_t               width_;
+   std::size_t               mask_;
+   std::size_t               depth_;
+   bool                      conservative_;
+   unsigned long long int    total_count_;
+   std::vector<counter_type> table_;
+};
+
+class counted_bloom_filter : public bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter and a count_min_sketch on the filter's schema.
+     insert() hashes a key once and sets the filter's bits and raises
+     the sketch's counters from the same hashes. count() answers 0
+     for keys the filter rules out without reading the sketch, and
+     the sketch's estimate otherwise.
+   */
+
+public:
+
+   typedef count_min_sketch::counter_type counter_type;
+
+   counted_bloom_filter(const bloom_parameters& p, const count_min_parameters& c)
+   : bloom_filter(p),
+     sketch_(c,schema_)
+   {}
+
+   inline void clear()
+   {
+      bloom_filter::clear();
+      sketch_.clear();
+   }
+
+   inline void insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      const std::vector<bloom_type>& salt = schema_->salt;
+
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      std::size_t bit_index = 0;
+
+      for (std::size_t i = 0; i < salt.size(); ++i)
+      {
+         const bloom_type h = hash_ap(key_begin,length,salt[i]);
+         compute_index(h,bit_index);
+         set_bit(bit_index);
+
+         if (0 == i)
+            h1 = h;
+         else if (1 == i)
+            h2 = h;
+      }
+
+      if (salt.size() < 2)
+         h2 = count_min_sketch::derived_hash(h1);
+
+      sketch_.update_hashed(h1,h2,1);
+      ++inserted_element_count_;
+   }
+
+   template<typename T>
+   inline void insert(const T& t)
+   {
+      // Note: T must be a C++ POD type.
+      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline void insert(const std::string& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data()),key.size());
+   }
+
+   inline void insert(const char* data, const std::size_t& length)
+   {
+      insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline void insert(const bloom_key_view& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const bloom_uint64& key)
+   {
+      insert_counted(key.value,0);
+   }
+
+   inline void insert(const bloom_uint128& key)
+   {
+      insert_counted(key.low,key.high);
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   inline void insert_batch(const bloom_uint64* keys, const std::size_t count)
+   {
+      bloom_type h1[integer_block_size];
+      bloom_type h2[integer_block_size];
+
+      for (std::size_t i = 0; i < count; i += integer_block_size)
+      {
+         const std::size_t n = std::min<std::size_t>(integer_block_size,count - i);
+
+         hash_integer_block(keys + i,n,h1,h2);
+
+         for (std::size_t j = 0; j < n; ++j)
+         {
+            insert_hashed(h1[j],h2[j]);
+         }
+      }
+   }
+
+   inline counter_type count(const unsigned char* key_begin, const std::size_t length) const
+   {
+      const std::vector<bloom_type>& salt = schema_->salt;
+
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      std::size_t bit_index = 0;
+
+      for (std::size_t i = 0; i < salt.size(); ++i)
+      {
+         const bloom_type h = hash_ap(key_begin,length,salt[i]);
+         compute_index(h,bit_index);
+
+         if (!test_bit(bit_index))
+            return 0;
+
+         if (0 == i)
+            h1 = h;
+         else if (1 == i)
+            h2 = h;
+      }
+
+      if (salt.size() < 2)
+         h2 = count_min_sketch::derived_hash(h1);
+
+      return sketch_.estimate_hashed(h1,h2);
+   }
+
+   template<typename T>
+   inline counter_type count(const T& t) const
+   {
+      // Note: T must be a C++ POD type.
+      return count(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline counter_type count(const std::string& key) const
+   {
+      return count(reinterpret_cast<const unsigned char*>(key.data()),key.size());
+   }
+
+   inline counter_type count(const char* data, const std::size_t& length) const
+   {
+      return count(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline counter_type count(const bloom_key_view& key) const
+   {
+      return count(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline counter_type count(const bloom_uint64& key) const
+   {
+      return count_counted(key.value,0);
+   }
+
+   inline counter_type count(const bloom_uint128& key) const
+   {
+      return count_counted(key.low,key.high);
+   }
+
+   inline const count_min_sketch& sketch() const
+   {
+      return sketch_;
+   }
+
+private:
+
+   inline void insert_hashed(const bloom_type h1, const bloom_type h2)
+   {
+      std::size_t bit_index = 0;
+      bloom_type h = h1;
+
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h += h2)
+      {
+         compute_index(h,bit_index);
+         set_bit(bit_index);
+      }
+
+      sketch_.update_hashed(h1,h2,1);
+      ++inserted_element_count_;
+   }
+
+   inline void insert_counted(const unsigned long long int low, const unsigned long long int high)
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+      insert_hashed(h1,h2);
+   }
+
+   inline counter_type count_counted(const unsigned long long int low, const unsigned long long int high) const
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+      return contains_hashed(h1,h2) ? sketch_.estimate_hashed(h1,h2) : 0;
+   }
+
+   count_min_sketch sketch_;
+};
+
+class seed_trial_filter : public bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter whose table and salt storage can be reused for a
+     different random seed, avoiding a reallocation per trial. Keys
+     can be hashed once per seed into a bit index buffer, which then
+     serves both the insertion and the false negative check.
+   */
+
+public:
+
+   seed_trial_filter(const bloom_parameters& p)
+   : bloom_filter(p)
+   {}
+
+   inline void hash_keys(const std::vector<bloom_key_view>& keys, std::vector<std::size_t>& bit_indices) const
+   {
+      const std::size_t k = schema_->salt.size();
+
+      bit_indices.resize(keys.size() * k);
+
+      for (std::size_t i = 0; i < keys.size(); ++i)
+      {
+         const unsigned char* key = reinterpret_cast<const unsigned char*>(keys[i].data);
+
+         for (std::size_t j = 0; j < k; ++j)
+         {
+            compute_index(hash_ap(key,keys[i].length,schema_->salt[j]),bit_indices[(i * k) + j]);
+         }
+      }
+   }
+
+   inline void insert_hashed(const std::vector<std::size_t>& bit_indices)
+   {
+      for (std::size_t i = 0; i < bit_indices.size(); ++i)
+      {
+         set_bit(bit_indices[i]);
+      }
+
+      if (!schema_->salt.empty())
+         inserted_element_count_ += bit_indices.size() / schema_->salt.size();
+   }
+
+   inline std::size_t count_missing(const std::vector<std::size_t>& bit_indices) const
+   {
+      // Number of hashed keys with at least one clear bit, i.e. false negatives.
+      const std::size_t k = schema_->salt.size();
+
+      std::size_t missing = 0;
+
+      for (std::size_t i = 0; (i + k) <= bit_indices.size() && (k > 0); i += k)
+      {
+         for (std::size_t j = 0; j < k; ++j)
+         {
+            if (!test_bit(bit_indices[i + j]))
+            {
+               ++missing;
+               break;
+            }
+         }
+      }
+
+      return missing;
+   }
+
+   inline void reseed(const unsigned long long int seed)
+   {
+      clear();
+      schema_ = filter_schema::create(schema_->table_size,
+                                      schema_->salt_count,
+                                      (seed * 0xA5A5A5A5) + 1,
+                                      schema_->projected_element_count,
+                                      schema_->false_positive_probability);
+   }
+};
+
+struct seed_trial
+{
+   seed_trial()
+   : seed(0),
+     false_positive_count(0),
+     false_negative_count(0),
+     false_positive_probability(0.0)
+   {}
+
+   unsigned long long int seed;
+   std::size_t            false_positive_count;
+   std::size_t            false_negative_count; // keys not found, always 0 unless broken
+   double                 false_positive_probability;
+};
+
+struct seed_search_result
+{
+   seed_search_result()
+   : best_index(0),
+     table_size(0),
+     number_of_hashes(0)
+   {}
+
+   inline const seed_trial& best() const
+   {
+      return trials[best_index];
+   }
+
+   // One entry per round, in seed order.
+   std::vector<seed_trial> trials;
+   std::size_t             best_index;
+   unsigned long long int  table_size;
+   unsigned int            number_of_hashes;
+};
+
+namespace details
+{
+   struct seed_search_state
+   {
+      const std::vector<bloom_key_view>* keys;
+      const std::vector<bloom_key_view>* outliers;
+      const bloom_parameters*            parameters;
+      std::vector<seed_trial>*           trials;
+      unsigned int                       next_round;
+   };
+
+   inline void* seed_search_worker(void* arg)
+   {
+      seed_search_state& state = *static_cast<seed_search_state*>(arg);
+      seed_trial_filter filter(*state.parameters);
+      std::vector<std::size_t> bit_indices;
+
+      const std::vector<bloom_key_view>& keys     = *state.keys;
+      const std::vector<bloom_key_view>& outliers = *state.outliers;
+      const unsigned int rounds = static_cast<unsigned int>(state.trials->size());
+
+      for ( ; ; )
+      {
+         #if defined(BLOOM_FILTER_THREADS)
+         const unsigned int round = __atomic_fetch_add(&state.next_round,1U,__ATOMIC_RELAXED);
+         #else
+         const unsigned int round = state.next_round++;
+         #endif
+
+         if (round >= rounds)
+            break;
+
+         seed_trial& trial = (*state.trials)[round];
+         trial.seed = round + 1;
+
+         filter.reseed(trial.seed);
+
+         // Each key is hashed once per round, for both the insert and the check.
+         filter.hash_keys(keys,bit_indices);
+         filter.insert_hashed(bit_indices);
+
+         trial.false_negative_count = filter.count_missing(bit_indices);
+
+         for (std::size_t i = 0; i < outliers.size(); ++i)
+         {
+            if (filter.contains(outliers[i]))
+               ++trial.false_positive_count;
+         }
+
+         trial.false_positive_probability = outliers.empty() ? 0.0 : (1.0 * trial.false_positive_count) / outliers.size();
+      }
+
+      return 0;
+   }
+}
+
+template<typename KeyContainer, typename OutlierContainer>
+inline seed_search_result find_best_seed(const KeyContainer& keys,
+                                         const OutlierContainer& outliers,
+                                         const bloom_parameters& parameters,
+                                         const unsigned int rounds,
+                                         unsigned int thread_count = 0)
+{
+   /*
+     Note:
+     Builds a filter from keys for each of the seeds 1..rounds and
+     measures its false positive probability against outliers, which
+     must not contain any of the keys. The parameters must already have
+     had compute_optimal_parameters applied. Every round also checks
+     that all keys are found, see seed_trial::false_negative_count.
+     Rounds are spread over
+     thread_count workers (0 selects the number of online processors)
+     when built with BLOOM_FILTER_THREADS, otherwise they are run on
+     the calling thread. Each worker reuses a single filter.
+   */
+   std::vector<bloom_key_view> key_views;
+   std::vector<bloom_key_view> outlier_views;
+
+   key_views.reserve(keys.size());
+   outlier_views.reserve(outliers.size());
+
+   for (typename KeyContainer::const_iterator itr = keys.begin(); itr != keys.end(); ++itr)
+   {
+      key_views.push_back(details::make_key_view(*itr));
+   }
+
+   for (typename OutlierContainer::const_iterator itr = outliers.begin(); itr != outliers.end(); ++itr)
+   {
+      outlier_views.push_back(details::make_key_view(*itr));
+   }
+
+   seed_search_result result;
+   result.trials.resize(rounds);
+   result.table_size       = parameters.optimal_parameters.table_size;
+   result.number_of_hashes = parameters.optimal_parameters.number_of_hashes;
+
+   if (0 == rounds)
+      return result;
+
+   details::seed_search_state state;
+   state.keys       = &key_views;
+   state.outliers   = &outlier_views;
+   state.parameters = &parameters;
+   state.trials     = &result.trials;
+   state.next_round = 0;
+
+   #if defined(BLOOM_FILTER_THREADS)
+   if (0 == thread_count)
+   {
+      const long online = ::sysconf(_SC_NPROCESSORS_ONLN);
+      thread_count = (online > 0) ? static_cast<unsigned int>(online) : 1;
+   }
+
+   thread_count = std::min(thread_count,rounds);
+
+   std::vector<pthread_t> threads(thread_count);
+   std::vector<char>      started(thread_count,0);
+
+   for (unsigned int i = 1; i < thread_count; ++i)
+   {
+      // Rounds a worker fails to start for are taken by the others,
+      // including the calling thread below.
+      started[i] = (0 == pthread_create(&threads[i],0,&details::seed_search_worker,&state));
+   }
+
+   details::seed_search_worker(&state);
+
+   for (unsigned int i = 1; i < thread_count; ++i)
+   {
+      if (started[i])
+         pthread_join(threads[i],0);
+   }
+
+   #else
+   static_cast<void>(thread_count);
+   details::seed_search_worker(&state);
+   #endif
+
+   for (std::size_t i = 1; i < result.trials.size(); ++i)
+   {
+      if (result.trials[i].false_positive_count < result.trials[result.best_index].false_positive_count)
+         result.best_index = i;
+   }
+
+   return result;
+}
+
+struct null_bloom_stats
+{
+   /*
+     Note:
+     Statistics policy that records nothing. Every hook is an empty
+     inline function, so an instrumented_bloom_filter using this policy
+     compiles down to the same code as bloom_filter.
+   */
+   inline void on_insert() const
+   {}
+
+   inline void on_query(const bool, const std::size_t) const
+   {}
+};
+
+class bloom_stats
+{
+   /*
+     Note:
+     Statistics policy that counts inserts, queries, positives and the
+     number of probes made before a negative query exits. Counters are
+     kept in per-thread, cache line sized shards which are only summed
+     when a snapshot is taken. With more than max_shards concurrently
+     updating threads some shards are shared and counts may be
+     slightly under-reported.
+   */
+
+public:
+
+   enum { max_shards = 64, max_probe_bucket = 32 };
+
+   struct snapshot_t
+   {
+      snapshot_t()
+      : inserts(0),
+        queries(0),
+        positives(0)
+      {
+         std::fill_n(negative_probes,static_cast<std::size_t>(max_probe_bucket + 1),0ULL);
+      }
+
+      inline unsigned long long int negatives() const
+      {
+         return queries - positives;
+      }
+
+      inline double hit_ratio() const
+      {
+         return queries ? (1.0 * positives) / queries : 0.0;
+      }
+
+      inline double average_negative_probes() const
+      {
+         unsigned long long int total = 0;
+         unsigned long long int count = 0;
+
+         for (std::size_t i = 1; i <= max_probe_bucket; ++i)
+         {
+            total += i * negative_probes[i];
+            count += negative_probes[i];
+         }
+
+         return count ? (1.0 * total) / count : 0.0;
+      }
+
+      unsigned long long int inserts;
+      unsigned long long int queries;
+      unsigned long long int positives;
+
+      // negative_probes[i] is the number of negative queries that
+      // exited on the i-th probe, the last bucket collects the rest.
+      unsigned long long int negative_probes[max_probe_bucket + 1];
+   };
+
+   bloom_stats()
+   : shards_(max_shards)
+   {}
+
+   inline void on_insert()
+   {
+      increment(shard().inserts);
+   }
+
+   inline void on_query(const bool positive, const std::size_t probes)
+   {
+      shard_t& s = shard();
+
+      increment(s.queries);
+
+      if (positive)
+         increment(s.positives);
+      else
+         increment(s.negative_probes[std::min(probes,static_cast<std::size_t>(max_probe_bucket))]);
+   }
+
+   inline snapshot_t snapshot() const
+   {
+      snapshot_t result;
+
+      for (std::size_t i = 0; i < shards_.size(); ++i)
+      {
+         const shard_t& s = shards_[i];
+
+         result.inserts   += load(s.inserts);
+         result.queries   += load(s.queries);
+         result.positives += load(s.positives);
+
+         for (std::size_t j = 0; j <= max_probe_bucket; ++j)
+         {
+            result.negative_probes[j] += load(s.negative_probes[j]);
+         }
+      }
+
+      return result;
+   }
+
+   inline void reset()
+   {
+      std::fill(shards_.begin(),shards_.end(),shard_t());
+   }
+
+private:
+
+   struct shard_t
+   {
+      shard_t()
+      : inserts(0),
+        queries(0),
+        positives(0)
+      {
+         std::fill_n(negative_probes,static_cast<std::size_t>(max_probe_bucket + 1),0ULL);
+      }
+
+      unsigned long long int inserts;
+      unsigned long long int queries;
+      unsigned long long int positives;
+      unsigned long long int negative_probes[max_probe_bucket + 1];
+      unsigned char padding[64 - (((max_probe_bucket + 4) * sizeof(unsigned long long int)) % 64)];
+   };
+
+   static inline std::size_t thread_slot()
+   {
+      #if defined(__GNUC__)
+      static unsigned int next_slot = 0;
+      static __thread unsigned int slot = 0;
+
+      if (0 == slot)
+      {
+         slot = __atomic_add_fetch(&next_slot,1U,__ATOMIC_RELAXED);
+      }
+
+      return slot % max_shards;
+      #else
+      return 0;
+      #endif
+   }
+
+   inline shard_t& shard()
+   {
+      return shards_[thread_slot()];
+   }
+
+   static inline void increment(unsigned long long int& counter)
+   {
+      // Single writer per shard: a relaxed load/store pair avoids a
+      // locked read-modify-write on the hot path.
+      #if defined(__GNUC__)
+      __atomic_store_n(&counter,__atomic_load_n(&counter,__ATOMIC_RELAXED) + 1,__ATOMIC_RELAXED);
+      #else
+      ++counter;
+      #endif
+   }
+
+   static inline unsigned long long int load(const unsigned long long int& counter)
+   {
+      #if defined(__GNUC__)
+      return __atomic_load_n(&counter,__ATOMIC_RELAXED);
+      #else
+      return counter;
+      #endif
+   }
+
+   std::vector<shard_t> shards_;
+};
+
+template<typename StatsPolicy>
+class instrumented_bloom_filter : public bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter that reports every insert and query to a statistics
+     policy, e.g. null_bloom_stats or bloom_stats. The policy is chosen
+     at compile time, so a null policy adds no cost.
+   */
+
+public:
+
+   instrumented_bloom_filter()
+   {}
+
+   instrumented_bloom_filter(const bloom_parameters& p)
+   : bloom_filter(p)
+   {}
+
+   inline void insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      bloom_filter::insert(key_begin,length);
+      stats_.on_insert();
+   }
+
+   template<typename T>
+   inline void insert(const T& t)
+   {
+      // Note: T must be a C++ POD type.
+      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline void insert(const std::string& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline void insert(const char* data, const std::size_t& length)
+   {
+      insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline void insert(const bloom_key_view& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const bloom_uint64& key)
+   {
+      bloom_filter::insert(key);
+      stats_.on_insert();
+   }
+
+   inline void insert(const bloom_uint128& key)
+   {
+      bloom_filter::insert(key);
+      stats_.on_insert();
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   using bloom_filter::contains;
+
+   inline bool contains(const bloom_uint64& key) const
+   {
+      return counted_contains_integer(key.value,0);
+   }
+
+   inline bool contains(const bloom_uint128& key) const
+   {
+      return counted_contains_integer(key.low,key.high);
+   }
+
+   inline virtual bool contains(const unsigned char* key_begin, const std::size_t length) const
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         if (!test_bit(bit_index))
+         {
+            stats_.on_query(false,i + 1);
+            return false;
+         }
+      }
+      stats_.on_query(true,schema_->salt.size());
+      return true;
+   }
+
+   inline StatsPolicy& stats() const
+   {
+      return stats_;
+   }
+
+private:
+
+   inline bool counted_contains_integer(const unsigned long long int low, const unsigned long long int high) const
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1 += h2)
+      {
+         compute_index(h1,bit_index);
+         if (!test_bit(bit_index))
+         {
+            stats_.on_query(false,i + 1);
+            return false;
+         }
+      }
+      stats_.on_query(true,schema_->salt.size());
+      return true;
+   }
+
+   mutable StatsPolicy stats_;
+};
+
+class cached_bloom_filter : public bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter with a small 2-way set associative cache of recent
+     query results in front of it, for skewed query streams against
+     large tables where every probe is a cache miss.
+
+     bloom_uint64 and bloom_uint128 keys are cached under their (h1,h2)
+     pair, which fixes all k probes, so a matching entry answers
+     exactly what the table would have. Entries are stamped with the
+     table generation, which every bloom_filter mutator bumps, also
+     when called through a bloom_filter reference: negatives are only
+     used while the table is unchanged, positives until an operation
+     that may clear bits (clear, &=, ^=, assignment). Byte keys are
+     cached under a 64-bit fingerprint and only when positive, so a
+     fingerprint collision can at worst add a false positive. Hence
+     the cache never gives a false negative.
+
+     Queries update the cache, so unlike bloom_filter concurrent
+     queries need external synchronisation.
+   */
+
+public:
+
+   enum { default_cache_bytes = 32 * 1024 };
+
+   struct cache_stats_t
+   {
+      cache_stats_t()
+      : hits(0),
+        misses(0),
+        stale(0),
+        probes(0)
+      {}
+
+      inline double hit_ratio() const
+      {
+         return (hits + misses) ? (1.0 * hits) / (hits + misses) : 0.0;
+      }
+
+      inline double probes_per_query() const
+      {
+         return (hits + misses) ? (1.0 * probes) / (hits + misses) : 0.0;
+      }
+
+      inline double probes_per_miss() const
+      {
+         // The table probes a query costs without the cache.
+         return misses ? (1.0 * probes) / misses : 0.0;
+      }
+
+      unsigned long long int hits;
+      unsigned long long int misses;
+      unsigned long long int stale;   // entries found but outdated by table changes, counted as misses
+      unsigned long long int probes;  // table probes made by misses
+   };
+
+   cached_bloom_filter()
+   : set_mask_(0)
+   {}
+
+   cached_bloom_filter(const bloom_parameters& p, const std::size_t cache_bytes = default_cache_bytes)
+   : bloom_filter(p),
+     set_mask_(0)
+   {
+      set_cache_size(cache_bytes);
+   }
+
+   inline void set_cache_size(const std::size_t cache_bytes)
+   {
+      // Rounded down to a power of two number of sets, 0 disables the cache.
+      std::size_t sets = 0;
+
+      for (std::size_t s = 1; (s * sizeof(cache_set)) <= cache_bytes; s <<= 1)
+      {
+         sets = s;
+      }
+
+      cache_.assign(sets,cache_set());
+      set_mask_ = sets ? (sets - 1) : 0;
+   }
+
+   inline std::size_t cache_size() const
+   {
+      return cache_.size() * sizeof(cache_set);
+   }
+
+   inline void flush_cache()
+   {
+      std::fill(cache_.begin(),cache_.end(),cache_set());
+   }
+
+   inline const cache_stats_t& cache_stats() const
+   {
+      return stats_;
+   }
+
+   inline void reset_cache_stats()
+   {
+      stats_ = cache_stats_t();
+   }
+
+   using bloom_filter::contains;
+
+   inline bool contains(const bloom_uint64& key) const
+   {
+      return cached_contains_integer(key.value,0);
+   }
+
+   inline bool contains(const bloom_uint128& key) const
+   {
+      return cached_contains_integer(key.low,key.high);
+   }
+
+   inline virtual bool contains(const unsigned char* key_begin, const std::size_t length) const
+   {
+      if (cache_.empty())
+         return bloom_filter::contains(key_begin,length);
+
+      const unsigned long long int tag = details::hash64(key_begin,length,schema_->random_seed);
+
+      cache_set& set = cache_[static_cast<std::size_t>(tag ^ (tag >> 32)) & set_mask_];
+
+      for (std::size_t w = 0; w < cache_ways; ++w)
+      {
+         if ((set.way[w].tag != tag) || ((e_positive | e_byte_key) != set.way[w].state))
+            continue;
+         else if (current(set.way[w]))
+         {
+            hit(set,w);
+            return true;
+         }
+         else
+            expire(set.way[w]);
+      }
+
+      std::size_t probes = 0;
+      bool result = true;
+
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         ++probes;
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         if (!test_bit(bit_index))
+         {
+            result = false;
+            break;
+         }
+      }
+
+      ++stats_.misses;
+      stats_.probes += probes;
+
+      if (result)
+         fill(set,tag,e_positive | e_byte_key);
+
+      return result;
+   }
+
+private:
+
+   enum { cache_ways = 2 };
+
+   enum cache_state
+   {
+      e_empty      = 0,
+      e_positive   = 1,
+      e_negative   = 2,
+      e_byte_key   = 4
+   };
+
+   struct cache_entry
+   {
+      cache_entry()
+      : tag(0),
+        stamp(0),
+        state(e_empty)
+      {}
+
+      unsigned long long int tag;
+      unsigned int           stamp;
+      unsigned int           state;
+   };
+
+   struct cache_set
+   {
+      // Way 0 holds the most recently used entry.
+      cache_entry way[cache_ways];
+   };
+
+   inline void hit(cache_set& set, const std::size_t w) const
+   {
+      if (w)
+         std::swap(set.way[0],set.way[w]);
+
+      ++stats_.hits;
+   }
+
+   inline void fill(cache_set& set, const unsigned long long int tag, const unsigned int state) const
+   {
+      set.way[1] = set.way[0];
+      set.way[0].tag   = tag;
+      set.way[0].stamp = generation_;
+      set.way[0].state = state;
+   }
+
+   inline bool current(const cache_entry& entry) const
+   {
+      // Negatives need an unchanged table, positives no bit cleared since (wrap safe).
+      if (entry.state & e_negative)
+         return (entry.stamp == generation_);
+      else
+         return ((entry.stamp - removal_generation_) <= (generation_ - removal_generation_));
+   }
+
+   inline void expire(cache_entry& entry) const
+   {
+      ++stats_.stale;
+      entry.state = e_empty;
+   }
+
+   inline bool cached_contains_integer(const unsigned long long int low, const unsigned long long int high) const
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+
+      if (cache_.empty())
+         return contains_hashed(h1,h2);
+
+      const unsigned long long int tag = (static_cast<unsigned long long int>(h2) << 32) | h1;
+
+      cache_set& set = cache_[static_cast<std::size_t>(h1 ^ h2) & set_mask_];
+
+      for (std::size_t w = 0; w < cache_ways; ++w)
+      {
+         const cache_entry& entry = set.way[w];
+
+         if ((entry.tag != tag) || (entry.state & e_byte_key) || (e_empty == entry.state))
+            continue;
+         else if (current(entry))
+         {
+            // hit() moves the entry to way 0, so read it first.
+            const bool result = (e_positive == entry.state);
+            hit(set,w);
+            return result;
+         }
+         else
+            expire(set.way[w]);
+      }
+
+      std::size_t probes = 0;
+      bool result = true;
+
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1 += h2)
+      {
+         ++probes;
+         compute_index(h1,bit_index);
+         if (!test_bit(bit_index))
+         {
+            result = false;
+            break;
+         }
+      }
+
+      ++stats_.misses;
+      stats_.probes += probes;
+
+      fill(set,tag,result ? e_positive : e_negative);
+
+      return result;
+   }
+
+   mutable std::vector<cache_set> cache_;
+   std::size_t                    set_mask_;
+   mutable cache_stats_t          stats_;
+};
+
+class bloom_key_pipeline
+{
+   /*
+     Note:
+     Looks up several normalised variants of one key in a single call,
+     e.g. the key as given, case folded and reversed. The variants are
+     registered once, each as a combination of the built-in transforms
+     or as a custom function, and contains() returns a mask with bit v
+     set when variant v is possibly in the filter.
+
+     The built-in transforms share one scan of the key, producing the
+     case folded copy and the positions of the '.' separators, while
+     the trimmed bounds are found from either end. A variant needing
+     no reversal is a view into the key or the folded copy, so it is
+     not copied at all. Variants that come out identical are looked up
+     once, and the rest are handed to the filter's contains_mask() so
+     all of their probes are in flight together.
+
+     The scratch buffers are reused between calls, so an instance must
+     not be shared between threads.
+   */
+
+public:
+
+   enum transform_type
+   {
+      e_identity       = 0,
+      e_case_fold      = 1, // ASCII letters to lower case
+      e_trim           = 2, // drop leading and trailing white space
+      e_reverse_domain = 4, // reverse the order of '.' separated labels
+      e_reverse        = 8  // reverse the bytes, applied last
+   };
+
+   enum { max_variants = bloom_filter::max_mask_keys };
+
+   // Writes the transformed key to out, which has room for length
+   // bytes, and returns the transformed length.
+   typedef std::size_t (*custom_transform)(const char* key, const std::size_t length, char* out);
+
+   bloom_key_pipeline()
+   : transforms_used_(0)
+   {}
+
+   inline bool add_variant(const unsigned int transforms)
+   {
+      if (variants_.size() >= max_variants)
+         return false;
+
+      variants_.push_back(variant(transforms,0));
+      views_.push_back(bloom_key_view());
+      transforms_used_ |= transforms;
+
+      return true;
+   }
+
+   inline bool add_variant(const custom_transform transform)
+   {
+      if ((variants_.size() >= max_variants) || (0 == transform))
+         return false;
+
+      variants_.push_back(variant(e_identity,transform));
+      views_.push_back(bloom_key_view());
+
+      return true;
+   }
+
+   inline std::size_t variant_count() const
+   {
+      return variants_.size();
+   }
+
+   inline void apply(const char* key, const std::size_t length)
+   {
+      /*
+        Note:
+        Computes every variant of the key, available from variant(i)
+        until the next call. Variants may point into the key itself.
+      */
+      const std::size_t scratch_size = (variants_.size() + 1) * length;
+
+      if (scratch_.size() < scratch_size)
+         scratch_.resize(scratch_size);
+
+      char* folded = scratch_.empty() ? 0 : &scratch_[0];
+
+      std::size_t trim_begin = 0;
+      std::size_t trim_end   = length;
+
+      if (transforms_used_ & e_trim)
+      {
+         while ((trim_begin < trim_end) && is_space(key[trim_begin  ])) ++trim_begin;
+         while ((trim_end > trim_begin) && is_space(key[trim_end - 1])) --trim_end;
+      }
+
+      separators_.clear();
+
+      if (transforms_used_ & (e_case_fold | e_reverse_domain))
+      {
+         const bool fold   = (0 != (transforms_used_ & e_case_fold     ));
+         const bool domain = (0 != (transforms_used_ & e_reverse_domain));
+
+         for (std::size_t i = 0; i < length; ++i)
+         {
+            const char c = key[i];
+
+            if (fold)
+               folded[i] = ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c + ('a' - 'A')) : c;
+
+            if (domain && ('.' == c))
+               separators_.push_back(i);
+         }
+      }
+
+      for (std::size_t v = 0; v < variants_.size(); ++v)
+      {
+         const variant& var = variants_[v];
+         char* out = folded + (v + 1) * length;
+
+         if (var.custom)
+         {
+            views_[v] = bloom_key_view(out,var.custom(key,length,out));
+            continue;
+         }
+
+         const char* source = (var.transforms & e_case_fold) ? folded : key;
+         std::size_t begin  = (var.transforms & e_trim) ? trim_begin : 0;
+         std::size_t end    = (var.transforms & e_trim) ? trim_end   : length;
+
+         if (var.transforms & e_reverse_domain)
+         {
+            end    = reverse_labels(source,begin,end,out);
+            source = out;
+            begin  = 0;
+         }
+
+         if (var.transforms & e_reverse)
+         {
+            if (source == out)
+               std::reverse(out,out + end);
+            else
+               std::reverse_copy(source + begin,source + end,out);
+
+            source = out;
+            end   -= begin;
+            begin  = 0;
+         }
+
+         views_[v] = bloom_key_view(source + begin,end - begin);
+      }
+   }
+
+   inline const bloom_key_view& variant_key(const std::size_t i) const
+   {
+      return views_[i];
+   }
+
+   template<typename Filter>
+   inline unsigned int contains(const Filter& filter, const char* key, const std::size_t length)
+   {
+      apply(key,length);
+
+      // Identical variants share one lookup.
+      bloom_key_view unique[max_variants];
+      unsigned char  alias [max_variants];
+      std::size_t    unique_count = 0;
+
+      for (std::size_t v = 0; v < views_.size(); ++v)
+      {
+         const bloom_key_view& view = views_[v];
+
+         std::size_t u = 0;
+
+         while (
+                 (u < unique_count) &&
+                 (
+                   (unique[u].length != view.length) ||
+                   (view.length && (unique[u].data != view.data) && (0 != std::memcmp(unique[u].data,view.data,view.length)))
+                 )
+               )
+         {
+            ++u;
+         }
+
+         if (u == unique_count)
+            unique[unique_count++] = view;
+
+         alias[v] = static_cast<unsigned char>(u);
+      }
+
+      const unsigned int found = filter.contains_mask(unique,unique_count);
+
+      unsigned int result = 0;
+
+      for (std::size_t v = 0; v < views_.size(); ++v)
+      {
+         if (found & (1U << alias[v]))
+            result |= (1U << v);
+      }
+
+      return result;
+   }
+
+   template<typename Filter>
+   inline unsigned int contains(const Filter& filter, const std::string& key)
+   {
+      return contains(filter,key.data(),key.size());
+   }
+
+   template<typename Filter>
+   inline unsigned int contains(const Filter& filter, const bloom_key_view& key)
+   {
+      return contains(filter,key.data,key.length);
+   }
+
+private:
+
+   struct variant
+   {
+      variant(const unsigned int t, const custom_transform c)
+      : transforms(t),
+        custom(c)
+      {}
+
+      unsigned int     transforms;
+      custom_transform custom;
+   };
+
+   static inline bool is_space(const char c)
+   {
+      return (' '  == c) || ('\t' == c) || ('\n' == c) ||
+             ('\r' == c) || ('\f' == c) || ('\v' == c) ;
+   }
+
+   inline std::size_t reverse_labels(const char* source, const std::size_t begin, const std::size_t end, char* out) const
+   {
+      // Writes the '.' separated labels of [begin,end) to out in
+      // reverse order, e.g. www.example.com -> com.example.www
+      std::size_t length    = 0;
+      std::size_t label_end = end;
+
+      for (std::size_t s = separators_.size(); s-- > 0; )
+      {
+         const std::size_t separator = separators_[s];
+
+         if (separator >= end)
+            continue;
+         else if (separator < begin)
+            break;
+
+         std::copy(source + separator + 1,source + label_end,out + length);
+         length += label_end - separator - 1;
+         out[length++] = '.';
+         label_end = separator;
+      }
+
+      std::copy(source + begin,source + label_end,out + length);
+
+      return length + (label_end - begin);
+   }
+
+   std::vector<variant>        variants_;
+   std::vector<bloom_key_view> views_;
+   std::vector<char>           scratch_;
+   std::vector<std::size_t>    separators_;
+   unsigned int                transforms_used_;
+};
+
+#if defined(__linux__) && defined(BLOOM_FILTER_PERF_EVENTS)
+
+class bloom_perf_counters
+{
+   /*
+     Note:
+     Thin wrapper around Linux perf_event_open, counting CPU cycles,
+     instructions and last level cache misses of the calling thread
+     while enabled. Wrap a batch of filter operations in start/stop and
+     divide by the operation count to attribute the cost per query;
+     reading the counters costs a system call, so per operation
+     sampling is not advisable. Requires a perf_event_paranoid setting
+     that permits user space measurement.
+   */
+
+public:
+
+   enum event_t { e_cycles = 0, e_instructions = 1, e_llc_misses = 2, e_event_count = 3 };
+
+   bloom_perf_counters()
+   {
+      static const unsigned long long int configs[e_event_count] =
+                                             {
+                                               PERF_COUNT_HW_CPU_CYCLES,
+                                               PERF_COUNT_HW_INSTRUCTIONS,
+                                               PERF_COUNT_HW_CACHE_MISSES
+                                             };
+
+      for (std::size_t i = 0; i < e_event_count; ++i)
+      {
+         perf_event_attr attr;
+         std::memset(&attr,0,sizeof(attr));
+         attr.type           = PERF_TYPE_HARDWARE;
+         attr.size           = sizeof(attr);
+         attr.config         = configs[i];
+         attr.disabled       = 1;
+         attr.exclude_kernel = 1;
+         attr.exclude_hv     = 1;
+
+         fd_[i]    = static_cast<int>(::syscall(__NR_perf_event_open,&attr,0,-1,-1,0));
+         total_[i] = 0;
+      }
+   }
+
+  ~bloom_perf_counters()
+   {
+      for (std::size_t i = 0; i < e_event_count; ++i)
+      {
+         if (fd_[i] >= 0)
+            ::close(fd_[i]);
       }
-      if (remaining_length)
+   }
+
+   inline bool operator!() const
+   {
+      return (fd_[e_cycles] < 0);
+   }
+
+   inline void start()
+   {
+      for (std::size_t i = 0; i < e_event_count; ++i)
       {
-         if (remaining_length >= 4)
+         if (fd_[i] >= 0)
          {
-            const unsigned int& i = *(reinterpret_cast<const unsigned int*>(itr));
-            if (loop & 0x01)
-               hash ^=    (hash <<  7) ^  i * (hash >> 3);
-            else
-               hash ^= (~((hash << 11) + (i ^ (hash >> 5))));
-            ++loop;
-            remaining_length -= 4;
-            itr += sizeof(unsigned int);
+            ::ioctl(fd_[i],PERF_EVENT_IOC_RESET,0);
+            ::ioctl(fd_[i],PERF_EVENT_IOC_ENABLE,0);
          }
-         if (remaining_length >= 2)
+      }
+   }
+
+   inline void stop()
+   {
+      for (std::size_t i = 0; i < e_event_count; ++i)
+      {
+         if (fd_[i] >= 0)
          {
-            const unsigned short& i = *(reinterpret_cast<const unsigned short*>(itr));
-            if (loop & 0x01)
-               hash ^=    (hash <<  7) ^  i * (hash >> 3);
-            else
-               hash ^= (~((hash << 11) + (i ^ (hash >> 5))));
-            ++loop;
-            remaining_length -= 2;
-            itr += sizeof(unsigned short);
+            ::ioctl(fd_[i],PERF_EVENT_IOC_DISABLE,0);
+
+            unsigned long long int value = 0;
+
+            if (static_cast<ssize_t>(sizeof(value)) == ::read(fd_[i],&value,sizeof(value)))
+            {
+               total_[i] += value;
+            }
          }
-         if (remaining_length)
+      }
+   }
+
+   inline unsigned long long int total(const event_t event) const
+   {
+      return total_[event];
+   }
+
+   inline double per_operation(const event_t event, const unsigned long long int operations) const
+   {
+      return operations ? (1.0 * total_[event]) / operations : 0.0;
+   }
+
+   inline void reset()
+   {
+      std::fill_n(total_,static_cast<std::size_t>(e_event_count),0ULL);
+   }
+
+private:
+
+   bloom_perf_counters(const bloom_perf_counters&);
+   bloom_perf_counters& operator=(const bloom_perf_counters&);
+
+   int                    fd_[e_event_count];
+   unsigned long long int total_[e_event_count];
+};
+
+#endif
+
+class key_file_reader
+{
+   /*
+     Note:
+     Streams newline delimited keys from a file in large chunks. Each
+     key is handed to the caller as a (pointer,length) view into the
+     read buffer, so no per-key allocation or copy takes place. Lines
+     are split with memchr, which the C library implements with SIMD
+     on most platforms. As with std::getline the newline is not part
+     of the key, and a trailing line without a newline is still a key.
+   */
+
+public:
+
+   explicit key_file_reader(const std::string& file_name, const std::size_t buffer_size = 1 << 20)
+   : file_(std::fopen(file_name.c_str(),"rb")),
+     buffer_((buffer_size > 0) ? buffer_size : 1)
+   {
+      if (file_)
+      {
+         std::setvbuf(file_,0,_IONBF,0);
+      }
+   }
+
+   ~key_file_reader()
+   {
+      if (file_)
+      {
+         std::fclose(file_);
+      }
+   }
+
+   inline bool operator!() const
+   {
+      return (0 == file_);
+   }
+
+   template<typename KeyHandler>
+   inline bool for_each_key(KeyHandler& handler)
+   {
+      /*
+        Note:
+        handler is invoked as handler(const char* key, std::size_t length).
+        The view is only valid for the duration of the call.
+      */
+      key_forwarder<KeyHandler> forwarder(handler);
+      return scan(forwarder);
+   }
+
+   template<typename BatchHandler>
+   inline bool for_each_batch(BatchHandler& handler, const std::size_t batch_size = 1024)
+   {
+      /*
+        Note:
+        handler is invoked as handler(const bloom_key_view* begin,
+        const bloom_key_view* end) with up to batch_size keys at a time.
+        The views point into the read buffer and are only valid for the
+        duration of the call.
+      */
+      batch_collector<BatchHandler> collector(handler,(batch_size > 0) ? batch_size : 1);
+      return scan(collector);
+   }
+
+private:
+
+   key_file_reader(const key_file_reader&);
+   key_file_reader& operator=(const key_file_reader&);
+
+   template<typename KeyHandler>
+   class key_forwarder
+   {
+   public:
+
+      explicit key_forwarder(KeyHandler& handler)
+      : handler_(handler)
+      {}
+
+      inline void operator()(const char* key, const std::size_t length)
+      {
+         handler_(key,length);
+      }
+
+      inline void flush()
+      {}
+
+   private:
+
+      KeyHandler& handler_;
+   };
+
+   template<typename BatchHandler>
+   class batch_collector
+   {
+   public:
+
+      batch_collector(BatchHandler& handler, const std::size_t batch_size)
+      : handler_(handler),
+        batch_size_(batch_size)
+      {
+         views_.reserve(batch_size);
+      }
+
+      inline void operator()(const char* key, const std::size_t length)
+      {
+         views_.push_back(bloom_key_view(key,length));
+
+         if (views_.size() >= batch_size_)
          {
-            hash += ((*itr) ^ (hash * 0xA5A5A5A5)) + loop;
+            flush();
+         }
+      }
+
+      inline void flush()
+      {
+         if (!views_.empty())
+         {
+            handler_(&views_[0],&views_[0] + views_.size());
+            views_.clear();
+         }
+      }
+
+   private:
+
+      BatchHandler& handler_;
+      const std::size_t batch_size_;
+      std::vector<bloom_key_view> views_;
+   };
+
+   template<typename Sink>
+   inline bool scan(Sink& sink)
+   {
+      /*
+        Note:
+        The sink is flushed before the read buffer is modified, so any
+        views it holds remain valid until then.
+      */
+      if (!file_)
+         return false;
+
+      std::size_t carry = 0;
+
+      for ( ; ; )
+      {
+         if (carry == buffer_.size())
+         {
+            buffer_.resize(buffer_.size() * 2);
+         }
+
+         const std::size_t read_count = std::fread(&buffer_[carry],1,buffer_.size() - carry,file_);
+         const std::size_t available  = carry + read_count;
+
+         if (0 == read_count)
+         {
+            if (carry)
+            {
+               sink(static_cast<const char*>(&buffer_[0]),carry);
+            }
+
+            sink.flush();
+
+            return (0 == std::ferror(file_));
+         }
+
+         const char* itr = &buffer_[0];
+         const char* end = itr + available;
+
+         while (itr != end)
+         {
+            const char* newline = static_cast<const char*>(std::memchr(itr,'\n',static_cast<std::size_t>(end - itr)));
+
+            if (0 == newline)
+               break;
+
+            sink(itr,static_cast<std::size_t>(newline - itr));
+            itr = newline + 1;
+         }
+
+         sink.flush();
+
+         carry = static_cast<std::size_t>(end - itr);
+
+         if (carry && (itr != &buffer_[0]))
+         {
+            std::memmove(&buffer_[0],itr,carry);
          }
       }
-      return hash;
    }
 
-   std::vector<bloom_type> salt_;
-   unsigned char*          bit_table_;
-   unsigned int            salt_count_;
-   unsigned long long int  table_size_;
-   unsigned long long int  raw_table_size_;
-   unsigned long long int  projected_element_count_;
-   unsigned int            inserted_element_count_;
-   unsigned long long int  random_seed_;
-   double                  desired_false_positive_probability_;
+   std::FILE*        file_;
+   std::vector<char> buffer_;
 };
 
-inline bloom_filter operator & (const bloom_filter& a, const bloom_filter& b)
+class key_file_inserter
 {
-   bloom_filter result = a;
-   result &= b;
-   return result;
-}
+   /*
+     Note:
+     Adaptor that feeds the keys produced by key_file_reader into a
+     filter, either one at a time or a batch at a time.
+   */
 
-inline bloom_filter operator | (const bloom_filter& a, const bloom_filter& b)
-{
-   bloom_filter result = a;
-   result |= b;
-   return result;
-}
+public:
 
-inline bloom_filter operator ^ (const bloom_filter& a, const bloom_filter& b)
+   explicit key_file_inserter(bloom_filter& filter)
+   : filter_(filter)
+   {}
+
+   inline void operator()(const char* key, const std::size_t length)
+   {
+      filter_.insert(key,length);
+   }
+
+   inline void operator()(const bloom_key_view* begin, const bloom_key_view* end)
+   {
+      filter_.insert(begin,end);
+   }
+
+private:
+
+   bloom_filter& filter_;
+};
+
+inline bool insert_key_file(bloom_filter& filter, const std::string& file_name, const std::size_t batch_size = 0)
 {
-   bloom_filter result = a;
-   result ^= b;
-   return result;
+   /*
+     Note:
+     Inserts every line of file_name into filter. A non-zero batch_size
+     routes the keys through the batch stage.
+   */
+   key_file_reader reader(file_name);
+   key_file_inserter inserter(filter);
+
+   if (!reader)
+      return false;
+   else if (batch_size)
+      return reader.for_each_batch(inserter,batch_size);
+   else
+      return reader.for_each_key(inserter);
 }
 
-class compressible_bloom_filter : public bloom_filter
+#if defined(__GNUC__)
+
+class bloom_filter_holder
 {
+   /*
+     Note:
+     Publishes an immutable filter to concurrent readers through an
+     atomic pointer. Readers announce the epoch they entered in a
+     per-reader slot and never block or take a lock. A replaced filter
+     is retired and only deleted once every reader slot is either idle
+     or has entered an epoch later than the one in which the filter was
+     retired (epoch based reclamation).
+
+     Each reader thread must use its own reader_id in [0,max_readers),
+     and guards for the same reader_id must not be nested. Calls to
+     publish and reclaim must be serialised by the caller.
+   */
+
 public:
 
-   compressible_bloom_filter(const bloom_parameters& p)
-   : bloom_filter(p)
-   {
-      size_list.push_back(table_size_);
-   }
+   explicit bloom_filter_holder(bloom_filter* filter = 0, const std::size_t max_readers = 64)
+   : current_(filter),
+     global_epoch_(1),
+     reader_epoch_(max_readers)
+   {}
 
-   inline unsigned long long int size() const
+   ~bloom_filter_holder()
    {
-      return size_list.back();
+      delete current_;
+      for (std::size_t i = 0; i < retired_.size(); ++i)
+      {
+         delete retired_[i].filter;
+      }
    }
 
-   inline bool compress(const double& percentage)
+   class read_guard
    {
-      if ((0.0 >= percentage) || (percentage >= 100.0))
+   public:
+
+      read_guard(const bloom_filter_holder& holder, const std::size_t reader_id)
+      : slot_(holder.reader_epoch_[reader_id].epoch)
       {
-         return false;
+         __atomic_store_n(&slot_,__atomic_load_n(&holder.global_epoch_,__ATOMIC_SEQ_CST),__ATOMIC_SEQ_CST);
+         filter_ = __atomic_load_n(&holder.current_,__ATOMIC_SEQ_CST);
       }
 
-      unsigned long long int original_table_size = size_list.back();
-      unsigned long long int new_table_size = static_cast<unsigned long long int>((size_list.back() * (1.0 - (percentage / 100.0))));
-      new_table_size -= (((new_table_size % bits_per_char) != 0) ? (new_table_size % bits_per_char) : 0);
+      ~read_guard()
+      {
+         __atomic_store_n(&slot_,0ULL,__ATOMIC_RELEASE);
+      }
 
-      if ((bits_per_char > new_table_size) || (new_table_size >= original_table_size))
+      inline const bloom_filter* get() const
       {
-         return false;
+         return filter_;
       }
 
-      desired_false_positive_probability_ = effective_fpp();
-      cell_type* tmp = new cell_type[static_cast<std::size_t>(new_table_size / bits_per_char)];
-      std::copy(bit_table_, bit_table_ + (new_table_size / bits_per_char), tmp);
-      cell_type* itr = bit_table_ + (new_table_size / bits_per_char);
-      cell_type* end = bit_table_ + (original_table_size / bits_per_char);
-      cell_type* itr_tmp = tmp;
+      inline const bloom_filter* operator->() const
+      {
+         return filter_;
+      }
 
-      while (end != itr)
+      inline const bloom_filter& operator*() const
       {
-         *(itr_tmp++) |= (*itr++);
+         return *filter_;
       }
 
-      delete[] bit_table_;
-      bit_table_ = tmp;
-      size_list.push_back(new_table_size);
+   private:
 
-      return true;
+      read_guard(const read_guard&);
+      read_guard& operator=(const read_guard&);
+
+      unsigned long long int& slot_;
+      const bloom_filter* filter_;
+   };
+
+   template<typename T>
+   inline bool contains(const std::size_t reader_id, const T& t) const
+   {
+      read_guard guard(*this,reader_id);
+      return (0 != guard.get()) && guard->contains(t);
    }
 
-private:
+   inline void publish(bloom_filter* filter)
+   {
+      /*
+        Note:
+        Takes ownership of filter. The filter must be fully built
+        before being published and must not be modified afterwards.
+      */
+      bloom_filter* previous = __atomic_exchange_n(&current_,filter,__ATOMIC_SEQ_CST);
 
-   inline void compute_indices(const bloom_type& hash, std::size_t& bit_index, std::size_t& bit) const
+      if (previous)
+      {
+         retired_filter r;
+         r.filter = previous;
+         r.epoch  = __atomic_add_fetch(&global_epoch_,1ULL,__ATOMIC_SEQ_CST);
+         retired_.push_back(r);
+      }
+
+      reclaim();
+   }
+
+   inline std::size_t reclaim()
    {
-      bit_index = hash;
-      for (std::size_t i = 0; i < size_list.size(); ++i)
+      /*
+        Note:
+        Deletes every retired filter that can no longer be observed by
+        a reader, returning the number of filters still pending.
+      */
+      unsigned long long int oldest_active = std::numeric_limits<unsigned long long int>::max();
+
+      for (std::size_t i = 0; i < reader_epoch_.size(); ++i)
       {
-         bit_index %= size_list[i];
+         const unsigned long long int epoch = __atomic_load_n(&reader_epoch_[i].epoch,__ATOMIC_SEQ_CST);
+         if ((0 != epoch) && (epoch < oldest_active))
+            oldest_active = epoch;
       }
-      bit = bit_index % bits_per_char;
+
+      std::vector<retired_filter> pending;
+
+      for (std::size_t i = 0; i < retired_.size(); ++i)
+      {
+         if (retired_[i].epoch <= oldest_active)
+            delete retired_[i].filter;
+         else
+            pending.push_back(retired_[i]);
+      }
+
+      retired_.swap(pending);
+
+      return retired_.size();
    }
 
-   std::vector<unsigned long long int> size_list;
+   inline std::size_t max_readers() const
+   {
+      return reader_epoch_.size();
+   }
+
+private:
+
+   bloom_filter_holder(const bloom_filter_holder&);
+   bloom_filter_holder& operator=(const bloom_filter_holder&);
+
+   struct reader_slot
+   {
+      reader_slot()
+      : epoch(0)
+      {}
+
+      unsigned long long int epoch;
+      unsigned char padding[64 - sizeof(unsigned long long int)];
+   };
+
+   struct retired_filter
+   {
+      bloom_filter*          filter;
+      unsigned long long int epoch;
+   };
+
+   bloom_filter*                       current_;
+   unsigned long long int              global_epoch_;
+   mutable std::vector<reader_slot>    reader_epoch_;
+   std::vector<retired_filter>         retired_;
 };
 
 #endif
 
+#endif
+
 
 /*
   Note 1:
-  If it can be guaranteed that bits_per_char will be of the form 2^n then
-  the following optimization can be used:
+  The bloom_filter table is held as 64-bit words, so that a probe is a
+  shift and a mask rather than a bit_mask lookup:
 
-  hash_table[bit_index >> n] |= bit_mask[bit_index & (bits_per_char - 1)];
+  hash_table[bit_index >> 6] |= 1ULL << (bit_index & 63);
 
   Note 2:
   For performance reasons where possible when allocating memory it should
@@ -0,0 +1,2205 @@
+/*
+ **************************************************************************
+ *                                                                        *
+ *                           Open Bloom Filter                            *
+ *                                                                        *
+ * Description: Bloom Filter Benchmark Suite                              *
+ * Author: Arash Partow - 2000                                            *
+ * URL: http://www.partow.net                                             *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html        *
+ *                                                                        *
+ * Copyright notice:                                                      *
+ * Free use of the Bloom Filter Library is permitted under the guidelines *
+ * and in accordance with the most current version of the Common Public   *
+ * License.                                                               *
+ * http://www.opensource.org/licenses/cpl1.0.php                          *
+ *                                                                        *
+ **************************************************************************
+*/
+
+
+
+/*
+   Description: This program measures insert and query throughput, per query
+                latency percentiles (p50/p99/p999) and the observed false
+                positive probability of the filter variants in the library.
+                The following sweeps are carried out:
+
+                  table  : table sizes from L1 resident up to --max-table MB
+                  hashes : number of hash functions
+                  keylen : key length in bytes
+                  threads: number of concurrent query threads
+                  dataset: the bundled word-list*.txt and random-list.txt
+                  hitratio: query strategies at 1%, 50% and 99% hit ratios
+                  static : xor8/xor16 filters against bloom_filter at equal FPP
+                  interleave: contains_interleaved group sizes at --max-table
+                  range  : range_bloom_filter against chained point lookups
+                  intkey : 64-bit integer keys, byte path against integer path
+                  checkpoint: insert rate while checkpoints run in the background
+                  paged  : disk-resident paged_bloom_filter, single against batched
+                  buffered: bulk load rate of buffered_bloom_filter at --max-table
+                  arena  : create/insert/query/destroy cycles of small filters
+                  sketch : count_min_sketch update/estimate and counted_bloom_filter
+                  cache  : cached_bloom_filter on a skewed query stream at --max-table
+                  variants: bloom_key_pipeline against per variant lookups at --max-table
+                  swap   : query latency while bloom_filter_holder swaps
+
+                Results are written to stdout as CSV (default) or JSON, one
+                record per measured configuration, so that they can be kept
+                and compared between releases.
+
+   Usage: bloom_filter_benchmark [--format=csv|json] [--max-table=MB]
+                                 [--threads=N] [--samples=N] [--quick]
+                                 [--only=sweep]
+*/
+
+
+#include <iostream>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+#include "bloom_filter_checkpoint.hpp"
+#include "bloom_filter_paged.hpp"
+
+struct benchmark_options
+{
+   benchmark_options()
+   : json(false),
+     max_table_bytes(256ULL * 1024 * 1024),
+     max_threads(4),
+     latency_samples(200000),
+     quick(false)
+   {}
+
+   inline bool selected(const std::string& sweep) const
+   {
+      return only.empty() || (only == sweep);
+   }
+
+   bool json;
+   unsigned long long int max_table_bytes;
+   unsigned int max_threads;
+   std::size_t latency_samples;
+   bool quick;
+   std::string only;
+};
+
+struct benchmark_result
+{
+   benchmark_result()
+   : table_bytes(0),
+     hashes(0),
+     key_length(0),
+     threads(1),
+     keys(0),
+     insert_mops(0.0),
+     query_mops(0.0),
+     p50_ns(0.0),
+     p99_ns(0.0),
+     p999_ns(0.0),
+     observed_fpp(0.0),
+     expected_fpp(0.0)
+   {}
+
+   std::string benchmark;
+   std::string variant;
+   std::string dataset;
+   unsigned long long int table_bytes;
+   unsigned int hashes;
+   std::size_t key_length;
+   unsigned int threads;
+   unsigned long long int keys;
+   double insert_mops;
+   double query_mops;
+   double p50_ns;
+   double p99_ns;
+   double p999_ns;
+   double observed_fpp;
+   double expected_fpp;
+};
+
+class result_writer
+{
+public:
+
+   explicit result_writer(const bool json)
+   : json_(json),
+     count_(0)
+   {
+      if (json_)
+         printf("[\n");
+      else
+         printf("benchmark,variant,dataset,table_bytes,hashes,key_length,threads,keys,"
+                "insert_mops,query_mops,p50_ns,p99_ns,p999_ns,observed_fpp,expected_fpp\n");
+   }
+
+  ~result_writer()
+   {
+      if (json_)
+         printf("\n]\n");
+   }
+
+   void write(const benchmark_result& r)
+   {
+      if (json_)
+      {
+         printf("%s   {\"benchmark\":\"%s\",\"variant\":\"%s\",\"dataset\":\"%s\",\"table_bytes\":%llu,"
+                "\"hashes\":%u,\"key_length\":%llu,\"threads\":%u,\"keys\":%llu,\"insert_mops\":%.4f,"
+                "\"query_mops\":%.4f,\"p50_ns\":%.1f,\"p99_ns\":%.1f,\"p999_ns\":%.1f,"
+                "\"observed_fpp\":%.8f,\"expected_fpp\":%.8f}",
+                (count_ ? ",\n" : ""),
+                r.benchmark.c_str(), r.variant.c_str(), r.dataset.c_str(), r.table_bytes,
+                r.hashes, static_cast<unsigned long long>(r.key_length), r.threads, r.keys, r.insert_mops,
+                r.query_mops, r.p50_ns, r.p99_ns, r.p999_ns,
+                r.observed_fpp, r.expected_fpp);
+      }
+      else
+      {
+         printf("%s,%s,%s,%llu,%u,%llu,%u,%llu,%.4f,%.4f,%.1f,%.1f,%.1f,%.8f,%.8f\n",
+                r.benchmark.c_str(), r.variant.c_str(), r.dataset.c_str(), r.table_bytes,
+                r.hashes, static_cast<unsigned long long>(r.key_length), r.threads, r.keys, r.insert_mops,
+                r.query_mops, r.p50_ns, r.p99_ns, r.p999_ns,
+                r.observed_fpp, r.expected_fpp);
+      }
+
+      fflush(stdout);
+      ++count_;
+   }
+
+private:
+
+   bool json_;
+   std::size_t count_;
+};
+
+class generated_keys
+{
+   /*
+     Note:
+     Keys are synthesised on demand from their index, so that tables of
+     several GB can be filled without holding the key set in memory.
+     Outliers are drawn from a disjoint index range.
+   */
+
+public:
+
+   generated_keys(const unsigned long long int count, const std::size_t key_length)
+   : count_(count),
+     key_length_(key_length)
+   {}
+
+   inline unsigned long long int size() const
+   {
+      return count_;
+   }
+
+   inline std::size_t max_key_length() const
+   {
+      return key_length_;
+   }
+
+   inline bloom_key_view key(const unsigned long long int i, char* scratch) const
+   {
+      return make(i,scratch);
+   }
+
+   inline bloom_key_view outlier(const unsigned long long int i, char* scratch) const
+   {
+      return make(i | 0x8000000000000000ULL,scratch);
+   }
+
+private:
+
+   inline bloom_key_view make(unsigned long long int id, char* scratch) const
+   {
+      for (std::size_t i = 0; i < key_length_; i += sizeof(unsigned long long int))
+      {
+         id += 0x9E3779B97F4A7C15ULL;
+         unsigned long long int z = id;
+         z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+         z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+         z = z ^ (z >> 31);
+         const std::size_t n = std::min(sizeof(z),key_length_ - i);
+         std::copy(reinterpret_cast<const char*>(&z),reinterpret_cast<const char*>(&z) + n,scratch + i);
+      }
+
+      return bloom_key_view(scratch,key_length_);
+   }
+
+   unsigned long long int count_;
+   std::size_t key_length_;
+};
+
+class word_list_keys
+{
+   /*
+     Note:
+     Keys are the lines of one of the bundled word lists. Outliers are
+     the same words with a byte appended that never occurs in a line.
+   */
+
+public:
+
+   bool load(const std::string& file_name)
+   {
+      key_file_reader reader(file_name);
+
+      if (!reader)
+         return false;
+
+      offsets_.push_back(0);
+
+      return reader.for_each_key(*this);
+   }
+
+   inline void operator()(const char* key, const std::size_t length)
+   {
+      arena_.insert(arena_.end(),key,key + length);
+      arena_.push_back('\x01');
+      offsets_.push_back(arena_.size());
+   }
+
+   inline unsigned long long int size() const
+   {
+      return offsets_.empty() ? 0 : (offsets_.size() - 1);
+   }
+
+   inline std::size_t max_key_length() const
+   {
+      std::size_t result = 0;
+
+      for (std::size_t i = 1; i < offsets_.size(); ++i)
+      {
+         result = std::max(result,offsets_[i] - offsets_[i - 1]);
+      }
+
+      return result;
+   }
+
+   inline bloom_key_view key(const unsigned long long int i, char*) const
+   {
+      const std::size_t j = static_cast<std::size_t>(i);
+      return bloom_key_view(&arena_[offsets_[j]],offsets_[j + 1] - offsets_[j] - 1);
+   }
+
+   inline bloom_key_view outlier(const unsigned long long int i, char*) const
+   {
+      const std::size_t j = static_cast<std::size_t>(i);
+      return bloom_key_view(&arena_[offsets_[j]],offsets_[j + 1] - offsets_[j]);
+   }
+
+private:
+
+   std::vector<char> arena_;
+   std::vector<std::size_t> offsets_;
+};
+
+inline double now_ns()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return (1.0e9 * ts.tv_sec) + ts.tv_nsec;
+}
+
+inline double percentile(std::vector<double>& samples, const double p)
+{
+   if (samples.empty())
+      return 0.0;
+
+   std::size_t index = static_cast<std::size_t>(p * (samples.size() - 1));
+   std::nth_element(samples.begin(),samples.begin() + index,samples.end());
+   return samples[index];
+}
+
+bloom_parameters make_parameters(const unsigned long long int table_bytes,
+                                 const unsigned int hashes,
+                                 const unsigned long long int keys);
+
+template<typename Filter, typename KeySource>
+void run_case(const std::string& benchmark,
+              const std::string& variant,
+              const std::string& dataset,
+              const bloom_parameters& parameters,
+              const KeySource& keys,
+              const unsigned int threads,
+              const benchmark_options& options,
+              result_writer& writer);
+
+template<typename KeySource>
+void run_variants(const std::string& benchmark,
+                  const std::string& dataset,
+                  const bloom_parameters& parameters,
+                  const KeySource& keys,
+                  const unsigned int threads,
+                  const benchmark_options& options,
+                  result_writer& writer);
+
+void run_hit_ratio(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_static_filters(const benchmark_options& options, result_writer& writer);
+
+void run_interleaved(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_range(const benchmark_options& options, result_writer& writer);
+
+void run_integer_keys(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_checkpoint(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_paged(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_buffered(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_arena(const benchmark_options& options, result_writer& writer);
+
+void run_sketch(const benchmark_options& options, result_writer& writer);
+
+void run_query_cache(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_key_variants(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+void run_holder_swap(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer);
+
+bool parse_options(int argc, char* argv[], benchmark_options& options);
+
+static volatile unsigned long long int benchmark_sink = 0;
+
+int main(int argc, char* argv[])
+{
+   benchmark_options options;
+
+   if (!parse_options(argc,argv,options))
+   {
+      std::cerr << "Usage: bloom_filter_benchmark [--format=csv|json] [--max-table=MB] "
+                   "[--threads=N] [--samples=N] [--quick] [--only=sweep]" << std::endl;
+      return 1;
+   }
+
+   result_writer writer(options.json);
+
+   static const double bits_per_key = 10.0;
+
+   // Fixed table size used by the sweeps over other dimensions.
+   const unsigned long long int fixed_table_bytes = std::min(options.quick ? 512ULL * 1024 : 4ULL * 1024 * 1024,options.max_table_bytes);
+
+   // Table size sweep: from L1 resident up to the configured maximum.
+   for (unsigned long long int table_bytes = 32 * 1024; options.selected("table") && (table_bytes <= options.max_table_bytes); table_bytes *= 4)
+   {
+      const unsigned long long int keys = static_cast<unsigned long long int>((table_bytes * bits_per_char) / bits_per_key);
+      run_variants("table","generated",make_parameters(table_bytes,7,keys),generated_keys(keys,16),1,options,writer);
+   }
+
+   // Hash function count sweep at a fixed, L2/L3 sized table.
+   if (options.selected("hashes"))
+   {
+      static const unsigned int hash_counts[] = { 1, 2, 4, 7, 10, 16 };
+      const unsigned long long int table_bytes = fixed_table_bytes;
+      const unsigned long long int keys = static_cast<unsigned long long int>((table_bytes * bits_per_char) / bits_per_key);
+
+      for (std::size_t i = 0; i < sizeof(hash_counts) / sizeof(unsigned int); ++i)
+      {
+         run_variants("hashes","generated",make_parameters(table_bytes,hash_counts[i],keys),generated_keys(keys,16),1,options,writer);
+      }
+   }
+
+   // Key length sweep.
+   if (options.selected("keylen"))
+   {
+      static const std::size_t key_lengths[] = { 4, 8, 16, 32, 64, 256 };
+      const unsigned long long int table_bytes = fixed_table_bytes;
+      const unsigned long long int keys = static_cast<unsigned long long int>((table_bytes * bits_per_char) / bits_per_key);
+
+      for (std::size_t i = 0; i < sizeof(key_lengths) / sizeof(std::size_t); ++i)
+      {
+         run_variants("keylen","generated",make_parameters(table_bytes,7,keys),generated_keys(keys,key_lengths[i]),1,options,writer);
+      }
+   }
+
+   // Concurrent query thread sweep at a DRAM resident table.
+   if (options.selected("threads"))
+   {
+      const unsigned long long int table_bytes = std::min(64ULL * 1024 * 1024,options.quick ? fixed_table_bytes : options.max_table_bytes);
+      const unsigned long long int keys = static_cast<unsigned long long int>((table_bytes * bits_per_char) / bits_per_key);
+
+      for (unsigned int threads = 1; threads <= options.max_threads; threads *= 2)
+      {
+         run_case<bloom_filter>("threads","bloom_filter","generated",make_parameters(table_bytes,7,keys),generated_keys(keys,16),threads,options,writer);
+      }
+   }
+
+   // Bundled data sets, sized as in the example programs.
+   if (options.selected("dataset"))
+   {
+      static const std::string data_sets[] =
+                        {
+                          "word-list.txt",
+                          "word-list-large.txt",
+                          "word-list-extra-large.txt",
+                          "random-list.txt"
+                        };
+
+      for (std::size_t i = 0; i < sizeof(data_sets) / sizeof(std::string); ++i)
+      {
+         word_list_keys keys;
+
+         if (!keys.load(data_sets[i]) || (0 == keys.size()))
+         {
+            std::cerr << "Warning: skipping data set '" << data_sets[i] << "'" << std::endl;
+            continue;
+         }
+
+         bloom_parameters parameters;
+         parameters.projected_element_count    = keys.size();
+         parameters.false_positive_probability = 1.0 / keys.size();
+         parameters.compute_optimal_parameters();
+
+         run_variants("dataset",data_sets[i],parameters,keys,1,options,writer);
+      }
+   }
+
+   if (options.selected("hitratio"))
+      run_hit_ratio(fixed_table_bytes,options,writer);
+
+   if (options.selected("static"))
+      run_static_filters(options,writer);
+
+   if (options.selected("interleave"))
+      run_interleaved(options.max_table_bytes,options,writer);
+
+   if (options.selected("range"))
+      run_range(options,writer);
+
+   if (options.selected("intkey"))
+      run_integer_keys(fixed_table_bytes,options,writer);
+
+   if (options.selected("checkpoint"))
+      run_checkpoint(options.max_table_bytes,options,writer);
+
+   if (options.selected("paged"))
+      run_paged(options.max_table_bytes,options,writer);
+
+   if (options.selected("buffered"))
+      run_buffered(options.max_table_bytes,options,writer);
+
+   if (options.selected("arena"))
+      run_arena(options,writer);
+
+   if (options.selected("sketch"))
+      run_sketch(options,writer);
+
+   if (options.selected("cache"))
+      run_query_cache(options.max_table_bytes,options,writer);
+
+   if (options.selected("variants"))
+      run_key_variants(options.max_table_bytes,options,writer);
+
+   if (options.selected("swap"))
+      run_holder_swap(fixed_table_bytes,options,writer);
+
+   return 0;
+}
+
+bloom_parameters make_parameters(const unsigned long long int table_bytes,
+                                 const unsigned int hashes,
+                                 const unsigned long long int keys)
+{
+   bloom_parameters parameters;
+
+   const double m = static_cast<double>(table_bytes * bits_per_char);
+
+   parameters.projected_element_count    = keys;
+   parameters.false_positive_probability = std::pow(1.0 - std::exp(-1.0 * hashes * keys / m), 1.0 * hashes);
+   parameters.minimum_size               = table_bytes * bits_per_char;
+   parameters.maximum_size               = table_bytes * bits_per_char;
+   parameters.minimum_number_of_hashes   = hashes;
+   parameters.maximum_number_of_hashes   = hashes;
+   parameters.compute_optimal_parameters();
+
+   return parameters;
+}
+
+template<typename Filter, typename KeySource>
+struct query_worker
+{
+   const Filter*          filter;
+   const KeySource*       keys;
+   unsigned long long int begin;
+   unsigned long long int end;
+   unsigned long long int positives;
+
+   static void* run(void* arg)
+   {
+      query_worker& w = *static_cast<query_worker*>(arg);
+      std::vector<char> scratch(w.keys->max_key_length() + sizeof(unsigned long long int));
+      unsigned long long int positives = 0;
+
+      for (unsigned long long int i = w.begin; i < w.end; ++i)
+      {
+         if (w.filter->contains(w.keys->key(i,&scratch[0])))     ++positives;
+         if (w.filter->contains(w.keys->outlier(i,&scratch[0]))) ++positives;
+      }
+
+      w.positives = positives;
+
+      return 0;
+   }
+};
+
+template<typename Filter, typename KeySource>
+void run_case(const std::string& benchmark,
+              const std::string& variant,
+              const std::string& dataset,
+              const bloom_parameters& parameters,
+              const KeySource& keys,
+              const unsigned int threads,
+              const benchmark_options& options,
+              result_writer& writer)
+{
+   Filter filter(parameters);
+
+   std::vector<char> scratch(keys.max_key_length() + sizeof(unsigned long long int));
+
+   const unsigned long long int key_count = keys.size();
+
+   benchmark_result result;
+   result.benchmark    = benchmark;
+   result.variant      = variant;
+   result.dataset      = dataset;
+   result.table_bytes  = filter.size() / bits_per_char;
+   result.hashes       = static_cast<unsigned int>(filter.hash_count());
+   result.key_length   = keys.max_key_length();
+   result.threads      = threads;
+   result.keys         = key_count;
+
+   double start = now_ns();
+
+   for (unsigned long long int i = 0; i < key_count; ++i)
+   {
+      filter.insert(keys.key(i,&scratch[0]));
+   }
+
+   result.insert_mops  = (1.0e3 * key_count) / (now_ns() - start);
+   result.expected_fpp = filter.effective_fpp();
+
+   // Query throughput: one inserted key and one outlier per step.
+   std::vector<query_worker<Filter,KeySource> > workers(threads);
+   std::vector<pthread_t> thread_ids(threads);
+
+   for (unsigned int t = 0; t < threads; ++t)
+   {
+      workers[t].filter    = &filter;
+      workers[t].keys      = &keys;
+      workers[t].begin     = (key_count * t) / threads;
+      workers[t].end       = (key_count * (t + 1)) / threads;
+      workers[t].positives = 0;
+   }
+
+   start = now_ns();
+
+   unsigned int started = 1;
+
+   for ( ; started < threads; ++started)
+   {
+      if (0 != pthread_create(&thread_ids[started],0,&query_worker<Filter,KeySource>::run,&workers[started]))
+         break;
+   }
+
+   query_worker<Filter,KeySource>::run(&workers[0]);
+
+   for (unsigned int t = 1; t < started; ++t)
+   {
+      pthread_join(thread_ids[t],0);
+   }
+
+   if (started < threads)
+   {
+      std::cerr << "Warning: skipping " << variant << " with " << threads << " threads, "
+                << "only " << started << " could be started" << std::endl;
+      return;
+   }
+
+   result.query_mops = (2.0e3 * key_count) / (now_ns() - start);
+
+   unsigned long long int positives = 0;
+
+   for (unsigned int t = 0; t < threads; ++t)
+   {
+      positives += workers[t].positives;
+   }
+
+   // Every inserted key is a positive, the remainder are false positives.
+   result.observed_fpp = (1.0 * (positives - key_count)) / key_count;
+
+   // Per query latency over an even mix of inserted keys and outliers.
+   const std::size_t samples = static_cast<std::size_t>(std::min<unsigned long long int>(options.latency_samples,2 * key_count));
+   std::vector<double> latency(samples);
+   unsigned long long int sink = 0;
+
+   for (std::size_t i = 0; i < samples; ++i)
+   {
+      const unsigned long long int j = (i / 2) % key_count;
+      const bloom_key_view key = (i & 1) ? keys.outlier(j,&scratch[0]) : keys.key(j,&scratch[0]);
+
+      const double t0 = now_ns();
+      sink += filter.contains(key) ? 1 : 0;
+      latency[i] = now_ns() - t0;
+   }
+
+   benchmark_sink += sink;
+
+   result.p50_ns  = percentile(latency,0.500);
+   result.p99_ns  = percentile(latency,0.990);
+   result.p999_ns = percentile(latency,0.999);
+
+   writer.write(result);
+}
+
+template<typename KeySource>
+void run_variants(const std::string& benchmark,
+                  const std::string& dataset,
+                  const bloom_parameters& parameters,
+                  const KeySource& keys,
+                  const unsigned int threads,
+                  const benchmark_options& options,
+                  result_writer& writer)
+{
+   run_case<bloom_filter>             (benchmark,"bloom_filter",             dataset,parameters,keys,threads,options,writer);
+   run_case<compressible_bloom_filter>(benchmark,"compressible_bloom_filter",dataset,parameters,keys,threads,options,writer);
+   run_case<instrumented_bloom_filter<null_bloom_stats> >(benchmark,"instrumented_null_stats",dataset,parameters,keys,threads,options,writer);
+   run_case<instrumented_bloom_filter<bloom_stats> >     (benchmark,"instrumented_bloom_stats",dataset,parameters,keys,threads,options,writer);
+   run_case<quotient_filter>                             (benchmark,"quotient_filter",dataset,parameters,keys,threads,options,writer);
+}
+
+void run_hit_ratio(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     Queries a filter with a stream in which each query is an inserted
+     key with the given probability, in an unpredictable order, once
+     per query strategy.
+   */
+   static const double hit_ratios[] = { 0.01, 0.50, 0.99 };
+
+   static const bloom_filter::query_strategy_t strategies[] =
+                                 {
+                                   bloom_filter::e_early_exit,
+                                   bloom_filter::e_branchless,
+                                   bloom_filter::e_adaptive
+                                 };
+
+   static const char* strategy_names[] = { "early_exit", "branchless", "adaptive" };
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+   const generated_keys keys(key_count,16);
+
+   std::vector<char> scratch(keys.max_key_length() + sizeof(unsigned long long int));
+
+   bloom_filter filter(parameters);
+
+   for (unsigned long long int i = 0; i < key_count; ++i)
+   {
+      filter.insert(keys.key(i,&scratch[0]));
+   }
+
+   for (std::size_t r = 0; r < sizeof(hit_ratios) / sizeof(double); ++r)
+   {
+      std::vector<unsigned char> hit(static_cast<std::size_t>(key_count));
+      unsigned long long int state = 0x2545F4914F6CDD1DULL;
+
+      for (std::size_t i = 0; i < hit.size(); ++i)
+      {
+         state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+         hit[i] = ((state >> 11) * (1.0 / 9007199254740992.0)) < hit_ratios[r];
+      }
+
+      char dataset[32];
+      sprintf(dataset,"hit=%.2f",hit_ratios[r]);
+
+      for (std::size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]); ++s)
+      {
+         filter.set_query_strategy(strategies[s]);
+
+         unsigned long long int positives = 0;
+         unsigned long long int expected  = 0;
+
+         const double start = now_ns();
+
+         for (std::size_t i = 0; i < hit.size(); ++i)
+         {
+            const bloom_key_view key = hit[i] ? keys.key(i,&scratch[0]) : keys.outlier(i,&scratch[0]);
+            positives += filter.contains(key) ? 1 : 0;
+            expected  += hit[i];
+         }
+
+         benchmark_result result;
+         result.benchmark    = "hitratio";
+         result.variant      = std::string("bloom_filter_") + strategy_names[s];
+         result.dataset      = dataset;
+         result.table_bytes  = table_bytes;
+         result.hashes       = static_cast<unsigned int>(filter.hash_count());
+         result.key_length   = keys.max_key_length();
+         result.keys         = key_count;
+         result.query_mops   = (1.0e3 * hit.size()) / (now_ns() - start);
+         result.observed_fpp = (1.0 * (positives - expected)) / std::max<unsigned long long int>(1,hit.size() - expected);
+         result.expected_fpp = filter.effective_fpp();
+
+         const std::size_t samples = std::min(options.latency_samples,hit.size());
+         std::vector<double> latency(samples);
+         unsigned long long int sink = 0;
+
+         for (std::size_t i = 0; i < samples; ++i)
+         {
+            const bloom_key_view key = hit[i] ? keys.key(i,&scratch[0]) : keys.outlier(i,&scratch[0]);
+            const double t0 = now_ns();
+            sink += filter.contains(key) ? 1 : 0;
+            latency[i] = now_ns() - t0;
+         }
+
+         benchmark_sink += sink;
+
+         result.p50_ns  = percentile(latency,0.500);
+         result.p99_ns  = percentile(latency,0.990);
+         result.p999_ns = percentile(latency,0.999);
+
+         writer.write(result);
+      }
+   }
+}
+
+template<typename Filter>
+void measure_static_queries(const Filter& filter,
+                            const generated_keys& keys,
+                            const benchmark_options& options,
+                            benchmark_result& result)
+{
+   std::vector<char> scratch(keys.max_key_length() + sizeof(unsigned long long int));
+   unsigned long long int positives = 0;
+
+   const double start = now_ns();
+
+   for (unsigned long long int i = 0; i < keys.size(); ++i)
+   {
+      if (filter.contains(keys.key    (i,&scratch[0]))) ++positives;
+      if (filter.contains(keys.outlier(i,&scratch[0]))) ++positives;
+   }
+
+   result.query_mops   = (2.0e3 * keys.size()) / (now_ns() - start);
+   result.observed_fpp = (1.0 * (positives - keys.size())) / keys.size();
+
+   const std::size_t samples = static_cast<std::size_t>(std::min<unsigned long long int>(options.latency_samples,2 * keys.size()));
+   std::vector<double> latency(samples);
+   unsigned long long int sink = 0;
+
+   for (std::size_t i = 0; i < samples; ++i)
+   {
+      const unsigned long long int j = (i / 2) % keys.size();
+      const bloom_key_view key = (i & 1) ? keys.outlier(j,&scratch[0]) : keys.key(j,&scratch[0]);
+
+      const double t0 = now_ns();
+      sink += filter.contains(key.data,key.length) ? 1 : 0;
+      latency[i] = now_ns() - t0;
+   }
+
+   benchmark_sink += sink;
+
+   result.p50_ns  = percentile(latency,0.500);
+   result.p99_ns  = percentile(latency,0.990);
+   result.p999_ns = percentile(latency,0.999);
+}
+
+template<typename StaticFilter>
+void run_static_pair(const std::string& variant,
+                     const generated_keys& keys,
+                     const std::vector<bloom_key_view>& key_views,
+                     const benchmark_options& options,
+                     result_writer& writer)
+{
+   StaticFilter static_filter;
+
+   benchmark_result result;
+   result.benchmark  = "static";
+   result.variant    = variant;
+   result.dataset    = "generated";
+   result.key_length = keys.max_key_length();
+   result.threads    = options.max_threads;
+   result.keys       = keys.size();
+
+   double start = now_ns();
+
+   if (!static_filter.build(key_views.begin(),key_views.end(),options.max_threads))
+   {
+      std::cerr << "Warning: failed to build " << variant << std::endl;
+      return;
+   }
+
+   result.insert_mops  = (1.0e3 * keys.size()) / (now_ns() - start);
+   result.table_bytes  = static_filter.size() / bits_per_char;
+   result.hashes       = static_cast<unsigned int>(static_filter.hash_count());
+   result.expected_fpp = static_filter.effective_fpp();
+
+   measure_static_queries(static_filter,keys,options,result);
+
+   writer.write(result);
+
+   // A bloom_filter sized for the same false positive probability.
+   bloom_parameters parameters;
+   parameters.projected_element_count    = keys.size();
+   parameters.false_positive_probability = static_filter.effective_fpp();
+   parameters.compute_optimal_parameters();
+
+   bloom_filter filter(parameters);
+
+   result = benchmark_result();
+   result.benchmark  = "static";
+   result.variant    = "bloom_filter_vs_" + variant;
+   result.dataset    = "generated";
+   result.key_length = keys.max_key_length();
+   result.threads    = 1;
+   result.keys       = keys.size();
+
+   start = now_ns();
+
+   filter.insert(key_views.begin(),key_views.end());
+
+   result.insert_mops  = (1.0e3 * keys.size()) / (now_ns() - start);
+   result.table_bytes  = filter.size() / bits_per_char;
+   result.hashes       = static_cast<unsigned int>(filter.hash_count());
+   result.expected_fpp = filter.effective_fpp();
+
+   measure_static_queries(filter,keys,options,result);
+
+   writer.write(result);
+}
+
+void run_static_filters(const benchmark_options& options, result_writer& writer)
+{
+   const generated_keys keys(options.quick ? 100000 : 4000000,16);
+
+   std::vector<char> arena(static_cast<std::size_t>(keys.size() * keys.max_key_length()));
+   std::vector<bloom_key_view> key_views(static_cast<std::size_t>(keys.size()));
+
+   for (std::size_t i = 0; i < key_views.size(); ++i)
+   {
+      key_views[i] = keys.key(i,&arena[i * keys.max_key_length()]);
+   }
+
+   run_static_pair<xor8_filter> ("xor8_filter", keys,key_views,options,writer);
+   run_static_pair<xor16_filter>("xor16_filter",keys,key_views,options,writer);
+}
+
+void run_interleaved(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     Compares synchronous contains against contains_interleaved with
+     several group sizes, querying an even mix of inserted keys and
+     outliers in batches. Latency columns are per batch key, i.e. the
+     batch time divided by the batch size.
+   */
+   static const std::size_t group_sizes[] = { 0, 1, 4, 8, 16, 32 };
+   static const std::size_t batch_size = 4096;
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+   const generated_keys keys(key_count,16);
+
+   std::vector<char> scratch(keys.max_key_length() + sizeof(unsigned long long int));
+
+   bloom_filter filter(parameters);
+
+   for (unsigned long long int i = 0; i < key_count; ++i)
+   {
+      filter.insert(keys.key(i,&scratch[0]));
+   }
+
+   const std::size_t query_count = static_cast<std::size_t>(std::min<unsigned long long int>(2 * key_count,options.quick ? 200000 : 4000000));
+
+   std::vector<char> arena(batch_size * keys.max_key_length());
+   std::vector<bloom_key_view> batch(batch_size);
+   bool results[batch_size];
+
+   for (std::size_t g = 0; g < sizeof(group_sizes) / sizeof(std::size_t); ++g)
+   {
+      std::vector<double> latency;
+      unsigned long long int positives = 0;
+      double total = 0.0;
+
+      for (std::size_t offset = 0; offset < query_count; offset += batch_size)
+      {
+         const std::size_t n = std::min(batch_size,query_count - offset);
+
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            const unsigned long long int j = ((offset + i) / 2) % key_count;
+            char* buffer = &arena[i * keys.max_key_length()];
+            batch[i] = ((offset + i) & 1) ? keys.outlier(j,buffer) : keys.key(j,buffer);
+         }
+
+         const double t0 = now_ns();
+
+         if (0 == group_sizes[g])
+         {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+               results[i] = filter.contains(batch[i]);
+            }
+         }
+         else
+            filter.contains_interleaved(batch.begin(),batch.begin() + n,results,group_sizes[g]);
+
+         const double elapsed = now_ns() - t0;
+
+         total += elapsed;
+         latency.push_back(elapsed / n);
+
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            positives += results[i] ? 1 : 0;
+         }
+      }
+
+      char variant[64];
+
+      if (0 == group_sizes[g])
+         sprintf(variant,"bloom_filter_sync");
+      else
+         sprintf(variant,"bloom_filter_interleaved_%llu",static_cast<unsigned long long>(group_sizes[g]));
+
+      const unsigned long long int inserted = (query_count + 1) / 2;
+
+      benchmark_result result;
+      result.benchmark    = "interleave";
+      result.variant      = variant;
+      result.dataset      = "generated";
+      result.table_bytes  = filter.size() / bits_per_char;
+      result.hashes       = static_cast<unsigned int>(filter.hash_count());
+      result.key_length   = keys.max_key_length();
+      result.keys         = key_count;
+      result.query_mops   = (1.0e3 * query_count) / total;
+      result.observed_fpp = (1.0 * (positives - inserted)) / (query_count - inserted);
+      result.expected_fpp = filter.effective_fpp();
+      result.p50_ns       = percentile(latency,0.500);
+      result.p99_ns       = percentile(latency,0.990);
+      result.p999_ns      = percentile(latency,0.999);
+
+      writer.write(result);
+   }
+}
+
+void run_integer_keys(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     64-bit integer keys through the generic byte path (hash_ap over
+     the 8 key bytes per probe), the bloom_uint64 overloads (one mix
+     for all probes) and insert_batch/contains_batch. Queries are an even
+     mix of inserted keys and outliers.
+   */
+   static const char* variants[] = { "bloom_filter_bytes", "bloom_filter_integer", "bloom_filter_integer_batch" };
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+
+   std::vector<bloom_uint64> keys(static_cast<std::size_t>(key_count));
+   std::vector<bloom_uint64> queries(static_cast<std::size_t>(2 * key_count));
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      keys[i] = bloom_uint64(details::mix64(i + 1));
+   }
+
+   for (std::size_t i = 0; i < queries.size(); ++i)
+   {
+      queries[i] = bloom_uint64((i & 1) ? details::mix64((i / 2) + 1) : details::mix64(~static_cast<unsigned long long int>(i / 2)));
+   }
+
+   std::vector<char> results(queries.size());
+
+   for (std::size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v)
+   {
+      bloom_filter filter(parameters);
+
+      double start = now_ns();
+
+      switch (v)
+      {
+         case 0  : for (std::size_t i = 0; i < keys.size(); ++i)
+                   {
+                      filter.insert(reinterpret_cast<const char*>(&keys[i].value),sizeof(keys[i].value));
+                   }
+                   break;
+
+         case 1  : filter.insert(keys.begin(),keys.end());
+                   break;
+
+         default : filter.insert_batch(&keys[0],keys.size());
+      }
+
+      const double insert_mops = (1.0e3 * keys.size()) / (now_ns() - start);
+
+      start = now_ns();
+
+      switch (v)
+      {
+         case 0  : for (std::size_t i = 0; i < queries.size(); ++i)
+                   {
+                      results[i] = filter.contains(reinterpret_cast<const char*>(&queries[i].value),sizeof(queries[i].value));
+                   }
+                   break;
+
+         case 1  : for (std::size_t i = 0; i < queries.size(); ++i)
+                   {
+                      results[i] = filter.contains(queries[i]);
+                   }
+                   break;
+
+         default : filter.contains_batch(&queries[0],queries.size(),reinterpret_cast<bool*>(&results[0]));
+      }
+
+      const double query_mops = (1.0e3 * queries.size()) / (now_ns() - start);
+
+      unsigned long long int positives = 0;
+
+      for (std::size_t i = 0; i < results.size(); ++i)
+      {
+         positives += results[i] ? 1 : 0;
+      }
+
+      const std::size_t samples = std::min(options.latency_samples,queries.size());
+      std::vector<double> latency(samples);
+      unsigned long long int sink = 0;
+
+      for (std::size_t i = 0; i < samples; ++i)
+      {
+         const double t0 = now_ns();
+
+         if (0 == v)
+            sink += filter.contains(reinterpret_cast<const char*>(&queries[i].value),sizeof(queries[i].value)) ? 1 : 0;
+         else
+            sink += filter.contains(queries[i]) ? 1 : 0;
+
+         latency[i] = now_ns() - t0;
+      }
+
+      benchmark_sink += sink;
+
+      benchmark_result result;
+      result.benchmark    = "intkey";
+      result.variant      = variants[v];
+      result.dataset      = "generated";
+      result.table_bytes  = table_bytes;
+      result.hashes       = static_cast<unsigned int>(filter.hash_count());
+      result.key_length   = sizeof(unsigned long long int);
+      result.keys         = key_count;
+      result.insert_mops  = insert_mops;
+      result.query_mops   = query_mops;
+      result.observed_fpp = (1.0 * (positives - key_count)) / key_count;
+      result.expected_fpp = filter.effective_fpp();
+      result.p50_ns       = percentile(latency,0.500);
+      result.p99_ns       = percentile(latency,0.990);
+      result.p999_ns      = percentile(latency,0.999);
+
+      writer.write(result);
+   }
+}
+
+template<typename Filter>
+double checkpoint_ingest(Filter& filter,
+                         const std::vector<unsigned long long int>& keys,
+                         checkpointed_bloom_filter* checkpointer,
+                         const std::string& file_name,
+                         unsigned long long int& checkpoints)
+{
+   // Returns the insert rate in Mops, starting a checkpoint whenever none is running.
+   const double start = now_ns();
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      filter.insert(keys[i]);
+
+      if (checkpointer && (0 == (i & 0xFFFF)) && !checkpointer->checkpoint_in_progress())
+      {
+         checkpoints += checkpointer->start_checkpoint(file_name) ? 1 : 0;
+      }
+   }
+
+   return (1.0e3 * keys.size()) / (now_ns() - start);
+}
+
+void run_checkpoint(const unsigned long long int table_bytes, const benchmark_options&, result_writer& writer)
+{
+   /*
+     Note:
+     Insert rate of bloom_filter, of checkpointed_bloom_filter alone
+     (the cost of dirty chunk tracking) and of checkpointed_bloom_filter
+     while back-to-back checkpoints to a temporary file run in the
+     background. The checkpoint count is reported on stderr.
+   */
+   static const char* variants[] = { "bloom_filter", "checkpointed_bloom_filter", "checkpointed_bloom_filter_background" };
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+   const std::string file_name = "/tmp/bloom_filter_benchmark.checkpoint";
+
+   std::vector<unsigned long long int> keys(static_cast<std::size_t>(key_count));
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      keys[i] = details::mix64(i + 1);
+   }
+
+   for (std::size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v)
+   {
+      unsigned long long int checkpoints = 0;
+      double insert_mops = 0.0;
+
+      if (0 == v)
+      {
+         bloom_filter filter(parameters);
+         insert_mops = checkpoint_ingest(filter,keys,0,file_name,checkpoints);
+      }
+      else
+      {
+         checkpointed_bloom_filter filter(parameters);
+         insert_mops = checkpoint_ingest(filter,keys,(2 == v) ? &filter : 0,file_name,checkpoints);
+
+         if (2 == v)
+         {
+            const bool failed = !filter.wait_checkpoint();
+
+            std::cerr << "checkpoint: " << checkpoints << " checkpoints during ingest"
+                      << (failed ? ", the last one failed" : "") << std::endl;
+
+            unlink(file_name.c_str());
+            unlink((file_name + ".manifest").c_str());
+         }
+      }
+
+      benchmark_result result;
+      result.benchmark    = "checkpoint";
+      result.variant      = variants[v];
+      result.dataset      = "generated";
+      result.table_bytes  = table_bytes;
+      result.hashes       = parameters.optimal_parameters.number_of_hashes;
+      result.key_length   = sizeof(unsigned long long int);
+      result.keys         = key_count;
+      result.insert_mops  = insert_mops;
+      result.expected_fpp = parameters.false_positive_probability;
+
+      writer.write(result);
+   }
+}
+
+void run_paged(const unsigned long long int table_bytes, const benchmark_options&, result_writer& writer)
+{
+   /*
+     Note:
+     A paged_bloom_filter file of about table_bytes queried one key at
+     a time and in batches of 4096 keys, half of them outliers. Unless
+     the file is evicted from the page cache beforehand this measures
+     the CPU and system call cost; the page reads per query, reported
+     on stderr, are what bounds the rate on an SSD.
+   */
+   static const std::size_t batch_size = 4096;
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+   const std::string file_name = "/tmp/bloom_filter_benchmark.paged";
+
+   paged_bloom_filter filter;
+
+   if (!paged_bloom_filter::create(file_name,parameters) || !filter.open(file_name,true))
+   {
+      std::cerr << "paged: cannot create " << file_name << std::endl;
+      return;
+   }
+
+   std::vector<unsigned long long int> keys(static_cast<std::size_t>(std::min<unsigned long long int>(key_count,16 * batch_size * 64)));
+   std::vector<unsigned long long int> queries(keys.size());
+
+   double start = now_ns();
+
+   for (unsigned long long int i = 0; i < key_count; i += keys.size())
+   {
+      const std::size_t n = static_cast<std::size_t>(std::min<unsigned long long int>(keys.size(),key_count - i));
+
+      for (std::size_t j = 0; j < n; ++j)
+      {
+         keys[j] = details::mix64(i + j + 1);
+      }
+
+      filter.insert(keys.begin(),keys.begin() + n);
+   }
+
+   const double insert_mops = (1.0e3 * key_count) / (now_ns() - start);
+
+   filter.sync();
+
+   for (std::size_t i = 0; i < queries.size(); ++i)
+   {
+      const unsigned long long int id = (3 * i) % key_count;
+      queries[i] = (i & 1) ? details::mix64(id + 1) : details::mix64(~id);
+   }
+
+   std::vector<char> results(queries.size());
+
+   for (int batched = 0; batched < 2; ++batched)
+   {
+      const unsigned long long int reads = filter.pages_read();
+
+      start = now_ns();
+
+      if (batched)
+      {
+         for (std::size_t i = 0; i < queries.size(); i += batch_size)
+         {
+            const std::size_t n = std::min(batch_size,queries.size() - i);
+            filter.contains(queries.begin() + i,queries.begin() + i + n,reinterpret_cast<bool*>(&results[i]));
+         }
+      }
+      else
+      {
+         for (std::size_t i = 0; i < queries.size(); ++i)
+         {
+            results[i] = filter.contains(queries[i]);
+         }
+      }
+
+      const double query_mops = (1.0e3 * queries.size()) / (now_ns() - start);
+
+      unsigned long long int false_positives = 0;
+
+      for (std::size_t i = 0; i < results.size(); i += 2)
+      {
+         false_positives += results[i] ? 1 : 0;
+      }
+
+      std::cerr << "paged: " << (batched ? "batched" : "single") << " "
+                << (1.0 * (filter.pages_read() - reads)) / queries.size() << " page reads per query" << std::endl;
+
+      benchmark_result result;
+      result.benchmark    = "paged";
+      result.variant      = batched ? "paged_bloom_filter_batch" : "paged_bloom_filter_single";
+      result.dataset      = "generated";
+      result.table_bytes  = filter.page_count() * paged_bloom_filter::page_size;
+      result.hashes       = static_cast<unsigned int>(filter.hash_count());
+      result.key_length   = sizeof(unsigned long long int);
+      result.keys         = key_count;
+      result.insert_mops  = insert_mops;
+      result.query_mops   = query_mops;
+      result.observed_fpp = (2.0 * false_positives) / queries.size();
+      result.expected_fpp = filter.effective_fpp();
+
+      writer.write(result);
+   }
+
+   filter.close();
+   unlink(file_name.c_str());
+}
+
+void run_buffered(const unsigned long long int table_bytes, const benchmark_options&, result_writer& writer)
+{
+   /*
+     Note:
+     Bulk load of 64-bit keys with insert_batch into a bloom_filter and
+     into a buffered_bloom_filter, including its final flush, followed
+     by an even mix of inserted keys and outliers as queries.
+   */
+   static const char* variants[] = { "bloom_filter", "buffered_bloom_filter" };
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+
+   std::vector<bloom_uint64> keys(static_cast<std::size_t>(key_count));
+   std::vector<bloom_uint64> queries(std::min<std::size_t>(keys.size(),1024 * 1024));
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      keys[i] = bloom_uint64(details::mix64(i + 1));
+   }
+
+   for (std::size_t i = 0; i < queries.size(); ++i)
+   {
+      queries[i] = (i & 1) ? keys[(3 * i) % keys.size()] : bloom_uint64(details::mix64(~static_cast<unsigned long long int>(i)));
+   }
+
+   std::vector<char> results(queries.size());
+
+   for (std::size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v)
+   {
+      bloom_filter plain(parameters);
+      buffered_bloom_filter buffered(parameters);
+      const bloom_filter& filter = v ? static_cast<const bloom_filter&>(buffered) : plain;
+
+      double start = now_ns();
+
+      if (v)
+      {
+         buffered.insert_batch(&keys[0],keys.size());
+         buffered.flush();
+      }
+      else
+         plain.insert_batch(&keys[0],keys.size());
+
+      const double insert_mops = (1.0e3 * keys.size()) / (now_ns() - start);
+
+      start = now_ns();
+      filter.contains_batch(&queries[0],queries.size(),reinterpret_cast<bool*>(&results[0]));
+      const double query_mops = (1.0e3 * queries.size()) / (now_ns() - start);
+
+      unsigned long long int false_positives = 0;
+
+      for (std::size_t i = 0; i < results.size(); i += 2)
+      {
+         false_positives += results[i] ? 1 : 0;
+      }
+
+      benchmark_result result;
+      result.benchmark    = "buffered";
+      result.variant      = variants[v];
+      result.dataset      = "generated";
+      result.table_bytes  = table_bytes;
+      result.hashes       = static_cast<unsigned int>(filter.hash_count());
+      result.key_length   = sizeof(unsigned long long int);
+      result.keys         = key_count;
+      result.insert_mops  = insert_mops;
+      result.query_mops   = query_mops;
+      result.observed_fpp = (2.0 * false_positives) / queries.size();
+      result.expected_fpp = filter.effective_fpp();
+
+      writer.write(result);
+   }
+}
+
+template<typename Factory>
+double measure_filter_cycles(Factory& factory, const std::size_t cycles, const std::size_t keys_per_filter)
+{
+   // Returns the average nanoseconds per create/insert/query/destroy cycle.
+   unsigned long long int sink = 0;
+   const double start = now_ns();
+
+   for (std::size_t c = 0; c < cycles; ++c)
+   {
+      sink += factory.cycle(c * keys_per_filter,keys_per_filter);
+   }
+
+   benchmark_sink += sink;
+
+   return (now_ns() - start) / cycles;
+}
+
+struct heap_filter_factory
+{
+   const bloom_parameters* parameters;
+
+   inline unsigned long long int cycle(const unsigned long long int first, const std::size_t keys)
+   {
+      bloom_filter filter(*parameters);
+      unsigned long long int hits = 0;
+
+      for (std::size_t i = 0; i < keys; ++i)
+      {
+         filter.insert(first + i);
+      }
+
+      for (std::size_t i = 0; i < keys; ++i)
+      {
+         hits += filter.contains(first + (2 * i)) ? 1 : 0;
+      }
+
+      return hits;
+   }
+};
+
+struct arena_filter_factory
+{
+   const filter_schema_ptr* schema;
+   bloom_arena*             arena;
+
+   inline unsigned long long int cycle(const unsigned long long int first, const std::size_t keys)
+   {
+      unsigned long long int hits = 0;
+
+      {
+         arena_bloom_filter filter(*schema,*arena);
+
+         for (std::size_t i = 0; i < keys; ++i)
+         {
+            filter.insert(first + i);
+         }
+
+         for (std::size_t i = 0; i < keys; ++i)
+         {
+            hits += filter.contains(first + (2 * i)) ? 1 : 0;
+         }
+      }
+
+      arena->release();
+
+      return hits;
+   }
+};
+
+void run_arena(const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     Request handler pattern: create a small filter, insert n integer
+     keys, query n keys (half of them inserted) and destroy it, with
+     bloom_filter (heap table and salts) and arena_bloom_filter (arena
+     table released after every cycle, salts of a shared schema).
+     insert_mops is the cycle rate in millions per second; the mean
+     cycle time is reported on stderr.
+   */
+   static const std::size_t key_counts[] = { 16, 64, 256 };
+
+   const std::size_t cycles = options.quick ? 20000 : 200000;
+
+   for (std::size_t k = 0; k < sizeof(key_counts) / sizeof(key_counts[0]); ++k)
+   {
+      bloom_parameters parameters;
+      parameters.projected_element_count    = key_counts[k];
+      parameters.false_positive_probability = 0.01;
+      parameters.compute_optimal_parameters();
+
+      bloom_arena arena;
+      const filter_schema_ptr schema = filter_schema::create(parameters);
+
+      heap_filter_factory heap;
+      heap.parameters = &parameters;
+
+      arena_filter_factory pooled;
+      pooled.schema = &schema;
+      pooled.arena  = &arena;
+
+      for (int v = 0; v < 2; ++v)
+      {
+         const double cycle_ns = v ? measure_filter_cycles(pooled,cycles,key_counts[k]) :
+                                     measure_filter_cycles(heap  ,cycles,key_counts[k]) ;
+
+         std::cerr << "arena: " << (v ? "arena_bloom_filter" : "bloom_filter") << " "
+                   << key_counts[k] << " keys " << cycle_ns << " ns per cycle" << std::endl;
+
+         benchmark_result result;
+         result.benchmark    = "arena";
+         result.variant      = v ? "arena_bloom_filter" : "bloom_filter";
+         result.dataset      = "generated";
+         result.table_bytes  = parameters.optimal_parameters.table_size / bits_per_char;
+         result.hashes       = parameters.optimal_parameters.number_of_hashes;
+         result.key_length   = sizeof(unsigned long long int);
+         result.keys         = key_counts[k];
+         result.insert_mops  = 1.0e3 / cycle_ns;
+         result.expected_fpp = parameters.false_positive_probability;
+
+         writer.write(result);
+      }
+   }
+}
+
+void run_sketch(const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     A skewed stream of 4 updates per distinct key into count-min
+     sketches: 64-bit keys one at a time, with conservative update
+     and batched, then 16 byte keys into a bloom_filter plus a
+     separate sketch against a counted_bloom_filter, which hashes each
+     key once for both. Queries are one estimate per distinct key.
+     observed_fpp is the mean overestimate as a fraction of the total
+     count and expected_fpp its bound epsilon.
+   */
+   static const char* variants[] =
+                      {
+                        "count_min_sketch",
+                        "count_min_sketch_conservative",
+                        "count_min_sketch_batch",
+                        "bloom_filter+count_min_sketch",
+                        "counted_bloom_filter"
+                      };
+
+   const std::size_t distinct = options.quick ? (1 << 16) : (1 << 20);
+   const std::size_t updates  = 4 * distinct;
+
+   count_min_parameters parameters;
+   parameters.epsilon = 0.0001;
+   parameters.delta   = 0.01;
+   parameters.compute_optimal_parameters();
+
+   const bloom_parameters filter_parameters = make_parameters((distinct * 10) / bits_per_char,7,distinct);
+
+   std::vector<unsigned long long int> stream(updates);
+   std::vector<bloom_uint64> stream_keys(updates);
+   std::vector<unsigned int> truth(distinct,0);
+
+   for (std::size_t i = 0; i < updates; ++i)
+   {
+      const unsigned long long int r = details::mix64(i + 1) % distinct;
+      stream[i] = (r * r) / distinct;
+      stream_keys[i] = bloom_uint64(stream[i]);
+      ++truth[static_cast<std::size_t>(stream[i])];
+   }
+
+   std::vector<bloom_uint64> queries(distinct);
+
+   for (std::size_t i = 0; i < distinct; ++i)
+   {
+      queries[i] = bloom_uint64(i);
+   }
+
+   const generated_keys keys(distinct,16);
+   char scratch[16];
+
+   std::vector<count_min_sketch::counter_type> estimates(distinct);
+
+   for (std::size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v)
+   {
+      count_min_parameters variant_parameters = parameters;
+      variant_parameters.conservative_update = (1 == v);
+
+      count_min_sketch sketch(variant_parameters);
+      bloom_filter filter(filter_parameters);
+      counted_bloom_filter counted(filter_parameters,variant_parameters);
+
+      double start = now_ns();
+
+      for (std::size_t i = 0; i < updates; ++i)
+      {
+         switch (v)
+         {
+            case 0 :
+            case 1 : sketch.update(stream_keys[i]);
+                     break;
+
+            case 2 : sketch.update_batch(&stream_keys[0],stream_keys.size());
+                     i = updates;
+                     break;
+
+            case 3 : {
+                        const bloom_key_view key = keys.key(stream[i],scratch);
+                        filter.insert(key);
+                        sketch.update(key);
+                     }
+                     break;
+
+            default: counted.insert(keys.key(stream[i],scratch));
+         }
+      }
+
+      const double insert_mops = (1.0e3 * updates) / (now_ns() - start);
+
+      start = now_ns();
+
+      if (2 == v)
+         sketch.estimate_batch(&queries[0],queries.size(),&estimates[0]);
+      else
+      {
+         for (std::size_t i = 0; i < distinct; ++i)
+         {
+            switch (v)
+            {
+               case 0 :
+               case 1 : estimates[i] = sketch.estimate(queries[i]);
+                        break;
+
+               case 3 : {
+                           const bloom_key_view key = keys.key(i,scratch);
+                           estimates[i] = filter.contains(key) ? sketch.estimate(key) : 0;
+                        }
+                        break;
+
+               default: estimates[i] = counted.count(keys.key(i,scratch));
+            }
+         }
+      }
+
+      const double query_mops = (1.0e3 * distinct) / (now_ns() - start);
+
+      double overestimate = 0.0;
+
+      for (std::size_t i = 0; i < distinct; ++i)
+      {
+         overestimate += static_cast<double>(estimates[i]) - truth[i];
+      }
+
+      benchmark_result result;
+      result.benchmark    = "sketch";
+      result.variant      = variants[v];
+      result.dataset      = "generated";
+      result.table_bytes  = parameters.optimal_parameters.width * parameters.optimal_parameters.depth * sizeof(count_min_sketch::counter_type);
+      result.hashes       = parameters.optimal_parameters.depth;
+      result.key_length   = (v < 3) ? sizeof(unsigned long long int) : 16;
+      result.keys         = updates;
+      result.insert_mops  = insert_mops;
+      result.query_mops   = query_mops;
+      result.observed_fpp = overestimate / (static_cast<double>(distinct) * updates);
+      result.expected_fpp = parameters.epsilon;
+
+      writer.write(result);
+   }
+}
+
+void run_query_cache(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     Skewed query stream against a filter at --max-table: 15 of 16
+     queries go to 4096 hot keys (half of them inserted), the rest are
+     uniform over all keys and outliers. cached_bloom_filter without a
+     cache and with L1 and L2 sized caches. The mean query time, the
+     table probes per query and the cache hit ratio are reported on
+     stderr; the latency columns are left at zero.
+   */
+   static const std::size_t cache_sizes[] = { 0, 32 * 1024, 256 * 1024 };
+   static const char*       variants[]    = { "uncached", "cached_bloom_filter_32k", "cached_bloom_filter_256k" };
+
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+
+   std::vector<bloom_uint64> keys(static_cast<std::size_t>(key_count));
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      keys[i] = bloom_uint64(details::mix64(i + 1));
+   }
+
+   std::vector<bloom_uint64> queries(options.quick ? (1 << 20) : (1 << 23));
+   unsigned long long int members = 0;
+
+   for (std::size_t i = 0; i < queries.size(); ++i)
+   {
+      const unsigned long long int r = details::mix64(~static_cast<unsigned long long int>(i));
+      const std::size_t hot = static_cast<std::size_t>(r >> 52) % 4096;
+      const bool member = (r & 0xF) ? (0 != (hot & 1)) : (0 != (r & 0x10));
+
+      if (r & 0xF)
+         queries[i] = member ? keys[hot % keys.size()] : bloom_uint64(details::mix64(hot + key_count + 1));
+      else
+         queries[i] = member ? keys[static_cast<std::size_t>(r >> 20) % keys.size()] : bloom_uint64(r);
+
+      members += member ? 1 : 0;
+   }
+
+   for (std::size_t c = 0; c < sizeof(cache_sizes) / sizeof(cache_sizes[0]); ++c)
+   {
+      cached_bloom_filter filter(parameters,cache_sizes[c]);
+      filter.insert_batch(&keys[0],keys.size());
+
+      unsigned long long int positives = 0;
+
+      const double start = now_ns();
+
+      for (std::size_t i = 0; i < queries.size(); ++i)
+      {
+         positives += filter.contains(queries[i]) ? 1 : 0;
+      }
+
+      const double elapsed = now_ns() - start;
+
+      benchmark_sink += positives;
+
+      std::cerr << "cache: " << variants[c] << " "
+                << elapsed / queries.size() << " ns per query, "
+                << filter.cache_stats().probes_per_query() << " probes per query, "
+                << filter.cache_stats().hit_ratio() << " hit ratio" << std::endl;
+
+      benchmark_result result;
+      result.benchmark    = "cache";
+      result.variant      = variants[c];
+      result.dataset      = "skewed";
+      result.table_bytes  = table_bytes;
+      result.hashes       = static_cast<unsigned int>(filter.hash_count());
+      result.key_length   = sizeof(unsigned long long int);
+      result.keys         = key_count;
+      result.query_mops   = (1.0e3 * queries.size()) / elapsed;
+      result.observed_fpp = (1.0 * (positives - members)) / (queries.size() - members);
+      result.expected_fpp = filter.effective_fpp();
+
+      writer.write(result);
+   }
+}
+
+void run_key_variants(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     Each query looks up four variants of a mixed case host name
+     (as given, case folded, trimmed and folded with the labels
+     reversed, and byte reversed) in a filter at --max-table holding
+     folded and label reversed names. "strings" builds each variant as
+     a std::string and calls contains() on it, "views" computes them
+     with bloom_key_pipeline::apply() and then calls contains() per
+     variant, "pipeline" calls bloom_key_pipeline::contains().
+     observed_fpp is the fraction of absent names with any variant
+     found, expected_fpp its value for four independent lookups. The
+     mean time per query (all four variants) is reported on stderr.
+   */
+   static const char* variants[] = { "strings", "views", "pipeline" };
+
+   const std::size_t key_count = options.quick ? (1 << 18) : (1 << 20);
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+
+   std::vector<std::string> queries(key_count);
+
+   for (std::size_t i = 0; i < queries.size(); ++i)
+   {
+      char buffer[64];
+      const unsigned long long int r = details::mix64(i + 1);
+      std::sprintf(buffer," Host%llu.Example%u.COM ",r % 1000000000ULL,static_cast<unsigned int>(r >> 50));
+      queries[i] = buffer;
+   }
+
+   bloom_key_pipeline pipeline;
+   pipeline.add_variant(bloom_key_pipeline::e_identity);
+   pipeline.add_variant(bloom_key_pipeline::e_case_fold);
+   pipeline.add_variant(bloom_key_pipeline::e_case_fold | bloom_key_pipeline::e_trim | bloom_key_pipeline::e_reverse_domain);
+   pipeline.add_variant(bloom_key_pipeline::e_reverse);
+
+   bloom_filter filter(parameters);
+
+   // Half of the names are present, under the reversed label variant.
+   for (std::size_t i = 0; i < queries.size(); i += 2)
+   {
+      pipeline.apply(queries[i].data(),queries[i].size());
+      filter.insert(pipeline.variant_key(2).data,pipeline.variant_key(2).length);
+   }
+
+   for (std::size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v)
+   {
+      unsigned long long int found = 0;
+      unsigned long long int false_positives = 0;
+
+      const double start = now_ns();
+
+      for (std::size_t i = 0; i < queries.size(); ++i)
+      {
+         const std::string& key = queries[i];
+         const unsigned long long int previous = found;
+
+         if (0 == v)
+         {
+            std::string folded(key);
+            std::transform(folded.begin(),folded.end(),folded.begin(),::tolower);
+
+            const std::size_t begin = folded.find_first_not_of(" \t\n\r\f\v");
+            const std::size_t end   = folded.find_last_not_of (" \t\n\r\f\v");
+            const std::string trimmed = (std::string::npos == begin) ? std::string() : folded.substr(begin,end - begin + 1);
+
+            std::string domain;
+            std::size_t label_end = trimmed.size();
+
+            for (std::size_t p = trimmed.size(); p-- > 0; )
+            {
+               if ('.' == trimmed[p])
+               {
+                  domain.append(trimmed,p + 1,label_end - p - 1);
+                  domain += '.';
+                  label_end = p;
+               }
+            }
+
+            domain.append(trimmed,0,label_end);
+
+            const std::string reversed(key.rbegin(),key.rend());
+
+            found += (filter.contains(key     ) ||
+                      filter.contains(folded  ) ||
+                      filter.contains(domain  ) ||
+                      filter.contains(reversed)) ? 1 : 0;
+         }
+         else if (1 == v)
+         {
+            pipeline.apply(key.data(),key.size());
+
+            bool any = false;
+
+            for (std::size_t j = 0; j < pipeline.variant_count(); ++j)
+            {
+               any |= filter.contains(pipeline.variant_key(j).data,pipeline.variant_key(j).length);
+            }
+
+            found += any ? 1 : 0;
+         }
+         else
+            found += (0 != pipeline.contains(filter,key)) ? 1 : 0;
+
+         // Odd names were not inserted.
+         if (i & 1)
+            false_positives += found - previous;
+      }
+
+      const double elapsed = now_ns() - start;
+
+      benchmark_sink += found;
+
+      std::cerr << "variants: " << variants[v] << " "
+                << elapsed / queries.size() << " ns per query" << std::endl;
+
+      benchmark_result result;
+      result.benchmark    = "variants";
+      result.variant      = variants[v];
+      result.dataset      = "hostnames";
+      result.table_bytes  = table_bytes;
+      result.hashes       = static_cast<unsigned int>(filter.hash_count());
+      result.key_length   = queries[0].size();
+      result.keys         = key_count;
+      result.query_mops   = (1.0e3 * queries.size()) / elapsed;
+      result.observed_fpp = (1.0 * false_positives) / (queries.size() / 2);
+      result.expected_fpp = 1.0 - std::pow(1.0 - filter.effective_fpp(),1.0 * pipeline.variant_count());
+
+      writer.write(result);
+   }
+}
+
+struct range_query_set
+{
+   /*
+     Note:
+     Sorted 64-bit keys drawn uniformly from [0,2^40) together with
+     the query ranges, so that each range can be classified as empty
+     or non-empty exactly.
+   */
+   range_query_set(const std::size_t key_count, const std::size_t query_count, const unsigned long long int width)
+   {
+      unsigned long long int state = 0x9E3779B97F4A7C15ULL;
+
+      for (std::size_t i = 0; i < key_count; ++i)
+      {
+         state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+         keys.push_back(state & ((1ULL << 40) - 1));
+      }
+
+      for (std::size_t i = 0; i < query_count; ++i)
+      {
+         state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+         const unsigned long long int lower = state & ((1ULL << 40) - 1);
+         lower_bounds.push_back(lower);
+      }
+
+      std::sort(keys.begin(),keys.end());
+
+      for (std::size_t i = 0; i < query_count; ++i)
+      {
+         const unsigned long long int upper = lower_bounds[i] + width - 1;
+         std::vector<unsigned long long int>::const_iterator itr = std::lower_bound(keys.begin(),keys.end(),lower_bounds[i]);
+         non_empty.push_back((keys.end() != itr) && (*itr <= upper));
+      }
+   }
+
+   std::vector<unsigned long long int> keys;
+   std::vector<unsigned long long int> lower_bounds;
+   std::vector<bool> non_empty;
+};
+
+template<typename RangeQuery>
+void measure_range_queries(const RangeQuery& query,
+                           const range_query_set& queries,
+                           const std::size_t query_count,
+                           benchmark_result& result)
+{
+   std::vector<double> latency(query_count);
+   unsigned long long int false_positives = 0;
+   unsigned long long int empty = 0;
+
+   const double start = now_ns();
+
+   for (std::size_t i = 0; i < query_count; ++i)
+   {
+      const double t0 = now_ns();
+      const bool positive = query(queries.lower_bounds[i]);
+      latency[i] = now_ns() - t0;
+
+      if (!queries.non_empty[i])
+      {
+         ++empty;
+         false_positives += positive ? 1 : 0;
+      }
+   }
+
+   result.query_mops   = (1.0e3 * query_count) / (now_ns() - start);
+   result.observed_fpp = (1.0 * false_positives) / std::max<unsigned long long int>(1,empty);
+   result.p50_ns       = percentile(latency,0.500);
+   result.p99_ns       = percentile(latency,0.990);
+   result.p999_ns      = percentile(latency,0.999);
+}
+
+struct prefix_range_query
+{
+   prefix_range_query(const range_bloom_filter& f, const unsigned long long int w)
+   : filter(f),
+     width(w)
+   {}
+
+   inline bool operator()(const unsigned long long int lower) const
+   {
+      return filter.contains_range(lower,lower + width - 1);
+   }
+
+   const range_bloom_filter& filter;
+   unsigned long long int width;
+};
+
+struct point_chain_query
+{
+   point_chain_query(const bloom_filter& f, const unsigned long long int w)
+   : filter(f),
+     width(w)
+   {}
+
+   inline bool operator()(const unsigned long long int lower) const
+   {
+      for (unsigned long long int key = lower; key < (lower + width); ++key)
+      {
+         if (filter.contains(key))
+            return true;
+      }
+
+      return false;
+   }
+
+   const bloom_filter& filter;
+   unsigned long long int width;
+};
+
+void run_range(const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     Compares range_bloom_filter::contains_range against a chain of
+     point lookups, one per value in the range, on a bloom_filter with
+     the same point false positive probability. The chain is run on
+     fewer queries for wide ranges so that its total cost stays
+     bounded.
+   */
+   static const unsigned long long int widths[] = { 1, 16, 256, 4096, 65536 };
+
+   const std::size_t key_count   = options.quick ? 100000 : 1000000;
+   const std::size_t query_count = options.quick ? 10000  : 100000;
+
+   bloom_parameters parameters;
+   parameters.projected_element_count    = key_count;
+   parameters.false_positive_probability = 0.001;
+   parameters.compute_optimal_parameters();
+
+   range_bloom_filter range_filter(parameters);
+   bloom_filter point_filter(parameters);
+
+   const range_query_set keys(key_count,0,1);
+
+   double start = now_ns();
+   range_filter.insert(keys.keys.begin(),keys.keys.end());
+   const double range_insert_mops = (1.0e3 * key_count) / (now_ns() - start);
+
+   start = now_ns();
+   point_filter.insert(keys.keys.begin(),keys.keys.end());
+   const double point_insert_mops = (1.0e3 * key_count) / (now_ns() - start);
+
+   for (std::size_t w = 0; w < sizeof(widths) / sizeof(unsigned long long int); ++w)
+   {
+      const range_query_set queries(key_count,query_count,widths[w]);
+
+      char dataset[32];
+      sprintf(dataset,"width=%llu",widths[w]);
+
+      {
+         double expected_fpp = 0.0;
+
+         for (std::size_t i = 0; i < query_count; ++i)
+         {
+            expected_fpp += range_filter.range_fpp(queries.lower_bounds[i],queries.lower_bounds[i] + widths[w] - 1);
+         }
+
+         benchmark_result result;
+         result.benchmark    = "range";
+         result.variant      = "range_bloom_filter";
+         result.dataset      = dataset;
+         result.table_bytes  = range_filter.size() / bits_per_char;
+         result.hashes       = static_cast<unsigned int>(range_filter.filter().hash_count());
+         result.key_length   = sizeof(unsigned long long int);
+         result.keys         = key_count;
+         result.insert_mops  = range_insert_mops;
+         result.expected_fpp = expected_fpp / query_count;
+
+         measure_range_queries(prefix_range_query(range_filter,widths[w]),queries,query_count,result);
+
+         writer.write(result);
+      }
+
+      {
+         const std::size_t chain_query_count = static_cast<std::size_t>(std::max<unsigned long long int>(100,std::min<unsigned long long int>(query_count,(options.quick ? 2000000ULL : 20000000ULL) / widths[w])));
+
+         benchmark_result result;
+         result.benchmark    = "range";
+         result.variant      = "bloom_filter_point_chain";
+         result.dataset      = dataset;
+         result.table_bytes  = point_filter.size() / bits_per_char;
+         result.hashes       = static_cast<unsigned int>(point_filter.hash_count());
+         result.key_length   = sizeof(unsigned long long int);
+         result.keys         = key_count;
+         result.insert_mops  = point_insert_mops;
+         result.expected_fpp = 1.0 - std::pow(1.0 - point_filter.effective_fpp(),1.0 * widths[w]);
+
+         measure_range_queries(point_chain_query(point_filter,widths[w]),queries,chain_query_count,result);
+
+         writer.write(result);
+      }
+   }
+}
+
+struct swap_reader
+{
+   const bloom_filter_holder* holder;
+   const generated_keys*      keys;
+   std::size_t                samples;
+   std::vector<double>        latency;
+   volatile bool              done;
+
+   static void* run(void* arg)
+   {
+      swap_reader& r = *static_cast<swap_reader*>(arg);
+      std::vector<char> scratch(r.keys->max_key_length() + sizeof(unsigned long long int));
+      unsigned long long int sink = 0;
+
+      r.latency.resize(r.samples);
+
+      for (std::size_t i = 0; i < r.samples; ++i)
+      {
+         const unsigned long long int j = (i / 2) % r.keys->size();
+         const bloom_key_view key = (i & 1) ? r.keys->outlier(j,&scratch[0]) : r.keys->key(j,&scratch[0]);
+
+         const double t0 = now_ns();
+         sink += r.holder->contains(0,key) ? 1 : 0;
+         r.latency[i] = now_ns() - t0;
+      }
+
+      benchmark_sink += sink;
+      __atomic_store_n(&r.done,true,__ATOMIC_RELEASE);
+
+      return 0;
+   }
+};
+
+void run_holder_swap(const unsigned long long int table_bytes, const benchmark_options& options, result_writer& writer)
+{
+   /*
+     Note:
+     One reader queries through a bloom_filter_holder while, in the
+     "swapping" variant, the main thread keeps rebuilding the filter
+     and publishing it. The reader latency percentiles of the two
+     variants should be indistinguishable.
+   */
+   const unsigned long long int key_count = (table_bytes * bits_per_char) / 10;
+   const bloom_parameters parameters = make_parameters(table_bytes,7,key_count);
+   const generated_keys keys(key_count,16);
+
+   std::vector<char> scratch(keys.max_key_length() + sizeof(unsigned long long int));
+
+   for (int swapping = 0; swapping < 2; ++swapping)
+   {
+      bloom_filter* initial = new bloom_filter(parameters);
+
+      for (unsigned long long int i = 0; i < key_count; ++i)
+      {
+         initial->insert(keys.key(i,&scratch[0]));
+      }
+
+      bloom_filter_holder holder(initial,1);
+
+      swap_reader reader;
+      reader.holder  = &holder;
+      reader.keys    = &keys;
+      reader.samples = options.latency_samples * 10;
+      reader.done    = false;
+
+      unsigned long long int publications = 0;
+      const double start = now_ns();
+
+      pthread_t reader_id;
+
+      if (0 != pthread_create(&reader_id,0,&swap_reader::run,&reader))
+      {
+         std::cerr << "Warning: skipping swap, the reader thread could not be started" << std::endl;
+         return;
+      }
+
+      while (swapping && !__atomic_load_n(&reader.done,__ATOMIC_ACQUIRE))
+      {
+         bloom_filter* rebuilt = new bloom_filter(parameters);
+
+         for (unsigned long long int i = 0; i < key_count; ++i)
+         {
+            rebuilt->insert(keys.key(i,&scratch[0]));
+         }
+
+         holder.publish(rebuilt);
+         ++publications;
+
+         usleep(1000);
+      }
+
+      pthread_join(reader_id,0);
+
+      benchmark_result result;
+      result.benchmark   = "swap";
+      result.variant     = swapping ? "bloom_filter_holder_swapping" : "bloom_filter_holder_steady";
+      result.dataset     = "generated";
+      result.table_bytes = table_bytes;
+      result.hashes      = parameters.optimal_parameters.number_of_hashes;
+      result.key_length  = keys.max_key_length();
+      result.threads     = 1;
+      result.keys        = key_count;
+      result.query_mops  = (1.0e3 * reader.samples) / (now_ns() - start);
+      result.p50_ns      = percentile(reader.latency,0.500);
+      result.p99_ns      = percentile(reader.latency,0.990);
+      result.p999_ns     = percentile(reader.latency,0.999);
+
+      writer.write(result);
+
+      if (swapping)
+      {
+         std::cerr << "swap: " << publications << " filters published during the run" << std::endl;
+      }
+   }
+}
+
+bool parse_options(int argc, char* argv[], benchmark_options& options)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg = argv[i];
+
+      if ("--format=csv" == arg)
+         options.json = false;
+      else if ("--format=json" == arg)
+         options.json = true;
+      else if (0 == arg.find("--max-table="))
+         options.max_table_bytes = ::strtoull(arg.c_str() + 12,0,10) * 1024 * 1024;
+      else if (0 == arg.find("--threads="))
+         options.max_threads = static_cast<unsigned int>(::atoi(arg.c_str() + 10));
+      else if (0 == arg.find("--samples="))
+         options.latency_samples = static_cast<std::size_t>(::strtoull(arg.c_str() + 10,0,10));
+      else if ("--quick" == arg)
+         options.quick = true;
+      else if (0 == arg.find("--only="))
+         options.only = arg.substr(7);
+      else
+         return false;
+   }
+
+   if (options.quick)
+   {
+      options.max_table_bytes = std::min(options.max_table_bytes,2ULL * 1024 * 1024);
+   }
+
+   return (options.max_threads > 0) && (options.latency_samples > 0);
+}
@@ -0,0 +1,698 @@
+/*
+ *********************************************************************
+ *                                                                   *
+ *                           Open Bloom Filter                       *
+ *                                                                   *
+ * Author: Arash Partow - 2000                                       *
+ * URL: http://www.partow.net                                        *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html   *
+ *                                                                   *
+ * Copyright notice:                                                 *
+ * Free use of the Open Bloom Filter Library is permitted under the  *
+ * guidelines and in accordance with the most current version of the *
+ * Common Public License.                                            *
+ * http://www.opensource.org/licenses/cpl1.0.php                     *
+ *                                                                   *
+ *********************************************************************
+*/
+
+
+#ifndef INCLUDE_BLOOM_FILTER_CHECKPOINT_HPP
+#define INCLUDE_BLOOM_FILTER_CHECKPOINT_HPP
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+#include "bloom_filter_io.hpp"
+#include "bloom_filter_mapped.hpp"
+
+
+class checkpointed_bloom_filter : private bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter that can be checkpointed to a filter file (the
+     format of bloom_filter_mapped.hpp) while inserts continue.
+
+     Every insert marks the 4 KiB chunk of the table it modifies as
+     dirty. A checkpoint atomically takes and clears each dirty flag,
+     copies the chunk into a staging buffer (the copy-on-write
+     snapshot) and writes it, coalescing runs of adjacent chunks. The
+     first checkpoint to a file writes every chunk; later ones only
+     the chunks modified since the previous checkpoint.
+
+     Bits are only ever set, so a chunk copied while inserts proceed
+     holds at least the bits it had when the checkpoint started, and a
+     file holding any mix of old and new chunk contents still contains
+     every key of the previous checkpoint. Once the data file has been
+     synced, a small manifest (file.manifest) recording the epoch and
+     element count is replaced atomically by rename. recover() trusts
+     only the manifest, so after a crash every key inserted before the
+     start of the last completed checkpoint is present.
+
+     A full checkpoint truncates the data file, so it first removes
+     the manifest: a crash during it leaves no checkpoint rather than
+     a manifest describing a partly written table. clear(), the one
+     operation removing bits, makes the next checkpoint a full one.
+
+     bloom_filter is a private base so that every table mutation goes
+     through this class and marks its chunks: clear() and operator|=
+     mark every chunk, while operators that clear bits (&=, ^=,
+     assignment) are not offered. The read-only interface is exposed
+     by using-declarations, and base() gives a const bloom_filter& for
+     code taking one.
+
+     One thread may insert while a background checkpoint is running;
+     as with bloom_filter, concurrent inserts need external locking.
+   */
+
+public:
+
+   enum { chunk_size = 4096 };
+
+   checkpointed_bloom_filter()
+   : epoch_(0),
+     joinable_(false),
+     active_(false),
+     result_(false)
+   {}
+
+   checkpointed_bloom_filter(const bloom_parameters& p)
+   : bloom_filter(p),
+     dirty_(chunk_count(),1),
+     epoch_(0),
+     joinable_(false),
+     active_(false),
+     result_(false)
+   {}
+
+  ~checkpointed_bloom_filter()
+   {
+      wait_checkpoint();
+   }
+
+   using bloom_filter::operator!;
+   using bloom_filter::contains;
+   using bloom_filter::contains_batch;
+   using bloom_filter::contains_all;
+   using bloom_filter::contains_none;
+   using bloom_filter::contains_interleaved;
+   using bloom_filter::contains_mask;
+   using bloom_filter::size;
+   using bloom_filter::element_count;
+   using bloom_filter::effective_fpp;
+   using bloom_filter::bit_count;
+   using bloom_filter::fill_ratio;
+   using bloom_filter::estimated_element_count;
+   using bloom_filter::estimated_union_count;
+   using bloom_filter::estimated_intersection_count;
+   using bloom_filter::table;
+   using bloom_filter::set_query_strategy;
+   using bloom_filter::query_strategy;
+   using bloom_filter::hash_count;
+   using bloom_filter::schema;
+
+   inline const bloom_filter& base() const
+   {
+      return *this;
+   }
+
+   inline void clear()
+   {
+      /*
+        Note:
+        Clearing removes bits, so the next checkpoint is a full one:
+        that removes the manifest before any chunk of the file loses a
+        bit. A background checkpoint is waited for first.
+      */
+      wait_checkpoint();
+      bloom_filter::clear();
+      mark_all();
+      last_file_name_.clear();
+   }
+
+   inline checkpointed_bloom_filter& operator |= (const bloom_filter& f)
+   {
+      bloom_filter::operator|=(f);
+      mark_all();
+      return *this;
+   }
+
+   inline void insert(const unsigned char* key_begin, const std::size_t& length)
+   {
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i)
+      {
+         compute_index(hash_ap(key_begin,length,schema_->salt[i]),bit_index);
+         set_bit(bit_index);
+      }
+      count_insert();
+   }
+
+   template<typename T>
+   inline void insert(const T& t)
+   {
+      // Note: T must be a C++ POD type.
+      insert(reinterpret_cast<const unsigned char*>(&t),sizeof(T));
+   }
+
+   inline void insert(const std::string& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.c_str()),key.size());
+   }
+
+   inline void insert(const char* data, const std::size_t& length)
+   {
+      insert(reinterpret_cast<const unsigned char*>(data),length);
+   }
+
+   inline void insert(const bloom_key_view& key)
+   {
+      insert(reinterpret_cast<const unsigned char*>(key.data),key.length);
+   }
+
+   inline void insert(const bloom_uint64& key)
+   {
+      insert_integer_tracked(key.value,0);
+   }
+
+   inline void insert(const bloom_uint128& key)
+   {
+      insert_integer_tracked(key.low,key.high);
+   }
+
+   template<typename InputIterator>
+   inline void insert(const InputIterator begin, const InputIterator end)
+   {
+      InputIterator itr = begin;
+      while (end != itr)
+      {
+         insert(*(itr++));
+      }
+   }
+
+   inline void insert_batch(const bloom_uint64* keys, const std::size_t count)
+   {
+      for (std::size_t i = 0; i < count; ++i)
+      {
+         insert_integer_tracked(keys[i].value,0);
+      }
+   }
+
+   inline bool checkpoint(const std::string& file_name)
+   {
+      /*
+        Note:
+        Synchronous checkpoint in the calling thread. Returns false if
+        the checkpoint failed (the chunks involved remain dirty) or if
+        a background checkpoint is running.
+      */
+      if (checkpoint_in_progress())
+         return false;
+
+      return run_checkpoint(file_name);
+   }
+
+   inline bool start_checkpoint(const std::string& file_name)
+   {
+      // Starts a checkpoint in a background thread; see wait_checkpoint.
+      if (checkpoint_in_progress())
+         return false;
+
+      wait_checkpoint();
+
+      file_name_ = file_name;
+      result_    = false;
+      set_active(true);
+
+      if (0 != pthread_create(&thread_,0,checkpoint_thread,this))
+      {
+         set_active(false);
+         return false;
+      }
+
+      joinable_ = true;
+
+      return true;
+   }
+
+   inline bool checkpoint_in_progress() const
+   {
+      #if defined(__GNUC__)
+      return __atomic_load_n(&active_,__ATOMIC_ACQUIRE);
+      #else
+      return active_;
+      #endif
+   }
+
+   inline bool wait_checkpoint()
+   {
+      // Waits for the background checkpoint, returning its result.
+      if (joinable_)
+      {
+         pthread_join(thread_,0);
+         joinable_ = false;
+      }
+
+      return result_;
+   }
+
+   inline unsigned long long int epoch() const
+   {
+      // Number of the last completed checkpoint.
+      return epoch_;
+   }
+
+   inline std::size_t dirty_chunk_count() const
+   {
+      std::size_t result = 0;
+
+      for (std::size_t i = 0; i < dirty_.size(); ++i)
+      {
+         result += load_flag(dirty_[i]);
+      }
+
+      return result;
+   }
+
+   inline bool recover(const std::string& file_name)
+   {
+      /*
+        Note:
+        Replaces this filter with the last completed checkpoint of
+        file_name. Returns false if there is none or it is unreadable.
+      */
+      if (checkpoint_in_progress())
+         return false;
+
+      manifest_t manifest;
+
+      if (!read_manifest(file_name,manifest))
+         return false;
+
+      const int fd = ::open(file_name.c_str(),O_RDONLY);
+
+      if (fd < 0)
+         return false;
+
+      bloom_filter_file_header header;
+
+      bool result = read_fully(fd,reinterpret_cast<unsigned char*>(&header),sizeof(header),0) &&
+                    header.valid() &&
+                    (header.table_size  == manifest.table_size) &&
+                    (header.random_seed == manifest.random_seed) &&
+                    (header.salt_count  == manifest.salt_count);
+
+      if (result)
+      {
+         std::vector<unsigned char> table(static_cast<std::size_t>(header.table_size / bits_per_char));
+
+         result = read_fully(fd,&table[0],table.size(),bloom_filter_file_header::table_offset);
+
+         if (result)
+         {
+            delete[] bit_table_;
+
+            schema_ = filter_schema::create(header.table_size,
+                                            header.salt_count,
+                                            header.random_seed,
+                                            header.projected_element_count,
+                                            header.false_positive_probability);
+            inserted_element_count_ = static_cast<unsigned int>(manifest.inserted_element_count);
+
+            allocate_table();
+            std::copy(table.begin(),table.end(),reinterpret_cast<cell_type*>(bit_table_));
+            removed_bits();
+
+            // The file matches the table, so the next checkpoint to it is incremental.
+            dirty_.assign(chunk_count(),0);
+            epoch_          = manifest.epoch;
+            last_file_name_ = file_name;
+         }
+      }
+
+      ::close(fd);
+
+      return result;
+   }
+
+private:
+
+   struct manifest_t
+   {
+      manifest_t()
+      : epoch(0),
+        inserted_element_count(0),
+        table_size(0),
+        random_seed(0),
+        salt_count(0)
+      {}
+
+      unsigned long long int epoch;
+      unsigned long long int inserted_element_count;
+      unsigned long long int table_size;
+      unsigned long long int random_seed;
+      unsigned int           salt_count;
+   };
+
+   checkpointed_bloom_filter(const checkpointed_bloom_filter&);
+   checkpointed_bloom_filter& operator=(const checkpointed_bloom_filter&);
+
+   static inline void* checkpoint_thread(void* arg)
+   {
+      checkpointed_bloom_filter& filter = *static_cast<checkpointed_bloom_filter*>(arg);
+      filter.result_ = filter.run_checkpoint(filter.file_name_);
+      filter.set_active(false);
+      return 0;
+   }
+
+   inline void set_active(const bool active)
+   {
+      #if defined(__GNUC__)
+      __atomic_store_n(&active_,active,__ATOMIC_RELEASE);
+      #else
+      active_ = active;
+      #endif
+   }
+
+   inline std::size_t chunk_count() const
+   {
+      return static_cast<std::size_t>((schema_->raw_table_size + chunk_size - 1) / chunk_size);
+   }
+
+   static inline unsigned char load_flag(const unsigned char& flag)
+   {
+      #if defined(__GNUC__)
+      return __atomic_load_n(&flag,__ATOMIC_RELAXED);
+      #else
+      return flag;
+      #endif
+   }
+
+   static inline unsigned char take_flag(unsigned char& flag)
+   {
+      #if defined(__GNUC__)
+      return __atomic_exchange_n(&flag,static_cast<unsigned char>(0),__ATOMIC_ACQUIRE);
+      #else
+      const unsigned char result = flag;
+      flag = 0;
+      return result;
+      #endif
+   }
+
+   static inline void mark_flag(unsigned char& flag)
+   {
+      // Release: a checkpoint that takes the flag also sees the bits set before it.
+      #if defined(__GNUC__)
+      __atomic_store_n(&flag,static_cast<unsigned char>(1),__ATOMIC_RELEASE);
+      #else
+      flag = 1;
+      #endif
+   }
+
+   inline void set_bit(const std::size_t bit_index)
+   {
+      bloom_filter::set_bit(bit_index);
+      mark_flag(dirty_[(bit_index / bits_per_char) / chunk_size]);
+   }
+
+   inline void mark_all()
+   {
+      for (std::size_t i = 0; i < dirty_.size(); ++i)
+      {
+         mark_flag(dirty_[i]);
+      }
+   }
+
+   inline void count_insert()
+   {
+      #if defined(__GNUC__)
+      __atomic_store_n(&inserted_element_count_,inserted_element_count_ + 1,__ATOMIC_RELEASE);
+      #else
+      ++inserted_element_count_;
+      #endif
+   }
+
+   inline void insert_integer_tracked(const unsigned long long int low, const unsigned long long int high)
+   {
+      bloom_type h1 = 0;
+      bloom_type h2 = 0;
+      integer_hash(low,high,h1,h2);
+
+      std::size_t bit_index = 0;
+      for (std::size_t i = 0; i < schema_->salt.size(); ++i, h1 += h2)
+      {
+         compute_index(h1,bit_index);
+         set_bit(bit_index);
+      }
+      count_insert();
+   }
+
+   inline bool run_checkpoint(const std::string& file_name)
+   {
+      static const std::size_t staging_chunks = 2048;  // 8 MiB per round
+      static const std::size_t max_run_chunks = 256;   // 1 MiB per write
+
+      // Keys counted here have all of their chunks marked already.
+      #if defined(__GNUC__)
+      const unsigned long long int element_count = __atomic_load_n(&inserted_element_count_,__ATOMIC_ACQUIRE);
+      #else
+      const unsigned long long int element_count = inserted_element_count_;
+      #endif
+
+      const bool full = (file_name != last_file_name_);
+
+      // The old manifest must not outlive the table it describes.
+      if (full && !remove_manifest(file_name))
+         return false;
+
+      const int fd = ::open(file_name.c_str(),O_WRONLY | O_CREAT | (full ? O_TRUNC : 0),0644);
+
+      if (fd < 0)
+         return false;
+
+      bloom_filter_file_header header;
+      header.table_size                 = schema_->table_size;
+      header.random_seed                = schema_->random_seed;
+      header.projected_element_count    = schema_->projected_element_count;
+      header.inserted_element_count     = element_count;
+      header.false_positive_probability = schema_->false_positive_probability;
+      header.salt_count                 = schema_->salt_count;
+
+      std::vector<unsigned char> header_block(bloom_filter_file_header::table_offset,0);
+      std::memcpy(&header_block[0],&header,sizeof(header));
+
+      bloom_io_queue writer;
+      std::vector<unsigned char> staging(staging_chunks * chunk_size);
+      std::vector<std::size_t> taken;
+
+      writer.write(fd,&header_block[0],header_block.size(),0);
+
+      bool result = true;
+      std::size_t staged = 0;
+      std::size_t run_begin = 0;
+      std::size_t run_length = 0;
+
+      for (std::size_t chunk = 0; chunk <= dirty_.size(); ++chunk)
+      {
+         const bool dirty = (chunk < dirty_.size()) && (take_flag(dirty_[chunk]) || full);
+
+         if (dirty)
+            taken.push_back(chunk);
+
+         const bool extend = dirty && run_length && ((run_begin + run_length) == chunk) &&
+                             (run_length < max_run_chunks) && (staged < staging_chunks);
+
+         if (!extend && run_length)
+         {
+            // Close the current run: queue one write for its staged copy.
+            const std::size_t begin = run_begin * chunk_size;
+            const std::size_t bytes = static_cast<std::size_t>(std::min<unsigned long long int>(run_length * chunk_size,schema_->raw_table_size - begin));
+
+            writer.write(fd,&staging[(staged - run_length) * chunk_size],bytes,bloom_filter_file_header::table_offset + begin);
+            run_length = 0;
+         }
+
+         if (dirty && (staged == staging_chunks))
+         {
+            result = writer.flush() && result;
+            staged = 0;
+         }
+
+         if (dirty)
+         {
+            if (0 == run_length)
+               run_begin = chunk;
+
+            const std::size_t begin = chunk * chunk_size;
+            const std::size_t bytes = static_cast<std::size_t>(std::min<unsigned long long int>(chunk_size,schema_->raw_table_size - begin));
+
+            std::memcpy(&staging[staged * chunk_size],table() + begin,bytes);
+            ++staged;
+            ++run_length;
+         }
+      }
+
+      result = writer.flush() && result;
+      result = result && (0 == ::fdatasync(fd));
+
+      ::close(fd);
+
+      manifest_t manifest;
+      manifest.epoch                  = epoch_ + 1;
+      manifest.inserted_element_count = element_count;
+      manifest.table_size             = schema_->table_size;
+      manifest.random_seed            = schema_->random_seed;
+      manifest.salt_count             = schema_->salt_count;
+
+      result = result && write_manifest(file_name,manifest);
+
+      if (result)
+      {
+         epoch_          = manifest.epoch;
+         last_file_name_ = file_name;
+      }
+      else
+      {
+         for (std::size_t i = 0; i < taken.size(); ++i)
+         {
+            mark_flag(dirty_[taken[i]]);
+         }
+      }
+
+      return result;
+   }
+
+   static inline bool write_manifest(const std::string& file_name, const manifest_t& manifest)
+   {
+      const std::string manifest_name  = file_name + ".manifest";
+      const std::string temporary_name = manifest_name + ".tmp";
+
+      FILE* file = std::fopen(temporary_name.c_str(),"w");
+
+      if (0 == file)
+         return false;
+
+      std::fprintf(file,"open_bloom_filter_checkpoint 1\n"
+                        "epoch %llu\n"
+                        "inserted_element_count %llu\n"
+                        "table_size %llu\n"
+                        "random_seed %llu\n"
+                        "salt_count %u\n"
+                        "end\n",
+                   manifest.epoch,
+                   manifest.inserted_element_count,
+                   manifest.table_size,
+                   manifest.random_seed,
+                   manifest.salt_count);
+
+      bool result = (0 == std::fflush(file)) && (0 == ::fsync(fileno(file)));
+      result = (0 == std::fclose(file)) && result;
+      result = result && (0 == std::rename(temporary_name.c_str(),manifest_name.c_str()));
+
+      if (result)
+      {
+         // Persist the rename itself.
+         sync_directory(manifest_name);
+      }
+
+      return result;
+   }
+
+   static inline bool remove_manifest(const std::string& file_name)
+   {
+      const std::string manifest_name = file_name + ".manifest";
+
+      if (0 != ::unlink(manifest_name.c_str()))
+         return (ENOENT == errno);
+
+      // The removal must be durable before the data file is truncated.
+      return sync_directory(manifest_name);
+   }
+
+   static inline bool sync_directory(const std::string& file_name)
+   {
+      const std::size_t slash = file_name.rfind('/');
+      const std::string directory = (std::string::npos == slash) ? std::string(".") : file_name.substr(0,slash + 1);
+      const int fd = ::open(directory.c_str(),O_RDONLY);
+
+      if (fd < 0)
+         return false;
+
+      const bool result = (0 == ::fsync(fd));
+      ::close(fd);
+
+      return result;
+   }
+
+   static inline bool read_manifest(const std::string& file_name, manifest_t& manifest)
+   {
+      FILE* file = std::fopen((file_name + ".manifest").c_str(),"r");
+
+      if (0 == file)
+         return false;
+
+      unsigned int version = 0;
+      char end[4] = { 0 };
+
+      const int fields = std::fscanf(file,"open_bloom_filter_checkpoint %u "
+                                          "epoch %llu "
+                                          "inserted_element_count %llu "
+                                          "table_size %llu "
+                                          "random_seed %llu "
+                                          "salt_count %u "
+                                          "%3s",
+                                     &version,
+                                     &manifest.epoch,
+                                     &manifest.inserted_element_count,
+                                     &manifest.table_size,
+                                     &manifest.random_seed,
+                                     &manifest.salt_count,
+                                     end);
+
+      std::fclose(file);
+
+      return (7 == fields) && (1 == version) && (0 == std::strcmp(end,"end"));
+   }
+
+   static inline bool read_fully(const int fd, unsigned char* data, std::size_t length, unsigned long long int offset)
+   {
+      while (length)
+      {
+         const ssize_t n = ::pread(fd,data,length,static_cast<off_t>(offset));
+
+         if (n > 0)
+         {
+            data   += n;
+            length -= static_cast<std::size_t>(n);
+            offset += static_cast<unsigned long long int>(n);
+         }
+         else if ((n < 0) && (EINTR == errno))
+            continue;
+         else
+            return false;
+      }
+
+      return true;
+   }
+
+   std::vector<unsigned char> dirty_;
+   unsigned long long int     epoch_;
+   std::string                file_name_;
+   std::string                last_file_name_;
+   pthread_t                  thread_;
+   bool                       joinable_;
+   bool                       active_;
+   bool                       result_;
+};
+
+#endif
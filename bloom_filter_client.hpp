@@ -0,0 +1,393 @@
+/*
+ *********************************************************************
+ *                                                                   *
+ *                           Open Bloom Filter                       *
+ *                                                                   *
+ * Author: Arash Partow - 2000                                       *
+ * URL: http://www.partow.net                                        *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html   *
+ *                                                                   *
+ * Copyright notice:                                                 *
+ * Free use of the Open Bloom Filter Library is permitted under the  *
+ * guidelines and in accordance with the most current version of the *
+ * Common Public License.                                            *
+ * http://www.opensource.org/licenses/cpl1.0.php                     *
+ *                                                                   *
+ *********************************************************************
+*/
+
+
+#ifndef INCLUDE_BLOOM_FILTER_CLIENT_HPP
+#define INCLUDE_BLOOM_FILTER_CLIENT_HPP
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+
+
+/*
+   Note:
+   Binary protocol of bloom_filter_server, spoken over a Unix domain
+   stream socket in host byte order. A request is
+
+      bloom_request_header
+      filter name                     (name_length bytes)
+      key lengths                     (key_count x unsigned int)
+      key bytes                       (concatenated)
+
+   and is answered by
+
+      bloom_response_header
+      result bitmap                   (contains: bit i set when key i
+                                       is possibly in the filter)
+
+   A connection may carry any number of requests; responses are sent
+   in request order. Batching thousands of keys per request amortises
+   the system calls over the keys.
+*/
+
+struct bloom_protocol
+{
+   enum opcode_t
+   {
+      e_contains = 1,
+      e_insert   = 2
+   };
+
+   enum status_t
+   {
+      e_ok             = 0,
+      e_unknown_filter = 1,
+      e_read_only      = 2,
+      e_malformed      = 3,
+      e_io_error       = 255  // client side only
+   };
+
+   static const unsigned int request_magic  = 0x51464C42;  // "BLFQ"
+   static const unsigned int response_magic = 0x52464C42;  // "BLFR"
+
+   // Upper bounds enforced by the server.
+   static const unsigned int max_payload_length = 64 * 1024 * 1024;
+   static const unsigned int max_key_count      = 1024 * 1024;
+};
+
+struct bloom_request_header
+{
+   unsigned int   magic;
+   unsigned char  opcode;
+   unsigned char  name_length;
+   unsigned short reserved;
+   unsigned int   key_count;
+   unsigned int   payload_length;  // bytes following the header
+};
+
+struct bloom_response_header
+{
+   unsigned int   magic;
+   unsigned char  status;
+   unsigned char  reserved[3];
+   unsigned int   key_count;
+   unsigned int   payload_length;  // bytes following the header
+};
+
+class bloom_filter_client
+{
+   /*
+     Note:
+     Blocking client for bloom_filter_server. Keys are sent as bytes,
+     i.e. a key is hashed as bloom_filter::insert(const char*,length)
+     would hash it, whatever its type on the client side. Ranges larger
+     than batch_size() keys are split over several requests.
+   */
+
+public:
+
+   bloom_filter_client()
+   : socket_(-1),
+     status_(bloom_protocol::e_ok),
+     batch_size_(16384)
+   {}
+
+  ~bloom_filter_client()
+   {
+      close();
+   }
+
+   inline bool connect(const std::string& socket_path)
+   {
+      close();
+
+      sockaddr_un address;
+      std::memset(&address,0,sizeof(address));
+
+      if (socket_path.size() >= sizeof(address.sun_path))
+         return false;
+
+      address.sun_family = AF_UNIX;
+      std::memcpy(address.sun_path,socket_path.c_str(),socket_path.size());
+
+      socket_ = ::socket(AF_UNIX,SOCK_STREAM,0);
+
+      if (socket_ < 0)
+         return false;
+
+      if (0 != ::connect(socket_,reinterpret_cast<const sockaddr*>(&address),sizeof(address)))
+      {
+         close();
+         return false;
+      }
+
+      return true;
+   }
+
+   inline void close()
+   {
+      if (socket_ >= 0)
+      {
+         ::close(socket_);
+         socket_ = -1;
+      }
+   }
+
+   inline bool operator!() const
+   {
+      return (socket_ < 0);
+   }
+
+   template<typename InputIterator>
+   inline bool contains(const std::string& filter_name, const InputIterator begin, const InputIterator end, bool* results)
+   {
+      // Note: Writes the answer for the i-th key to results[i].
+      return transact(bloom_protocol::e_contains,filter_name,begin,end,results);
+   }
+
+   template<typename T>
+   inline bool contains(const std::string& filter_name, const T& key, bool& result)
+   {
+      const bloom_key_view view = details::make_key_view(key);
+      return contains(filter_name,&view,&view + 1,&result);
+   }
+
+   template<typename InputIterator>
+   inline bool insert(const std::string& filter_name, const InputIterator begin, const InputIterator end)
+   {
+      return transact(bloom_protocol::e_insert,filter_name,begin,end,0);
+   }
+
+   template<typename T>
+   inline bool insert(const std::string& filter_name, const T& key)
+   {
+      const bloom_key_view view = details::make_key_view(key);
+      return insert(filter_name,&view,&view + 1);
+   }
+
+   inline int last_status() const
+   {
+      // bloom_protocol::status_t of the last failed (or successful) request.
+      return status_;
+   }
+
+   inline void set_batch_size(const std::size_t batch_size)
+   {
+      batch_size_ = std::max<std::size_t>(1,std::min<std::size_t>(batch_size,bloom_protocol::max_key_count));
+   }
+
+   inline std::size_t batch_size() const
+   {
+      return batch_size_;
+   }
+
+private:
+
+   template<typename InputIterator>
+   inline bool transact(const unsigned char opcode,
+                        const std::string& filter_name,
+                        const InputIterator begin,
+                        const InputIterator end,
+                        bool* results)
+   {
+      if ((socket_ < 0) || (filter_name.size() > 255))
+      {
+         status_ = bloom_protocol::e_io_error;
+         return false;
+      }
+
+      InputIterator itr = begin;
+      std::size_t result_offset = 0;
+
+      while (end != itr)
+      {
+         keys_.clear();
+         std::size_t key_bytes = 0;
+
+         for ( ; (end != itr) && (keys_.size() < batch_size_); ++itr)
+         {
+            keys_.push_back(details::make_key_view(*itr));
+            key_bytes += keys_.back().length;
+
+            if (key_bytes > (bloom_protocol::max_payload_length / 2))
+            {
+               ++itr;
+               break;
+            }
+         }
+
+         if (!send_request(opcode,filter_name,key_bytes) ||
+             !receive_response(results ? (results + result_offset) : 0))
+         {
+            return false;
+         }
+
+         result_offset += keys_.size();
+      }
+
+      return true;
+   }
+
+   inline bool send_request(const unsigned char opcode, const std::string& filter_name, const std::size_t key_bytes)
+   {
+      bloom_request_header header;
+      header.magic          = bloom_protocol::request_magic;
+      header.opcode         = opcode;
+      header.name_length    = static_cast<unsigned char>(filter_name.size());
+      header.reserved       = 0;
+      header.key_count      = static_cast<unsigned int>(keys_.size());
+      header.payload_length = static_cast<unsigned int>(filter_name.size() + (keys_.size() * sizeof(unsigned int)) + key_bytes);
+
+      buffer_.resize(sizeof(header) + header.payload_length);
+
+      char* cursor = &buffer_[0];
+
+      std::memcpy(cursor,&header,sizeof(header));
+      cursor += sizeof(header);
+
+      std::memcpy(cursor,filter_name.data(),filter_name.size());
+      cursor += filter_name.size();
+
+      for (std::size_t i = 0; i < keys_.size(); ++i)
+      {
+         const unsigned int length = static_cast<unsigned int>(keys_[i].length);
+         std::memcpy(cursor,&length,sizeof(length));
+         cursor += sizeof(length);
+      }
+
+      for (std::size_t i = 0; i < keys_.size(); ++i)
+      {
+         std::memcpy(cursor,keys_[i].data,keys_[i].length);
+         cursor += keys_[i].length;
+      }
+
+      if (!write_all(&buffer_[0],buffer_.size()))
+      {
+         status_ = bloom_protocol::e_io_error;
+         return false;
+      }
+
+      return true;
+   }
+
+   inline bool receive_response(bool* results)
+   {
+      bloom_response_header header;
+
+      if (!read_all(reinterpret_cast<char*>(&header),sizeof(header)) ||
+          (bloom_protocol::response_magic != header.magic) ||
+          (header.payload_length > bloom_protocol::max_payload_length))
+      {
+         status_ = bloom_protocol::e_io_error;
+         close();
+         return false;
+      }
+
+      buffer_.resize(header.payload_length);
+
+      if (header.payload_length && !read_all(&buffer_[0],header.payload_length))
+      {
+         status_ = bloom_protocol::e_io_error;
+         close();
+         return false;
+      }
+
+      status_ = header.status;
+
+      if (bloom_protocol::e_ok != header.status)
+         return false;
+
+      if (results)
+      {
+         if ((header.key_count != keys_.size()) || (header.payload_length < ((keys_.size() + 7) / 8)))
+         {
+            status_ = bloom_protocol::e_malformed;
+            return false;
+         }
+
+         for (std::size_t i = 0; i < keys_.size(); ++i)
+         {
+            results[i] = (0 != (static_cast<unsigned char>(buffer_[i / 8]) & bit_mask[i % 8]));
+         }
+      }
+
+      return true;
+   }
+
+   inline bool write_all(const char* data, std::size_t length)
+   {
+      while (length)
+      {
+         const ssize_t n = ::send(socket_,data,length,MSG_NOSIGNAL);
+
+         if (n < 0)
+         {
+            if (EINTR == errno)
+               continue;
+
+            close();
+            return false;
+         }
+
+         data   += n;
+         length -= static_cast<std::size_t>(n);
+      }
+
+      return true;
+   }
+
+   inline bool read_all(char* data, std::size_t length)
+   {
+      while (length)
+      {
+         const ssize_t n = ::recv(socket_,data,length,0);
+
+         if (n <= 0)
+         {
+            if ((n < 0) && (EINTR == errno))
+               continue;
+
+            return false;
+         }
+
+         data   += n;
+         length -= static_cast<std::size_t>(n);
+      }
+
+      return true;
+   }
+
+   bloom_filter_client(const bloom_filter_client&);
+   bloom_filter_client& operator=(const bloom_filter_client&);
+
+   int                         socket_;
+   int                         status_;
+   std::size_t                 batch_size_;
+   std::vector<bloom_key_view> keys_;
+   std::vector<char>           buffer_;
+};
+
+#endif
@@ -72,7 +72,6 @@ int main(int argc, char* argv[])
 
    generate_outliers(word_list,outliers);
 
-   unsigned int random_seed = 0;
    std::size_t word_list_storage_size = 0;
 
    for (unsigned int i = 0; i < word_list.size(); ++i)
@@ -80,70 +79,62 @@ int main(int argc, char* argv[])
       word_list_storage_size += word_list[i].size();
    }
 
-   unsigned int total_number_of_queries = 0;
-
    const double desired_probability_of_false_positive = 1.0 / word_list.size();
 
-   printf("Round\t   Queries\t   FPQ\t   IPFP\t           PFP\t            DPFP\t    TvD\n");
-
-   unsigned int max_false_positive_count = 0;
-   unsigned int min_false_positive_count = std::numeric_limits<unsigned int>::max();
-   unsigned int total_false_positive = 0;
-   unsigned int total_zero_fp = 0;
-   unsigned long long int bloom_filter_size = 0;
-
-
    static const unsigned int rounds = 1000;
 
-   while (random_seed < rounds)
-   {
-      bloom_parameters parameters;
-      parameters.projected_element_count    = word_list.size();
-      parameters.false_positive_probability = desired_probability_of_false_positive;
-      parameters.random_seed                = ++random_seed;
-
-      if (!parameters)
-      {
-         std::cout << "Error - Invalid set of bloom filter parameters!" << std::endl;
-         return 1;
-      }
+   bloom_parameters parameters;
+   parameters.projected_element_count    = word_list.size();
+   parameters.false_positive_probability = desired_probability_of_false_positive;
 
-      parameters.compute_optimal_parameters();
+   if (!parameters)
+   {
+      std::cout << "Error - Invalid set of bloom filter parameters!" << std::endl;
+      return 1;
+   }
 
-      bloom_filter filter(parameters);
+   parameters.compute_optimal_parameters();
 
-      filter.insert(word_list.begin(),word_list.end());
+   // Run all rounds, spread across the available processors.
+   const seed_search_result search = find_best_seed(word_list,outliers,parameters,rounds);
 
-      std::vector<std::string>::iterator it = filter.contains_all(word_list.begin(),word_list.end());
-      if (word_list.end() != it)
+   for (std::size_t i = 0; i < search.trials.size(); ++i)
+   {
+      if (search.trials[i].false_negative_count)
       {
-         std::cout << "ERROR: key not found in bloom filter! =>" << (*it) << std::endl;
+         std::cout << "ERROR: " << search.trials[i].false_negative_count
+                   << " keys not found in bloom filter with seed " << search.trials[i].seed << std::endl;
          return 1;
       }
+   }
 
-      unsigned int current_total_false_positive = 0;
+   printf("Round\t   Queries\t   FPQ\t   IPFP\t           PFP\t            DPFP\t    TvD\n");
 
-      for (std::deque<std::string>::iterator it = outliers.begin(); it != outliers.end(); ++it)
-      {
-         if (filter.contains(*it))
-         {
-            ++current_total_false_positive;
-         }
-      }
+   unsigned long long int total_number_of_queries = 0;
+   unsigned int max_false_positive_count = 0;
+   unsigned int min_false_positive_count = std::numeric_limits<unsigned int>::max();
+   unsigned int total_false_positive = 0;
+   unsigned int total_zero_fp = 0;
+   unsigned long long int bloom_filter_size = search.table_size;
+
+   for (std::size_t i = 0; i < search.trials.size(); ++i)
+   {
+      const seed_trial& trial = search.trials[i];
+      const unsigned int current_total_false_positive = static_cast<unsigned int>(trial.false_positive_count);
 
       total_number_of_queries += (outliers.size() + word_list.size());
 
       // Overall false positive probability
-      double pfp = current_total_false_positive / (1.0 * outliers.size());
+      double pfp = trial.false_positive_probability;
 
       printf("%6llu\t%10llu\t%6d\t%8.7f\t%8.7f\t%9.3f%%\t%8.6f\n",
-              static_cast<unsigned long long>(random_seed),
+              static_cast<unsigned long long>(trial.seed),
               static_cast<unsigned long long>(total_number_of_queries),
               current_total_false_positive,
               desired_probability_of_false_positive,
               pfp,
               (100.0 * pfp) / desired_probability_of_false_positive,
-              (100.0 * filter.size()) / (bits_per_char * word_list_storage_size));
+              (100.0 * bloom_filter_size) / (bits_per_char * word_list_storage_size));
 
       if (current_total_false_positive < min_false_positive_count)
          min_false_positive_count = current_total_false_positive;
@@ -154,8 +145,6 @@ int main(int argc, char* argv[])
 
      if (0 == current_total_false_positive)
         ++total_zero_fp;
-
-     bloom_filter_size = filter.size();
    }
 
    double average_fpc = (1.0 * total_false_positive) / rounds;
@@ -163,14 +152,15 @@ int main(int argc, char* argv[])
 
    printf("Bloom Filter Statistics\n"
           "MinFPC: %d\tMaxFPC: %d\tAverageFPC: %8.5f\tAverageFPP: %9.8f Zero-FPC:%d\n"
-          "Filter Size: %lluKB\tData Size: %dKB\n",
+          "Filter Size: %lluKB\tData Size: %dKB\tBest Seed: %llu\n",
           min_false_positive_count,
           max_false_positive_count,
           average_fpc,
           average_fpp,
           total_zero_fp,
           bloom_filter_size / (8 * 1024),
-          static_cast<unsigned int>(word_list_storage_size / 1024));
+          static_cast<unsigned int>(word_list_storage_size / 1024),
+          static_cast<unsigned long long>(search.best().seed));
 
    /*
       Terminology
@@ -0,0 +1,530 @@
+/*
+ **************************************************************************
+ *                                                                        *
+ *                           Open Bloom Filter                            *
+ *                                                                        *
+ * Description: Round trips through the stateful filters                  *
+ * Author: Arash Partow - 2000                                            *
+ * URL: http://www.partow.net                                             *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html        *
+ *                                                                        *
+ * Copyright notice:                                                      *
+ * Free use of the Bloom Filter Library is permitted under the guidelines *
+ * and in accordance with the most current version of the Common Public   *
+ * License.                                                               *
+ * http://www.opensource.org/licenses/cpl1.0.php                          *
+ *                                                                        *
+ **************************************************************************
+*/
+
+
+
+/*
+   Description: This example takes the filters that can change after they
+                were first filled (erase, resize, merge, checkpoint and
+                recover, paged and buffered inserts, cached lookups)
+                through those operations and checks after each step that
+                every key still present is reported as present, i.e. that
+                no operation introduces a false negative. The program
+                returns 1 on the first false negative found.
+*/
+
+
+#include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+#include "bloom_filter_checkpoint.hpp"
+#include "bloom_filter_paged.hpp"
+
+bool check_quotient_filter();
+bool check_checkpointed_filter();
+bool check_paged_filter();
+bool check_buffered_filter();
+bool check_cached_filter();
+
+void generate_keys(const std::string& prefix, const std::size_t count, std::vector<std::string>& keys);
+
+template<typename Filter>
+bool verify(const std::string& stage, const Filter& filter, const std::vector<std::string>& keys);
+
+int main()
+{
+   if (!check_quotient_filter())
+      return 1;
+
+   if (!check_checkpointed_filter())
+      return 1;
+
+   if (!check_paged_filter())
+      return 1;
+
+   if (!check_buffered_filter())
+      return 1;
+
+   if (!check_cached_filter())
+      return 1;
+
+   std::cout << "No false negatives found." << std::endl;
+
+   return 0;
+}
+
+bool check_quotient_filter()
+{
+   bloom_parameters parameters;
+   parameters.projected_element_count    = 1000;
+   parameters.false_positive_probability = 0.01;
+   parameters.random_seed                = 0xA5A5A5A5;
+
+   std::vector<std::string> keys;
+   generate_keys("quotient",1000,keys);
+
+   // Find two keys sharing a fingerprint: with a single key inserted
+   // the filter reports exactly the keys with the same fingerprint.
+   std::string key_a;
+   std::string key_b;
+
+   for (std::size_t i = 0; (i < 1000000) && key_b.empty(); ++i)
+   {
+      quotient_filter probe(parameters);
+
+      char buffer[32];
+      std::sprintf(buffer,"collision-a-%u",static_cast<unsigned int>(i));
+      probe.insert(std::string(buffer));
+
+      for (std::size_t j = 0; j < 4096; ++j)
+      {
+         std::sprintf(buffer,"collision-b-%u",static_cast<unsigned int>(j));
+
+         if (probe.contains(std::string(buffer)))
+         {
+            std::sprintf(buffer,"collision-a-%u",static_cast<unsigned int>(i));
+            key_a = buffer;
+            std::sprintf(buffer,"collision-b-%u",static_cast<unsigned int>(j));
+            key_b = buffer;
+            break;
+         }
+      }
+   }
+
+   if (key_b.empty())
+   {
+      std::cout << "ERROR: quotient_filter - no fingerprint collision found" << std::endl;
+      return false;
+   }
+
+   quotient_filter filter(parameters);
+
+   if (!filter.insert(keys.begin(),keys.end()) || !filter.insert(key_a) || !filter.insert(key_b))
+   {
+      std::cout << "ERROR: quotient_filter - insert failed" << std::endl;
+      return false;
+   }
+
+   if (!verify("quotient_filter insert",filter,keys))
+      return false;
+
+   // Erasing one of two keys with the same fingerprint keeps the other.
+   filter.erase(key_a);
+
+   if (!filter.contains(key_b))
+   {
+      std::cout << "ERROR: quotient_filter - erase removed a colliding key" << std::endl;
+      return false;
+   }
+
+   // Erase every other key, the remainder must all still be present.
+   std::vector<std::string> remaining;
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      if (i & 1)
+         remaining.push_back(keys[i]);
+      else if (!filter.erase(keys[i]))
+      {
+         std::cout << "ERROR: quotient_filter - erase of inserted key failed: " << keys[i] << std::endl;
+         return false;
+      }
+   }
+
+   remaining.push_back(key_b);
+
+   if (!verify("quotient_filter erase",filter,remaining))
+      return false;
+
+   if (!filter.double_size() || !verify("quotient_filter double_size",filter,remaining))
+      return false;
+
+   std::vector<std::string> other_keys;
+   generate_keys("quotient-other",1000,other_keys);
+
+   quotient_filter other(parameters);
+   other.insert(other_keys.begin(),other_keys.end());
+   other.insert(key_b);
+
+   if (!filter.merge(other))
+   {
+      std::cout << "ERROR: quotient_filter - merge failed" << std::endl;
+      return false;
+   }
+
+   remaining.insert(remaining.end(),other_keys.begin(),other_keys.end());
+
+   if (!verify("quotient_filter merge",filter,remaining))
+      return false;
+
+   // key_b was in both filters, so one erase leaves it present.
+   filter.erase(key_b);
+
+   return verify("quotient_filter merge/erase",filter,remaining);
+}
+
+bool check_checkpointed_filter()
+{
+   bloom_parameters parameters;
+   parameters.projected_element_count    = 100000;
+   parameters.false_positive_probability = 0.001;
+   parameters.random_seed                = 0xA5A5A5A5;
+   parameters.compute_optimal_parameters();
+
+   const std::string file_name = "bloom_filter_example04.checkpoint";
+
+   std::vector<std::string> keys;
+   generate_keys("checkpoint",50000,keys);
+
+   checkpointed_bloom_filter filter(parameters);
+   filter.insert(keys.begin(),keys.begin() + 25000);
+
+   if (!filter.checkpoint(file_name))
+   {
+      std::cout << "ERROR: checkpointed_bloom_filter - full checkpoint failed" << std::endl;
+      return false;
+   }
+
+   // Inserts while a background checkpoint runs, then an incremental one.
+   if (!filter.start_checkpoint(file_name))
+   {
+      std::cout << "ERROR: checkpointed_bloom_filter - background checkpoint not started" << std::endl;
+      return false;
+   }
+
+   filter.insert(keys.begin() + 25000,keys.end());
+
+   if (!filter.wait_checkpoint() || !filter.checkpoint(file_name))
+   {
+      std::cout << "ERROR: checkpointed_bloom_filter - incremental checkpoint failed" << std::endl;
+      return false;
+   }
+
+   checkpointed_bloom_filter recovered;
+
+   if (!recovered.recover(file_name))
+   {
+      std::cout << "ERROR: checkpointed_bloom_filter - recover failed" << std::endl;
+      return false;
+   }
+
+   if (!verify("checkpointed_bloom_filter recover",recovered,keys))
+      return false;
+
+   // clear() makes the next checkpoint a full one, operator|= must reach it too.
+   std::vector<std::string> other_keys;
+   generate_keys("checkpoint-other",50000,other_keys);
+
+   bloom_filter other(parameters);
+   other.insert(other_keys.begin(),other_keys.end());
+
+   filter.clear();
+   filter |= other;
+
+   if (!filter.checkpoint(file_name) || !recovered.recover(file_name))
+   {
+      std::cout << "ERROR: checkpointed_bloom_filter - checkpoint after clear failed" << std::endl;
+      return false;
+   }
+
+   const bool result = verify("checkpointed_bloom_filter clear/merge/recover",recovered,other_keys);
+
+   if (result && recovered.contains(keys[0]) && recovered.contains(keys[1]))
+   {
+      std::cout << "ERROR: checkpointed_bloom_filter - cleared keys still in checkpoint" << std::endl;
+      return false;
+   }
+
+   ::unlink(file_name.c_str());
+   ::unlink((file_name + ".manifest").c_str());
+
+   return result;
+}
+
+bool check_paged_filter()
+{
+   bloom_parameters parameters;
+   parameters.projected_element_count    = 100000;
+   parameters.false_positive_probability = 0.001;
+   parameters.random_seed                = 0xA5A5A5A5;
+
+   const std::string file_name = "bloom_filter_example04.paged";
+
+   std::vector<std::string> keys;
+   generate_keys("paged",50000,keys);
+
+   paged_bloom_filter filter;
+
+   if (!paged_bloom_filter::create(file_name,parameters) || !filter.open(file_name,true))
+   {
+      std::cout << "ERROR: paged_bloom_filter - create/open failed" << std::endl;
+      return false;
+   }
+
+   // One batch, then single keys: both paths share pages.
+   if (!filter.insert(keys.begin(),keys.begin() + 25000))
+   {
+      std::cout << "ERROR: paged_bloom_filter - batch insert failed" << std::endl;
+      return false;
+   }
+
+   for (std::size_t i = 25000; i < keys.size(); ++i)
+   {
+      if (!filter.insert(keys[i]))
+      {
+         std::cout << "ERROR: paged_bloom_filter - insert failed" << std::endl;
+         return false;
+      }
+   }
+
+   if (!verify("paged_bloom_filter insert",filter,keys))
+      return false;
+
+   static const std::size_t batch_size = 1000;
+
+   for (std::size_t i = 0; i < keys.size(); i += batch_size)
+   {
+      bool results[batch_size];
+
+      if (!filter.contains(keys.begin() + i,keys.begin() + i + batch_size,results))
+      {
+         std::cout << "ERROR: paged_bloom_filter - batch contains failed" << std::endl;
+         return false;
+      }
+
+      for (std::size_t j = 0; j < batch_size; ++j)
+      {
+         if (!results[j])
+         {
+            std::cout << "ERROR: paged_bloom_filter batch contains - key not found in filter! =>" << keys[i + j] << std::endl;
+            return false;
+         }
+      }
+   }
+
+   filter.close();
+
+   paged_bloom_filter reopened;
+
+   if (!reopened.open(file_name,false) || !verify("paged_bloom_filter reopen",reopened,keys))
+      return false;
+
+   reopened.close();
+
+   // An insert whose pages cannot be read must fail without writing them back.
+   if (!filter.open(file_name,true) || (0 != ::truncate(file_name.c_str(),paged_filter_file_header::table_offset)))
+   {
+      std::cout << "ERROR: paged_bloom_filter - reopen failed" << std::endl;
+      return false;
+   }
+
+   const bool inserted = filter.insert(keys[0]);
+
+   struct stat status;
+   const bool written = (0 != ::stat(file_name.c_str(),&status)) || (status.st_size > paged_filter_file_header::table_offset);
+
+   filter.close();
+   ::unlink(file_name.c_str());
+
+   if (inserted || written)
+   {
+      std::cout << "ERROR: paged_bloom_filter - insert after failed read wrote pages" << std::endl;
+      return false;
+   }
+
+   return true;
+}
+
+bool check_buffered_filter()
+{
+   bloom_parameters parameters;
+   parameters.projected_element_count    = 100000;
+   parameters.false_positive_probability = 0.001;
+   parameters.random_seed                = 0xA5A5A5A5;
+   parameters.compute_optimal_parameters();
+
+   std::vector<std::string> keys;
+   generate_keys("buffered",50000,keys);
+
+   // Small regions, so that most bits are still buffered when queried.
+   buffered_bloom_filter filter(parameters,4096);
+   bloom_filter reference(parameters);
+
+   filter.insert(keys.begin(),keys.end());
+   reference.insert(keys.begin(),keys.end());
+
+   if (0 == filter.pending())
+   {
+      std::cout << "ERROR: buffered_bloom_filter - no bits buffered" << std::endl;
+      return false;
+   }
+
+   // A byte key lookup through the base class applies the buffers too.
+   const bloom_filter& base = filter;
+
+   if (!verify("buffered_bloom_filter base lookup",base,keys))
+      return false;
+
+   filter.insert(keys.begin(),keys.end());
+   reference.insert(keys.begin(),keys.end());
+
+   if (!verify("buffered_bloom_filter lookup",filter,keys))
+      return false;
+
+   filter.flush();
+
+   if ((0 != filter.pending()) || (filter != reference))
+   {
+      std::cout << "ERROR: buffered_bloom_filter - flushed table differs from bloom_filter" << std::endl;
+      return false;
+   }
+
+   return true;
+}
+
+bool check_cached_filter()
+{
+   bloom_parameters parameters;
+   parameters.projected_element_count    = 10000;
+   parameters.false_positive_probability = 0.0001;
+   parameters.random_seed                = 0xA5A5A5A5;
+   parameters.compute_optimal_parameters();
+
+   std::vector<bloom_uint64> keys;
+
+   for (unsigned long long int i = 0; i < 1000; ++i)
+   {
+      keys.push_back(bloom_uint64(i * 0x9E3779B97F4A7C15ULL));
+   }
+
+   cached_bloom_filter filter(parameters);
+   bloom_filter& base = filter;
+
+   // Cache a negative for every key, then change the table through the base class.
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      if (filter.contains(keys[i]))
+      {
+         std::cout << "ERROR: cached_bloom_filter - key found in empty filter" << std::endl;
+         return false;
+      }
+   }
+
+   // operator|= leaves element_count() unchanged.
+   bloom_filter other(parameters);
+
+   for (std::size_t i = 1; i < keys.size(); i += 2)
+   {
+      other.insert(keys[i]);
+   }
+
+   base |= other;
+
+   for (std::size_t i = 1; i < keys.size(); i += 2)
+   {
+      if (!filter.contains(keys[i]))
+      {
+         std::cout << "ERROR: cached_bloom_filter |= - key not found in filter! =>" << keys[i].value << std::endl;
+         return false;
+      }
+   }
+
+   for (std::size_t i = 0; i < keys.size(); i += 2)
+   {
+      base.insert(keys[i]);
+   }
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      if (!filter.contains(keys[i]))
+      {
+         std::cout << "ERROR: cached_bloom_filter insert - key not found in filter! =>" << keys[i].value << std::endl;
+         return false;
+      }
+   }
+
+   // Cached positives must not outlive a clear through the base class.
+   base.clear();
+   base = other;
+
+   std::size_t found = 0;
+
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      if (filter.contains(keys[i]) != (0 != (i & 1)))
+         ++found;
+   }
+
+   if (found > 1)
+   {
+      std::cout << "ERROR: cached_bloom_filter - " << found << " stale results after clear" << std::endl;
+      return false;
+   }
+
+   // A single 2-way set: alternating keys are answered from both ways.
+   cached_bloom_filter single_set(parameters,32);
+   single_set.insert(keys[0]);
+
+   for (std::size_t i = 0; i < 8; ++i)
+   {
+      if (!single_set.contains(keys[0]))
+      {
+         std::cout << "ERROR: cached_bloom_filter single set - key not found in filter! =>" << keys[0].value << std::endl;
+         return false;
+      }
+
+      single_set.contains(keys[1]);
+   }
+
+   return true;
+}
+
+void generate_keys(const std::string& prefix, const std::size_t count, std::vector<std::string>& keys)
+{
+   keys.reserve(keys.size() + count);
+
+   for (std::size_t i = 0; i < count; ++i)
+   {
+      char buffer[32];
+      std::sprintf(buffer,"-%08X",static_cast<unsigned int>(i * 0x9E3779B1));
+      keys.push_back(prefix + buffer);
+   }
+}
+
+template<typename Filter>
+bool verify(const std::string& stage, const Filter& filter, const std::vector<std::string>& keys)
+{
+   for (std::size_t i = 0; i < keys.size(); ++i)
+   {
+      if (!filter.contains(keys[i]))
+      {
+         std::cout << "ERROR: " << stage << " - key not found in filter! =>" << keys[i] << std::endl;
+         return false;
+      }
+   }
+
+   return true;
+}
@@ -0,0 +1,323 @@
+/*
+ *********************************************************************
+ *                                                                   *
+ *                           Open Bloom Filter                       *
+ *                                                                   *
+ * Author: Arash Partow - 2000                                       *
+ * URL: http://www.partow.net                                        *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html   *
+ *                                                                   *
+ * Copyright notice:                                                 *
+ * Free use of the Open Bloom Filter Library is permitted under the  *
+ * guidelines and in accordance with the most current version of the *
+ * Common Public License.                                            *
+ * http://www.opensource.org/licenses/cpl1.0.php                     *
+ *                                                                   *
+ *********************************************************************
+*/
+
+
+#ifndef INCLUDE_BLOOM_FILTER_IO_HPP
+#define INCLUDE_BLOOM_FILTER_IO_HPP
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+#if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+
+class bloom_io_queue
+{
+   /*
+     Note:
+     Positional reads and writes of caller owned buffers, which must
+     remain valid until flush() returns. With BLOOM_FILTER_IO_URING
+     defined (Linux) the requests are queued on an io_uring, keeping up
+     to queue_depth of them in flight; if the ring cannot be set up,
+     e.g. on older kernels or where it is disabled, and without the
+     define, each request is a blocking pread/pwrite. A ring whose
+     io_uring_enter fails is torn down and the blocking path used from
+     then on.
+   */
+
+public:
+
+   enum { queue_depth = 64 };
+
+   bloom_io_queue()
+   : failed_(false)
+   #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+   , ring_descriptor_(-1),
+     sq_ring_(0),
+     cq_ring_(0),
+     sqes_(0),
+     sq_ring_size_(0),
+     cq_ring_size_(0),
+     sqes_size_(0),
+     queued_(0),
+     in_flight_(0)
+   #endif
+   {
+      #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+      setup_ring();
+      #endif
+   }
+
+  ~bloom_io_queue()
+   {
+      #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+      flush();
+      teardown_ring();
+      #endif
+   }
+
+   inline bool uses_io_uring() const
+   {
+      #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+      return (ring_descriptor_ >= 0);
+      #else
+      return false;
+      #endif
+   }
+
+   inline void read(const int fd, unsigned char* data, const std::size_t length, const unsigned long long int offset)
+   {
+      queue(request(fd,data,length,offset,true));
+   }
+
+   inline void write(const int fd, const unsigned char* data, const std::size_t length, const unsigned long long int offset)
+   {
+      queue(request(fd,const_cast<unsigned char*>(data),length,offset,false));
+   }
+
+   inline bool flush()
+   {
+      // Waits for every queued request. Returns false if any failed.
+      #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+      while ((ring_descriptor_ >= 0) && (queued_ + in_flight_))
+      {
+         submit_and_wait(in_flight_ + queued_);
+      }
+
+      requests_.clear();
+      #endif
+
+      const bool result = !failed_;
+      failed_ = false;
+      return result;
+   }
+
+private:
+
+   struct request
+   {
+      request(const int f, unsigned char* d, const std::size_t l, const unsigned long long int o, const bool r)
+      : fd(f),
+        data(d),
+        length(l),
+        offset(o),
+        is_read(r)
+      {}
+
+      int                    fd;
+      unsigned char*         data;
+      std::size_t            length;
+      unsigned long long int offset;
+      bool                   is_read;
+   };
+
+   inline void queue(const request& r)
+   {
+      #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+      if (ring_descriptor_ >= 0)
+      {
+         if ((queued_ + in_flight_) >= sq_entries_)
+            submit_and_wait(1);
+
+         requests_.push_back(r);
+
+         const unsigned int tail  = *sq_tail_;
+         const unsigned int index = tail & sq_mask_;
+
+         io_uring_sqe& sqe = sqes_[index];
+         std::memset(&sqe,0,sizeof(sqe));
+         sqe.opcode    = r.is_read ? IORING_OP_READ : IORING_OP_WRITE;
+         sqe.fd        = r.fd;
+         sqe.addr      = reinterpret_cast<unsigned long long int>(r.data);
+         sqe.len       = static_cast<unsigned int>(r.length);
+         sqe.off       = r.offset;
+         sqe.user_data = requests_.size() - 1;
+
+         sq_array_[index] = index;
+         __atomic_store_n(sq_tail_,tail + 1,__ATOMIC_RELEASE);
+         ++queued_;
+
+         return;
+      }
+      #endif
+
+      transfer_fully(r,0);
+   }
+
+   inline void transfer_fully(const request& r, std::size_t done)
+   {
+      // Completes r with blocking calls, from byte done onwards.
+      while ((done < r.length) && !failed_)
+      {
+         const ssize_t n = r.is_read ?
+                           ::pread (r.fd,r.data + done,r.length - done,static_cast<off_t>(r.offset + done)) :
+                           ::pwrite(r.fd,r.data + done,r.length - done,static_cast<off_t>(r.offset + done)) ;
+
+         if (n > 0)
+            done += static_cast<std::size_t>(n);
+         else if ((n < 0) && (EINTR == errno))
+            continue;
+         else
+            failed_ = true;
+      }
+   }
+
+   #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+
+   inline void setup_ring()
+   {
+      io_uring_params parameters;
+      std::memset(&parameters,0,sizeof(parameters));
+
+      const long fd = ::syscall(__NR_io_uring_setup,static_cast<unsigned int>(queue_depth),&parameters);
+
+      if (fd < 0)
+         return;
+
+      ring_descriptor_ = static_cast<int>(fd);
+      sq_ring_size_    = parameters.sq_off.array + (parameters.sq_entries * sizeof(unsigned int));
+      cq_ring_size_    = parameters.cq_off.cqes  + (parameters.cq_entries * sizeof(io_uring_cqe));
+      sqes_size_       = parameters.sq_entries * sizeof(io_uring_sqe);
+
+      void* sq = ::mmap(0,sq_ring_size_,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ring_descriptor_,IORING_OFF_SQ_RING);
+      void* cq = ::mmap(0,cq_ring_size_,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ring_descriptor_,IORING_OFF_CQ_RING);
+      void* se = ::mmap(0,sqes_size_   ,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ring_descriptor_,IORING_OFF_SQES);
+
+      sq_ring_ = (MAP_FAILED == sq) ? 0 : static_cast<unsigned char*>(sq);
+      cq_ring_ = (MAP_FAILED == cq) ? 0 : static_cast<unsigned char*>(cq);
+      sqes_    = (MAP_FAILED == se) ? 0 : static_cast<io_uring_sqe*>(se);
+
+      if ((0 == sq_ring_) || (0 == cq_ring_) || (0 == sqes_))
+      {
+         teardown_ring();
+         return;
+      }
+
+      sq_tail_    = reinterpret_cast<unsigned int*>(sq_ring_ + parameters.sq_off.tail);
+      sq_array_   = reinterpret_cast<unsigned int*>(sq_ring_ + parameters.sq_off.array);
+      sq_mask_    = *reinterpret_cast<unsigned int*>(sq_ring_ + parameters.sq_off.ring_mask);
+      sq_entries_ = parameters.sq_entries;
+      cq_head_    = reinterpret_cast<unsigned int*>(cq_ring_ + parameters.cq_off.head);
+      cq_tail_    = reinterpret_cast<unsigned int*>(cq_ring_ + parameters.cq_off.tail);
+      cq_mask_    = *reinterpret_cast<unsigned int*>(cq_ring_ + parameters.cq_off.ring_mask);
+      cqes_       = reinterpret_cast<io_uring_cqe*>(cq_ring_ + parameters.cq_off.cqes);
+   }
+
+   inline void teardown_ring()
+   {
+      if (sqes_)    ::munmap(sqes_   ,sqes_size_   );
+      if (cq_ring_) ::munmap(cq_ring_,cq_ring_size_);
+      if (sq_ring_) ::munmap(sq_ring_,sq_ring_size_);
+
+      if (ring_descriptor_ >= 0)
+         ::close(ring_descriptor_);
+
+      sqes_            = 0;
+      cq_ring_         = 0;
+      sq_ring_         = 0;
+      ring_descriptor_ = -1;
+   }
+
+   inline void submit_and_wait(const unsigned int min_complete)
+   {
+      const long submitted = ::syscall(__NR_io_uring_enter,ring_descriptor_,queued_,min_complete,IORING_ENTER_GETEVENTS,0,0);
+
+      if (submitted < 0)
+      {
+         if (EINTR == errno)
+            return;
+
+         // The ring is unusable: complete everything still queued with blocking calls.
+         for (std::size_t i = requests_.size() - queued_; i < requests_.size(); ++i)
+         {
+            transfer_fully(requests_[i],0);
+         }
+
+         queued_ = 0;
+      }
+      else
+      {
+         queued_    -= static_cast<unsigned int>(submitted);
+         in_flight_ += static_cast<unsigned int>(submitted);
+      }
+
+      unsigned int head = *cq_head_;
+
+      while (head != __atomic_load_n(cq_tail_,__ATOMIC_ACQUIRE))
+      {
+         const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+         const request& r = requests_[static_cast<std::size_t>(cqe.user_data)];
+
+         if ((cqe.res < 0) || (r.is_read && (0 == cqe.res) && r.length))
+            failed_ = true;
+         else if (static_cast<std::size_t>(cqe.res) < r.length)
+            transfer_fully(r,static_cast<std::size_t>(cqe.res));
+
+         ++head;
+         --in_flight_;
+      }
+
+      __atomic_store_n(cq_head_,head,__ATOMIC_RELEASE);
+
+      if (submitted < 0)
+      {
+         // Nothing more can be reaped from a failed ring.
+         if (in_flight_)
+            failed_ = true;
+
+         in_flight_ = 0;
+
+         // The fallback left its SQEs unconsumed: later requests take the blocking path.
+         teardown_ring();
+      }
+   }
+
+   #endif
+
+   bool failed_;
+
+   #if defined(__linux__) && defined(BLOOM_FILTER_IO_URING)
+   int                  ring_descriptor_;
+   unsigned char*       sq_ring_;
+   unsigned char*       cq_ring_;
+   io_uring_sqe*        sqes_;
+   std::size_t          sq_ring_size_;
+   std::size_t          cq_ring_size_;
+   std::size_t          sqes_size_;
+   unsigned int*        sq_tail_;
+   unsigned int*        sq_array_;
+   unsigned int         sq_mask_;
+   unsigned int         sq_entries_;
+   unsigned int*        cq_head_;
+   unsigned int*        cq_tail_;
+   unsigned int         cq_mask_;
+   io_uring_cqe*        cqes_;
+   unsigned int         queued_;
+   unsigned int         in_flight_;
+   std::vector<request> requests_;
+   #endif
+};
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ *********************************************************************
+ *                                                                   *
+ *                           Open Bloom Filter                       *
+ *                                                                   *
+ * Author: Arash Partow - 2000                                       *
+ * URL: http://www.partow.net                                        *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html   *
+ *                                                                   *
+ * Copyright notice:                                                 *
+ * Free use of the Open Bloom Filter Library is permitted under the  *
+ * guidelines and in accordance with the most current version of the *
+ * Common Public License.                                            *
+ * http://www.opensource.org/licenses/cpl1.0.php                     *
+ *                                                                   *
+ *********************************************************************
+*/
+
+
+#ifndef INCLUDE_BLOOM_FILTER_MAPPED_HPP
+#define INCLUDE_BLOOM_FILTER_MAPPED_HPP
+
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+
+
+struct bloom_filter_file_header
+{
+   /*
+     Note:
+     On-disk layout of a filter file: this header, padded to
+     table_offset bytes so that the table is page aligned, followed
+     by the raw bit table. Fields are in host byte order; the files
+     are meant for the host that wrote them.
+   */
+   enum { table_offset = 4096 };
+
+   bloom_filter_file_header()
+   : table_size(0),
+     random_seed(0),
+     projected_element_count(0),
+     inserted_element_count(0),
+     false_positive_probability(0.0),
+     salt_count(0),
+     reserved(0)
+   {
+      std::memcpy(magic,signature(),sizeof(magic));
+   }
+
+   static inline const char* signature()
+   {
+      return "OBLOOM01";
+   }
+
+   inline bool valid() const
+   {
+      return (0 == std::memcmp(magic,signature(),sizeof(magic))) &&
+             (table_size > 0) &&
+             (0 == (table_size % bits_per_char)) &&
+             (salt_count > 0);
+   }
+
+   char                   magic[8];
+   unsigned long long int table_size;
+   unsigned long long int random_seed;
+   unsigned long long int projected_element_count;
+   unsigned long long int inserted_element_count;
+   double                 false_positive_probability;
+   unsigned int           salt_count;
+   unsigned int           reserved;
+};
+
+class mapped_bloom_filter : public bloom_filter
+{
+   /*
+     Note:
+     A bloom_filter whose table is a shared memory mapping of a filter
+     file, so that several processes (or a filter server) can use one
+     copy of a large table. Inserts made through a writable mapping
+     reach the file through the page cache; sync() also records the
+     inserted element count in the header. Not copyable.
+   */
+
+public:
+
+   mapped_bloom_filter()
+   : file_descriptor_(-1),
+     mapping_(0),
+     mapping_size_(0),
+     writable_(false)
+   {}
+
+  ~mapped_bloom_filter()
+   {
+      close();
+   }
+
+   static inline bool create(const std::string& file_name, bloom_parameters parameters)
+   {
+      /*
+        Note:
+        Creates (or truncates) file_name as an empty filter sized from
+        parameters, whose optimal parameters are computed if not set.
+      */
+      if (0 == parameters.optimal_parameters.table_size)
+      {
+         if (!parameters.compute_optimal_parameters())
+            return false;
+      }
+
+      bloom_filter_file_header header;
+      header.table_size                 = parameters.optimal_parameters.table_size;
+      header.random_seed                = (parameters.random_seed * 0xA5A5A5A5) + 1;
+      header.projected_element_count    = parameters.projected_element_count;
+      header.false_positive_probability = parameters.false_positive_probability;
+      header.salt_count                 = parameters.optimal_parameters.number_of_hashes;
+
+      const int fd = ::open(file_name.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+
+      if (fd < 0)
+         return false;
+
+      const off_t file_size = static_cast<off_t>(bloom_filter_file_header::table_offset + (header.table_size / bits_per_char));
+
+      const bool result = (0 == ::ftruncate(fd,file_size)) &&
+                          (sizeof(header) == static_cast<std::size_t>(::pwrite(fd,&header,sizeof(header),0)));
+
+      ::close(fd);
+
+      return result;
+   }
+
+   inline bool open(const std::string& file_name, const bool writable)
+   {
+      close();
+
+      file_descriptor_ = ::open(file_name.c_str(),writable ? O_RDWR : O_RDONLY);
+
+      if (file_descriptor_ < 0)
+         return false;
+
+      struct stat status;
+
+      if ((0 != ::fstat(file_descriptor_,&status)) ||
+          (static_cast<unsigned long long int>(status.st_size) <= bloom_filter_file_header::table_offset))
+      {
+         close();
+         return false;
+      }
+
+      void* mapping = ::mmap(0,static_cast<std::size_t>(status.st_size),
+                             writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                             MAP_SHARED,file_descriptor_,0);
+
+      if (MAP_FAILED == mapping)
+      {
+         close();
+         return false;
+      }
+
+      mapping_      = static_cast<unsigned char*>(mapping);
+      mapping_size_ = static_cast<std::size_t>(status.st_size);
+      writable_     = writable;
+
+      const bloom_filter_file_header& h = header();
+
+      if (!h.valid() || (mapping_size_ < (bloom_filter_file_header::table_offset + (h.table_size / bits_per_char))))
+      {
+         close();
+         return false;
+      }
+
+      schema_ = filter_schema::create(h.table_size,
+                                      h.salt_count,
+                                      h.random_seed,
+                                      h.projected_element_count,
+                                      h.false_positive_probability);
+      inserted_element_count_ = static_cast<unsigned int>(h.inserted_element_count);
+
+      bit_table_ = reinterpret_cast<word_type*>(mapping_ + bloom_filter_file_header::table_offset);
+
+      return true;
+   }
+
+   inline bool sync()
+   {
+      if ((0 == mapping_) || !writable_)
+         return false;
+
+      bloom_filter_file_header& h = *reinterpret_cast<bloom_filter_file_header*>(mapping_);
+      h.inserted_element_count = inserted_element_count_;
+
+      return (0 == ::msync(mapping_,mapping_size_,MS_SYNC));
+   }
+
+   inline void close()
+   {
+      if (mapping_)
+      {
+         if (writable_)
+            sync();
+
+         ::munmap(mapping_,mapping_size_);
+      }
+
+      if (file_descriptor_ >= 0)
+         ::close(file_descriptor_);
+
+      // The table belongs to the mapping, not to bloom_filter.
+      bit_table_       = 0;
+      schema_          = filter_schema_ptr();
+      mapping_         = 0;
+      mapping_size_    = 0;
+      file_descriptor_ = -1;
+      writable_        = false;
+   }
+
+   inline bool writable() const
+   {
+      return writable_;
+   }
+
+   inline const bloom_filter_file_header& header() const
+   {
+      return *reinterpret_cast<const bloom_filter_file_header*>(mapping_);
+   }
+
+private:
+
+   mapped_bloom_filter(const mapped_bloom_filter&);
+   mapped_bloom_filter& operator=(const mapped_bloom_filter&);
+
+   int            file_descriptor_;
+   unsigned char* mapping_;
+   std::size_t    mapping_size_;
+   bool           writable_;
+};
+
+#endif
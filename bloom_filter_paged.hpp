@@ -0,0 +1,546 @@
+/*
+ *********************************************************************
+ *                                                                   *
+ *                           Open Bloom Filter                       *
+ *                                                                   *
+ * Author: Arash Partow - 2000                                       *
+ * URL: http://www.partow.net                                        *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html   *
+ *                                                                   *
+ * Copyright notice:                                                 *
+ * Free use of the Open Bloom Filter Library is permitted under the  *
+ * guidelines and in accordance with the most current version of the *
+ * Common Public License.                                            *
+ * http://www.opensource.org/licenses/cpl1.0.php                     *
+ *                                                                   *
+ *********************************************************************
+*/
+
+
+#ifndef INCLUDE_BLOOM_FILTER_PAGED_HPP
+#define INCLUDE_BLOOM_FILTER_PAGED_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+#include "bloom_filter_io.hpp"
+
+
+struct paged_filter_file_header
+{
+   /*
+     Note:
+     On-disk layout of a paged filter file: this header, padded to
+     table_offset bytes, followed by page_count pages of page_size
+     bytes. Fields are in host byte order.
+   */
+   enum
+   {
+      page_size    = 4096,
+      table_offset = 4096
+   };
+
+   paged_filter_file_header()
+   : page_count(0),
+     random_seed(0),
+     projected_element_count(0),
+     inserted_element_count(0),
+     false_positive_probability(0.0),
+     hash_count(0),
+     reserved(0)
+   {
+      std::memcpy(magic,signature(),sizeof(magic));
+   }
+
+   static inline const char* signature()
+   {
+      return "OBLOOMP1";
+   }
+
+   inline bool valid() const
+   {
+      return (0 == std::memcmp(magic,signature(),sizeof(magic))) &&
+             (page_count > 0) &&
+             (hash_count > 0);
+   }
+
+   char                   magic[8];
+   unsigned long long int page_count;
+   unsigned long long int random_seed;
+   unsigned long long int projected_element_count;
+   unsigned long long int inserted_element_count;
+   double                 false_positive_probability;
+   unsigned int           hash_count;
+   unsigned int           reserved;
+};
+
+namespace details
+{
+   inline double paged_fpp(const unsigned long long int page_count,
+                           const unsigned long long int element_count,
+                           const unsigned int hash_count,
+                           const double page_bits)
+   {
+      /*
+        Note:
+        False positive probability of a filter whose keys each probe a
+        single page: the per-page FPP averaged over the Poisson
+        distributed number of keys per page. The spread of the page
+        loads makes this higher than for a classic filter of equal size.
+      */
+      if (0 == element_count)
+         return 0.0;
+
+      const double lambda = (1.0 * element_count) / page_count;
+      const double k      = hash_count;
+      const std::size_t mode = static_cast<std::size_t>(lambda);
+
+      // Poisson probability of the mode, accumulated in log space.
+      double log_p = (mode * std::log(lambda)) - lambda;
+
+      for (std::size_t i = 2; i <= mode; ++i)
+      {
+         log_p -= std::log(1.0 * i);
+      }
+
+      const double p_mode = std::exp(log_p);
+
+      double fpp = 0.0;
+      double p   = p_mode;
+
+      for (std::size_t j = mode; ; ++j)
+      {
+         fpp += p * std::pow(1.0 - std::exp(-k * j / page_bits),k);
+         p   *= lambda / (j + 1);
+
+         if (p < (p_mode * 1.0e-12))
+            break;
+      }
+
+      p = p_mode;
+
+      for (std::size_t j = mode; j > 0; --j)
+      {
+         p   *= j / lambda;
+         fpp += p * std::pow(1.0 - std::exp(-k * (j - 1) / page_bits),k);
+
+         if (p < (p_mode * 1.0e-12))
+            break;
+      }
+
+      return fpp;
+   }
+}
+
+class paged_bloom_filter
+{
+   /*
+     Note:
+     A disk-resident bloom filter for tables larger than memory. All k
+     probes of a key fall inside one 4 KiB page, chosen by a 64-bit
+     hash of the key, so a lookup costs one page read instead of up to
+     k. The table is accessed with positional reads and writes of whole
+     pages rather than through a mapping.
+
+     The batched contains/insert hash every key first, sort the keys by
+     page and read each distinct page once, coalescing adjacent pages,
+     with up to bloom_io_queue::queue_depth reads in flight. All keys
+     of a page are then resolved together, and pages modified by an
+     insert are written back.
+
+     Confining the probes to a page costs some accuracy: create() sizes
+     the table to reach the requested false positive probability under
+     the page-blocked model (details::paged_fpp), typically a few
+     percent larger than a bloom_filter for the same parameters.
+
+     Not thread safe, including contains, which reuses internal buffers.
+   */
+
+public:
+
+   enum
+   {
+      page_size = paged_filter_file_header::page_size,
+      page_bits = page_size * 8
+   };
+
+   paged_bloom_filter()
+   : file_descriptor_(-1),
+     writable_(false),
+     pages_read_(0)
+   {}
+
+  ~paged_bloom_filter()
+   {
+      close();
+   }
+
+   static inline bool create(const std::string& file_name, bloom_parameters parameters)
+   {
+      /*
+        Note:
+        Creates (or truncates) file_name as an empty paged filter. The
+        hash count comes from parameters' optimal parameters, which are
+        computed if not set.
+      */
+      if (0 == parameters.optimal_parameters.table_size)
+      {
+         if (!parameters.compute_optimal_parameters())
+            return false;
+      }
+
+      paged_filter_file_header header;
+      header.random_seed                = (parameters.random_seed * 0xA5A5A5A5) + 1;
+      header.projected_element_count    = parameters.projected_element_count;
+      header.false_positive_probability = parameters.false_positive_probability;
+      header.hash_count                 = parameters.optimal_parameters.number_of_hashes;
+      header.page_count                 = (parameters.optimal_parameters.table_size + page_bits - 1) / page_bits;
+
+      while (details::paged_fpp(header.page_count,
+                                header.projected_element_count,
+                                header.hash_count,
+                                page_bits) > header.false_positive_probability)
+      {
+         header.page_count += (header.page_count / 64) + 1;
+      }
+
+      const int fd = ::open(file_name.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+
+      if (fd < 0)
+         return false;
+
+      const off_t file_size = static_cast<off_t>(paged_filter_file_header::table_offset + (header.page_count * page_size));
+
+      const bool result = (0 == ::ftruncate(fd,file_size)) &&
+                          (sizeof(header) == static_cast<std::size_t>(::pwrite(fd,&header,sizeof(header),0)));
+
+      ::close(fd);
+
+      return result;
+   }
+
+   inline bool open(const std::string& file_name, const bool writable)
+   {
+      close();
+
+      file_descriptor_ = ::open(file_name.c_str(),writable ? O_RDWR : O_RDONLY);
+
+      if (file_descriptor_ < 0)
+         return false;
+
+      struct stat status;
+
+      if ((0 != ::fstat(file_descriptor_,&status)) ||
+          (sizeof(header_) != static_cast<std::size_t>(::pread(file_descriptor_,&header_,sizeof(header_),0))) ||
+          !header_.valid() ||
+          (static_cast<unsigned long long int>(status.st_size) < (paged_filter_file_header::table_offset + (header_.page_count * page_size))))
+      {
+         close();
+         return false;
+      }
+
+      // Lookups are random: read-ahead would only waste I/O bandwidth.
+      ::posix_fadvise(file_descriptor_,0,0,POSIX_FADV_RANDOM);
+
+      writable_   = writable;
+      pages_read_ = 0;
+
+      return true;
+   }
+
+   inline bool sync()
+   {
+      if ((file_descriptor_ < 0) || !writable_)
+         return false;
+
+      return (sizeof(header_) == static_cast<std::size_t>(::pwrite(file_descriptor_,&header_,sizeof(header_),0))) &&
+             (0 == ::fdatasync(file_descriptor_));
+   }
+
+   inline void close()
+   {
+      if (file_descriptor_ >= 0)
+      {
+         if (writable_)
+            sync();
+
+         ::close(file_descriptor_);
+      }
+
+      file_descriptor_ = -1;
+      writable_        = false;
+   }
+
+   inline bool operator!() const
+   {
+      return (file_descriptor_ < 0);
+   }
+
+   template<typename InputIterator>
+   inline bool insert(const InputIterator begin, const InputIterator end)
+   {
+      // Returns false if the filter is read-only or an I/O error occurred.
+      if (!writable_)
+         return false;
+
+      if (!process(begin,end,0))
+         return false;
+
+      header_.inserted_element_count += probes_.size();
+
+      return true;
+   }
+
+   template<typename T>
+   inline bool insert(const T& key)
+   {
+      const bloom_key_view view = details::make_key_view(key);
+      return insert(&view,&view + 1);
+   }
+
+   inline bool insert(const char* data, const std::size_t& length)
+   {
+      const bloom_key_view view(data,length);
+      return insert(&view,&view + 1);
+   }
+
+   template<typename InputIterator>
+   inline bool contains(const InputIterator begin, const InputIterator end, bool* results) const
+   {
+      /*
+        Note:
+        Writes the answer for the i-th key to results[i]. Returns false
+        on an I/O error, in which case results are undefined.
+      */
+      if (file_descriptor_ < 0)
+         return false;
+
+      return process(begin,end,results);
+   }
+
+   template<typename T>
+   inline bool contains(const T& key) const
+   {
+      // Note: An unreadable page reports the key as possibly present.
+      const bloom_key_view view = details::make_key_view(key);
+      bool result = true;
+      return !contains(&view,&view + 1,&result) || result;
+   }
+
+   inline bool contains(const char* data, const std::size_t& length) const
+   {
+      return contains(bloom_key_view(data,length));
+   }
+
+   inline unsigned long long int page_count() const
+   {
+      return header_.page_count;
+   }
+
+   inline unsigned long long int size() const
+   {
+      return header_.page_count * page_bits;
+   }
+
+   inline std::size_t hash_count() const
+   {
+      return header_.hash_count;
+   }
+
+   inline std::size_t element_count() const
+   {
+      return static_cast<std::size_t>(header_.inserted_element_count);
+   }
+
+   inline double effective_fpp() const
+   {
+      return details::paged_fpp(header_.page_count,header_.inserted_element_count,header_.hash_count,page_bits);
+   }
+
+   inline unsigned long long int pages_read() const
+   {
+      // Distinct page reads issued since open, for measuring I/O per query.
+      return pages_read_;
+   }
+
+private:
+
+   enum { window_pages = 256 };
+
+   struct probe
+   {
+      unsigned long long int page;
+      unsigned long long int hash;
+      std::size_t            index;
+
+      inline bool operator<(const probe& p) const
+      {
+         return (page < p.page);
+      }
+   };
+
+   paged_bloom_filter(const paged_bloom_filter&);
+   paged_bloom_filter& operator=(const paged_bloom_filter&);
+
+   inline void hash_key(const bloom_key_view& key, probe& p) const
+   {
+      const unsigned long long int h = details::hash64(reinterpret_cast<const unsigned char*>(key.data),key.length,header_.random_seed);
+      p.page = h % header_.page_count;
+      p.hash = details::mix64(h ^ header_.random_seed);
+   }
+
+   inline bool test_page(const unsigned char* page, const unsigned long long int hash) const
+   {
+      unsigned int h1 = static_cast<unsigned int>(hash);
+      const unsigned int h2 = static_cast<unsigned int>(hash >> 32) | 1;
+
+      for (unsigned int i = 0; i < header_.hash_count; ++i, h1 += h2)
+      {
+         const unsigned int bit = h1 & (page_bits - 1);
+
+         if ((page[bit / bits_per_char] & bit_mask[bit % bits_per_char]) != bit_mask[bit % bits_per_char])
+            return false;
+      }
+
+      return true;
+   }
+
+   inline void set_page(unsigned char* page, const unsigned long long int hash) const
+   {
+      unsigned int h1 = static_cast<unsigned int>(hash);
+      const unsigned int h2 = static_cast<unsigned int>(hash >> 32) | 1;
+
+      for (unsigned int i = 0; i < header_.hash_count; ++i, h1 += h2)
+      {
+         const unsigned int bit = h1 & (page_bits - 1);
+         page[bit / bits_per_char] |= bit_mask[bit % bits_per_char];
+      }
+   }
+
+   template<typename InputIterator>
+   inline bool process(const InputIterator begin, const InputIterator end, bool* results) const
+   {
+      // Inserts the keys when results is null, otherwise queries them.
+      probes_.clear();
+
+      for (InputIterator itr = begin; end != itr; ++itr)
+      {
+         probe p;
+         hash_key(details::make_key_view(*itr),p);
+         p.index = probes_.size();
+         probes_.push_back(p);
+      }
+
+      std::sort(probes_.begin(),probes_.end());
+
+      window_.resize(window_pages * page_size);
+
+      bool result = true;
+      std::size_t first = 0;
+
+      while (first < probes_.size())
+      {
+         // Stage up to window_pages distinct pages, one read per run of adjacent pages.
+         std::vector<std::size_t>& slots = slots_;
+         slots.clear();
+
+         std::size_t last = first;
+         std::size_t run_begin = 0;
+
+         while ((last < probes_.size()) && (slots.size() < window_pages || (probes_[last].page == probes_[last - 1].page)))
+         {
+            if ((last == first) || (probes_[last].page != probes_[last - 1].page))
+            {
+               const bool adjacent = (last != first) && (probes_[last].page == (probes_[last - 1].page + 1));
+
+               if (!adjacent && !slots.empty())
+               {
+                  queue_run(run_begin,slots.size() - run_begin,probes_[slots[run_begin]].page,true);
+                  run_begin = slots.size();
+               }
+
+               slots.push_back(last);
+            }
+
+            ++last;
+         }
+
+         queue_run(run_begin,slots.size() - run_begin,probes_[slots[run_begin]].page,true);
+
+         const bool read = queue_.flush();
+         pages_read_ += slots.size();
+
+         // Writing back pages that were not read would overwrite them.
+         if (!read && (0 == results))
+            return false;
+
+         result = read && result;
+
+         std::size_t slot = 0;
+
+         for (std::size_t i = first; i < last; ++i)
+         {
+            if ((slot + 1 < slots.size()) && (i == slots[slot + 1]))
+               ++slot;
+
+            unsigned char* page = &window_[slot * page_size];
+
+            if (results)
+               results[probes_[i].index] = test_page(page,probes_[i].hash);
+            else
+               set_page(page,probes_[i].hash);
+         }
+
+         if (0 == results)
+         {
+            run_begin = 0;
+
+            for (std::size_t s = 1; s <= slots.size(); ++s)
+            {
+               if ((s == slots.size()) || (probes_[slots[s]].page != (probes_[slots[s - 1]].page + 1)))
+               {
+                  queue_run(run_begin,s - run_begin,probes_[slots[run_begin]].page,false);
+                  run_begin = s;
+               }
+            }
+
+            result = queue_.flush() && result;
+         }
+
+         first = last;
+      }
+
+      return result;
+   }
+
+   inline void queue_run(const std::size_t slot, const std::size_t pages, const unsigned long long int page, const bool read) const
+   {
+      unsigned char* data = &window_[slot * page_size];
+      const std::size_t length = pages * page_size;
+      const unsigned long long int offset = paged_filter_file_header::table_offset + (page * page_size);
+
+      if (read)
+         queue_.read(file_descriptor_,data,length,offset);
+      else
+         queue_.write(file_descriptor_,data,length,offset);
+   }
+
+   int                                 file_descriptor_;
+   bool                                writable_;
+   paged_filter_file_header            header_;
+   mutable bloom_io_queue              queue_;
+   mutable std::vector<probe>          probes_;
+   mutable std::vector<std::size_t>    slots_;
+   mutable std::vector<unsigned char>  window_;
+   mutable unsigned long long int      pages_read_;
+};
+
+#endif
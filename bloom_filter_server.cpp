@@ -0,0 +1,620 @@
+/*
+ **************************************************************************
+ *                                                                        *
+ *                           Open Bloom Filter                            *
+ *                                                                        *
+ * Description: Bloom Filter Server                                       *
+ * Author: Arash Partow - 2000                                            *
+ * URL: http://www.partow.net                                             *
+ * URL: http://www.partow.net/programming/hashfunctions/index.html        *
+ *                                                                        *
+ * Copyright notice:                                                      *
+ * Free use of the Bloom Filter Library is permitted under the guidelines *
+ * and in accordance with the most current version of the Common Public   *
+ * License.                                                               *
+ * http://www.opensource.org/licenses/cpl1.0.php                          *
+ *                                                                        *
+ **************************************************************************
+*/
+
+
+
+/*
+   Description: This program serves a set of named, memory mapped filter
+                files to the processes of a host over a Unix domain
+                socket, so that each large filter is held only once per
+                host. Clients use bloom_filter_client (see
+                bloom_filter_client.hpp), which sends batches of keys per
+                request in the binary protocol described there.
+
+                Connections are accepted by the main thread and handed
+                round robin to one worker thread per core, each of which
+                multiplexes its connections with epoll. Queries on a
+                filter run concurrently; inserts take the filter's lock
+                exclusively. A connection with more than 4 MiB of
+                responses unsent is not read from until they drain.
+
+   Usage: bloom_filter_server [--socket=path] [--workers=N] [--read-only]
+                              name=file[:elements:fpp] ...
+
+          A filter file that does not exist is created when elements and
+          fpp are given, e.g. urls=/var/lib/bloom/urls.bf:100000000:0.001
+*/
+
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bloom_filter.hpp"
+#include "bloom_filter_mapped.hpp"
+#include "bloom_filter_client.hpp"
+
+struct served_filter
+{
+   served_filter()
+   {
+      pthread_rwlock_init(&lock,0);
+   }
+
+  ~served_filter()
+   {
+      pthread_rwlock_destroy(&lock);
+   }
+
+   std::string         name;
+   mapped_bloom_filter filter;
+   pthread_rwlock_t    lock;
+};
+
+typedef std::map<std::string,served_filter*> filter_map;
+
+// Unsent response bytes above which a connection's requests are not read.
+static const std::size_t max_pending_output = 4 * 1024 * 1024;
+
+struct connection
+{
+   connection(const int fd)
+   : socket(fd),
+     output_offset(0),
+     events(EPOLLIN)
+   {}
+
+   inline std::size_t pending_output() const
+   {
+      return output.size() - output_offset;
+   }
+
+   int                         socket;
+   std::vector<char>           input;
+   std::vector<char>           output;
+   std::size_t                 output_offset;
+   unsigned int                events;
+   std::vector<bloom_key_view> keys;
+   std::vector<char>           results;
+};
+
+struct worker
+{
+   worker()
+   : epoll_descriptor(-1),
+     filters(0)
+   {}
+
+   pthread_t         thread;
+   int               epoll_descriptor;
+   const filter_map* filters;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+   stop_requested = 1;
+}
+
+bool open_filters(int argc, char* argv[], const bool read_only, filter_map& filters);
+
+bool handle_request(connection& c, const bloom_request_header& header, const char* payload, const filter_map& filters);
+
+void* worker_main(void* arg);
+
+int main(int argc, char* argv[])
+{
+   std::string socket_path = "/tmp/bloom_filter.sock";
+   long worker_count = ::sysconf(_SC_NPROCESSORS_ONLN);
+   bool read_only = false;
+
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg = argv[i];
+
+      if (0 == arg.find("--socket="))
+         socket_path = arg.substr(9);
+      else if (0 == arg.find("--workers="))
+         worker_count = ::atol(arg.c_str() + 10);
+      else if ("--read-only" == arg)
+         read_only = true;
+      else if (0 == arg.find("--"))
+      {
+         std::cerr << "Usage: bloom_filter_server [--socket=path] [--workers=N] [--read-only] "
+                      "name=file[:elements:fpp] ..." << std::endl;
+         return 1;
+      }
+   }
+
+   filter_map filters;
+
+   if (!open_filters(argc,argv,read_only,filters) || filters.empty())
+   {
+      std::cerr << "Error - No filters could be opened." << std::endl;
+      return 1;
+   }
+
+   sockaddr_un address;
+   std::memset(&address,0,sizeof(address));
+
+   if (socket_path.size() >= sizeof(address.sun_path))
+   {
+      std::cerr << "Error - Socket path too long: " << socket_path << std::endl;
+      return 1;
+   }
+
+   address.sun_family = AF_UNIX;
+   std::memcpy(address.sun_path,socket_path.c_str(),socket_path.size());
+
+   ::unlink(socket_path.c_str());
+
+   const int listener = ::socket(AF_UNIX,SOCK_STREAM,0);
+
+   if ((listener < 0) ||
+       (0 != ::bind(listener,reinterpret_cast<const sockaddr*>(&address),sizeof(address))) ||
+       (0 != ::listen(listener,SOMAXCONN)))
+   {
+      std::cerr << "Error - Failed to listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+      return 1;
+   }
+
+   ::signal(SIGINT ,request_stop);
+   ::signal(SIGTERM,request_stop);
+   ::signal(SIGPIPE,SIG_IGN);
+
+   std::vector<worker> workers(static_cast<std::size_t>(std::max(1L,worker_count)));
+   std::size_t started = 0;
+
+   for ( ; started < workers.size(); ++started)
+   {
+      workers[started].epoll_descriptor = ::epoll_create(64);
+      workers[started].filters          = &filters;
+
+      // pthread_create returns its error rather than setting errno.
+      const int error = (workers[started].epoll_descriptor < 0) ? errno :
+                        pthread_create(&workers[started].thread,0,worker_main,&workers[started]);
+
+      if (0 != error)
+      {
+         std::cerr << "Error - Failed to start worker " << started << ": " << std::strerror(error) << std::endl;
+         break;
+      }
+   }
+
+   if (started < workers.size())
+   {
+      stop_requested = 1;
+
+      for (std::size_t i = 0; i <= started; ++i)
+      {
+         if (i < started)
+            pthread_join(workers[i].thread,0);
+
+         if (workers[i].epoll_descriptor >= 0)
+            ::close(workers[i].epoll_descriptor);
+      }
+
+      ::close(listener);
+      ::unlink(socket_path.c_str());
+
+      for (filter_map::iterator itr = filters.begin(); itr != filters.end(); ++itr)
+      {
+         delete itr->second;
+      }
+
+      return 1;
+   }
+
+   std::cerr << "Serving " << filters.size() << " filter(s) on " << socket_path
+             << " with " << workers.size() << " worker(s)" << std::endl;
+
+   std::size_t next_worker = 0;
+
+   while (!stop_requested)
+   {
+      pollfd p;
+      p.fd      = listener;
+      p.events  = POLLIN;
+      p.revents = 0;
+
+      if (::poll(&p,1,250) <= 0)
+         continue;
+
+      const int fd = ::accept(listener,0,0);
+
+      if (fd < 0)
+         continue;
+
+      ::fcntl(fd,F_SETFL,::fcntl(fd,F_GETFL) | O_NONBLOCK);
+
+      connection* c = new connection(fd);
+
+      epoll_event event;
+      event.events   = c->events;
+      event.data.ptr = c;
+
+      if (0 != ::epoll_ctl(workers[next_worker].epoll_descriptor,EPOLL_CTL_ADD,fd,&event))
+      {
+         ::close(fd);
+         delete c;
+         continue;
+      }
+
+      next_worker = (next_worker + 1) % workers.size();
+   }
+
+   for (std::size_t i = 0; i < workers.size(); ++i)
+   {
+      pthread_join(workers[i].thread,0);
+      ::close(workers[i].epoll_descriptor);
+   }
+
+   ::close(listener);
+   ::unlink(socket_path.c_str());
+
+   for (filter_map::iterator itr = filters.begin(); itr != filters.end(); ++itr)
+   {
+      delete itr->second;
+   }
+
+   return 0;
+}
+
+bool open_filters(int argc, char* argv[], const bool read_only, filter_map& filters)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg = argv[i];
+
+      if (0 == arg.find("--"))
+         continue;
+
+      const std::size_t equals = arg.find('=');
+
+      if ((std::string::npos == equals) || (0 == equals) || (equals > 255))
+      {
+         std::cerr << "Error - Invalid filter specification: " << arg << std::endl;
+         return false;
+      }
+
+      const std::string name = arg.substr(0,equals);
+      std::string file_name  = arg.substr(equals + 1);
+
+      const std::size_t colon = file_name.find(':');
+
+      if (std::string::npos != colon)
+      {
+         bloom_parameters parameters;
+         std::sscanf(file_name.c_str() + colon + 1,"%llu:%lf",
+                     &parameters.projected_element_count,
+                     &parameters.false_positive_probability);
+
+         file_name = file_name.substr(0,colon);
+
+         struct stat status;
+
+         if ((0 != ::stat(file_name.c_str(),&status)) && !mapped_bloom_filter::create(file_name,parameters))
+         {
+            std::cerr << "Error - Failed to create filter file: " << file_name << std::endl;
+            return false;
+         }
+      }
+
+      served_filter* served = new served_filter;
+      served->name = name;
+
+      if (!served->filter.open(file_name,!read_only))
+      {
+         std::cerr << "Error - Failed to open filter file: " << file_name << std::endl;
+         delete served;
+         return false;
+      }
+
+      filters[name] = served;
+   }
+
+   return true;
+}
+
+bool read_input(connection& c)
+{
+   // Returns false when the peer has closed the connection or on error.
+   char chunk[64 * 1024];
+
+   for ( ; ; )
+   {
+      const ssize_t n = ::recv(c.socket,chunk,sizeof(chunk),0);
+
+      if (n > 0)
+      {
+         c.input.insert(c.input.end(),chunk,chunk + n);
+
+         // The rest is read on the next (level triggered) event.
+         if (c.input.size() > max_pending_output)
+            return true;
+      }
+      else if (0 == n)
+         return false;
+      else if (EINTR == errno)
+         continue;
+      else
+         return (EAGAIN == errno) || (EWOULDBLOCK == errno);
+   }
+}
+
+bool process_input(connection& c, const filter_map& filters)
+{
+   std::size_t offset = 0;
+
+   // Requests wait in the input while too many responses are unsent.
+   while (((c.input.size() - offset) >= sizeof(bloom_request_header)) && (c.pending_output() <= max_pending_output))
+   {
+      bloom_request_header header;
+      std::memcpy(&header,&c.input[offset],sizeof(header));
+
+      if ((bloom_protocol::request_magic != header.magic) ||
+          (header.payload_length > bloom_protocol::max_payload_length))
+      {
+         return false;
+      }
+
+      if ((c.input.size() - offset - sizeof(header)) < header.payload_length)
+         break;
+
+      if (!handle_request(c,header,&c.input[offset + sizeof(header)],filters))
+         return false;
+
+      offset += sizeof(header) + header.payload_length;
+   }
+
+   c.input.erase(c.input.begin(),c.input.begin() + offset);
+
+   return true;
+}
+
+bool flush_output(connection& c, const int epoll_descriptor)
+{
+   while (c.output_offset < c.output.size())
+   {
+      const ssize_t n = ::send(c.socket,&c.output[c.output_offset],c.output.size() - c.output_offset,MSG_NOSIGNAL);
+
+      if (n >= 0)
+         c.output_offset += static_cast<std::size_t>(n);
+      else if (EINTR == errno)
+         continue;
+      else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+         break;
+      else
+         return false;
+   }
+
+   const std::size_t pending = c.pending_output();
+
+   if (0 == pending)
+   {
+      c.output.clear();
+      c.output_offset = 0;
+   }
+
+   // Above the bound only writability is waited for, so the peer cannot grow the output further.
+   const unsigned int events = (pending > max_pending_output) ? EPOLLOUT : (pending ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+
+   if (events != c.events)
+   {
+      epoll_event event;
+      event.events   = events;
+      event.data.ptr = &c;
+      ::epoll_ctl(epoll_descriptor,EPOLL_CTL_MOD,c.socket,&event);
+      c.events = events;
+   }
+
+   return true;
+}
+
+bool serve_connection(connection& c, const filter_map& filters, const int epoll_descriptor)
+{
+   // Handles and sends until input runs out or the socket stops draining the output.
+   for ( ; ; )
+   {
+      if (!process_input(c,filters))
+         return false;
+
+      const bool blocked = (c.pending_output() > max_pending_output);
+
+      if (!flush_output(c,epoll_descriptor))
+         return false;
+
+      if (!blocked || (c.pending_output() > max_pending_output))
+         return true;
+   }
+}
+
+void* worker_main(void* arg)
+{
+   worker& w = *static_cast<worker*>(arg);
+
+   std::set<connection*> open_connections;
+   epoll_event events[64];
+
+   while (!stop_requested)
+   {
+      const int count = ::epoll_wait(w.epoll_descriptor,events,64,250);
+
+      for (int i = 0; i < count; ++i)
+      {
+         connection& c = *static_cast<connection*>(events[i].data.ptr);
+
+         open_connections.insert(&c);
+
+         bool alive = true;
+
+         if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+         {
+            alive = read_input(c);
+         }
+
+         alive = alive && serve_connection(c,*w.filters,w.epoll_descriptor);
+
+         if (!alive)
+         {
+            // Best effort delivery of a final error response.
+            flush_output(c,w.epoll_descriptor);
+
+            ::epoll_ctl(w.epoll_descriptor,EPOLL_CTL_DEL,c.socket,0);
+            ::close(c.socket);
+            open_connections.erase(&c);
+            delete &c;
+         }
+      }
+   }
+
+   for (std::set<connection*>::iterator itr = open_connections.begin(); itr != open_connections.end(); ++itr)
+   {
+      ::close((*itr)->socket);
+      delete *itr;
+   }
+
+   return 0;
+}
+
+void append_response(connection& c, const unsigned char status, const unsigned int key_count, const char* payload, const std::size_t length)
+{
+   bloom_response_header header;
+   std::memset(&header,0,sizeof(header));
+   header.magic          = bloom_protocol::response_magic;
+   header.status         = status;
+   header.key_count      = key_count;
+   header.payload_length = static_cast<unsigned int>(length);
+
+   c.output.insert(c.output.end(),reinterpret_cast<const char*>(&header),reinterpret_cast<const char*>(&header) + sizeof(header));
+   c.output.insert(c.output.end(),payload,payload + length);
+}
+
+bool handle_request(connection& c, const bloom_request_header& header, const char* payload, const filter_map& filters)
+{
+   /*
+     Note:
+     Returns false only when the request cannot be framed, in which
+     case the connection is dropped. Other errors are reported to the
+     client in the response status.
+   */
+   const unsigned long long int fixed_length = header.name_length + (static_cast<unsigned long long int>(header.key_count) * sizeof(unsigned int));
+
+   if ((header.key_count > bloom_protocol::max_key_count) || (fixed_length > header.payload_length))
+   {
+      append_response(c,bloom_protocol::e_malformed,0,0,0);
+      return false;
+   }
+
+   const std::string name(payload,header.name_length);
+   const char* lengths = payload + header.name_length;
+   const char* key     = lengths + (header.key_count * sizeof(unsigned int));
+   const char* end     = payload + header.payload_length;
+
+   c.keys.resize(header.key_count);
+
+   for (std::size_t i = 0; i < header.key_count; ++i)
+   {
+      unsigned int length = 0;
+      std::memcpy(&length,lengths + (i * sizeof(unsigned int)),sizeof(length));
+
+      if (length > static_cast<std::size_t>(end - key))
+      {
+         append_response(c,bloom_protocol::e_malformed,0,0,0);
+         return false;
+      }
+
+      c.keys[i] = bloom_key_view(key,length);
+      key += length;
+   }
+
+   const filter_map::const_iterator itr = filters.find(name);
+
+   if (filters.end() == itr)
+   {
+      append_response(c,bloom_protocol::e_unknown_filter,header.key_count,0,0);
+      return true;
+   }
+
+   served_filter& served = *itr->second;
+
+   switch (header.opcode)
+   {
+      case bloom_protocol::e_contains :
+         {
+            c.results.resize(header.key_count);
+
+            pthread_rwlock_rdlock(&served.lock);
+
+            if (!c.keys.empty())
+               served.filter.contains_interleaved(c.keys.begin(),c.keys.end(),reinterpret_cast<bool*>(&c.results[0]));
+
+            pthread_rwlock_unlock(&served.lock);
+
+            std::vector<char> bitmap((header.key_count + 7) / 8,0);
+
+            for (std::size_t i = 0; i < header.key_count; ++i)
+            {
+               if (c.results[i])
+                  bitmap[i / 8] |= bit_mask[i % 8];
+            }
+
+            append_response(c,bloom_protocol::e_ok,header.key_count,bitmap.empty() ? 0 : &bitmap[0],bitmap.size());
+         }
+         break;
+
+      case bloom_protocol::e_insert :
+         {
+            if (!served.filter.writable())
+            {
+               append_response(c,bloom_protocol::e_read_only,header.key_count,0,0);
+               break;
+            }
+
+            pthread_rwlock_wrlock(&served.lock);
+            served.filter.insert(c.keys.begin(),c.keys.end());
+            pthread_rwlock_unlock(&served.lock);
+
+            append_response(c,bloom_protocol::e_ok,header.key_count,0,0);
+         }
+         break;
+
+      default : append_response(c,bloom_protocol::e_malformed,header.key_count,0,0);
+   }
+
+   return true;
+}